@@ -0,0 +1,574 @@
+#pragma once
+#include <memory>     //std::unique_ptr
+#ifdef _WIN32
+#include <direct.h>   //_mkdir
+#else
+#include <dirent.h>   //opendir
+#endif
+#include "Serialization.h"
+
+namespace BS {
+
+	////////////////////////////////////////////
+	//Deduplicating snapshot store
+	//A snapshot is cut into content-defined chunks by a gear rolling hash, so
+	//a local change only alters the chunks around it and the rest are shared
+	//with earlier snapshots.
+	//<dir>/<id>.chunk   one file per distinct chunk, id = FNV-1a and CRC-32C
+	//                   of its bytes
+	//<dir>/<name>.snap  manifest: magic, total size (uint64), chunk count
+	//                   (uint64), then a ChunkRef per chunk
+	//Not safe for concurrent writers on the same directory.
+	///////////////////////////////////////////
+	static const char CHUNK_MANIFEST_MAGIC[8] = { 'B', 'S', 'C', 'H', 'N', 'K', '0', '1' };
+
+	struct ChunkRef
+	{
+		uint64_t hash;
+		uint32_t crc;
+		uint32_t len;
+	};
+
+	struct ChunkStats
+	{
+		uint64_t chunks;
+		uint64_t new_chunks;
+		uint64_t bytes;
+		uint64_t new_bytes;
+	};
+
+
+	inline bool dir_create(const std::string &dir)
+	{
+#ifdef _WIN32
+		return _mkdir(dir.c_str()) == 0 || errno == EEXIST;
+#else
+		return mkdir(dir.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+	}
+
+	//names of the files in dir
+	inline std::vector<std::string> dir_list(const std::string &dir)
+	{
+		std::vector<std::string> names;
+#ifdef _WIN32
+		WIN32_FIND_DATAA fd;
+		HANDLE h = FindFirstFileA((dir + "\\*").c_str(), &fd);
+		if (h == INVALID_HANDLE_VALUE)
+		{
+			return names;
+		}
+		do
+		{
+			if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+				names.push_back(fd.cFileName);
+		} while (FindNextFileA(h, &fd));
+		FindClose(h);
+#else
+		DIR *d = opendir(dir.c_str());
+		if (d == NULL)
+		{
+			return names;
+		}
+		while (struct dirent *e = readdir(d))
+		{
+			if (e->d_name[0] != '.')
+				names.push_back(e->d_name);
+		}
+		closedir(d);
+#endif
+		return names;
+	}
+
+	inline bool file_exists(const std::string &filename)
+	{
+#ifdef _WIN32
+		struct _stat64 st;
+		return _stat64(filename.c_str(), &st) == 0;
+#else
+		struct stat st;
+		return stat(filename.c_str(), &st) == 0;
+#endif
+	}
+
+
+	//gear table for the rolling hash: fixed pseudo-random values
+	inline const uint64_t* gear_table()
+	{
+		struct Table
+		{
+			uint64_t v[256];
+			Table()
+			{
+				uint64_t x = 0x9E3779B97F4A7C15ull;
+				for (int i = 0; i < 256; ++i)
+				{
+					//splitmix64
+					uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+					z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+					z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+					v[i] = z ^ (z >> 31);
+				}
+			}
+		};
+		static const Table t;
+		return t.v;
+	}
+
+
+	class ChunkStore
+	{
+	public:
+		//chunk sizes: at least min_size, about avg_size (a power of two), at most max_size
+		explicit ChunkStore(const std::string &directory, size_t min_size = 2048, size_t avg_size = 8192, size_t max_size = 65536)
+			: dir(directory), min_chunk(min_size), max_chunk(max_size), mask(0)
+		{
+			dir_create(dir);
+			int bits = 0;
+			while (((size_t)1 << (bits + 1)) <= avg_size)
+			{
+				++bits;
+			}
+			//gear hash bits depend on more input the higher they are
+			mask = bits ? (((uint64_t)1 << bits) - 1) << (64 - bits) : 0;
+		}
+
+		//serialize a as snapshot name; stats, if given, shows how much was new
+		template<typename SerializableType>
+		bool save(const std::string &name, SerializableType &a, ChunkStats *stats = NULL);
+
+		//deserialize snapshot name into a
+		template<typename SerializableType>
+		bool restore(const std::string &name, SerializableType &a);
+
+		bool remove(const std::string &name)
+		{
+			return std::remove(manifest_path(name).c_str()) == 0;
+		}
+
+		//delete chunks no snapshot refers to; returns how many were deleted
+		size_t collect()
+		{
+			std::vector<std::string> files = dir_list(dir);
+			std::set<std::string> live;
+			for (size_t i = 0; i < files.size(); ++i)
+			{
+				if (ends_with(files[i], ".snap"))
+				{
+					std::vector<ChunkRef> refs;
+					uint64_t total;
+					if (!load_manifest(files[i].substr(0, files[i].size() - 5), refs, total))
+					{
+						return 0; //unreadable manifest: keep everything
+					}
+					for (size_t k = 0; k < refs.size(); ++k)
+					{
+						live.insert(chunk_name(refs[k]));
+					}
+				}
+			}
+			size_t removed = 0;
+			for (size_t i = 0; i < files.size(); ++i)
+			{
+				if (ends_with(files[i], ".chunk") && live.find(files[i]) == live.end())
+				{
+					removed += std::remove((dir + "/" + files[i]).c_str()) == 0;
+				}
+			}
+			return removed;
+		}
+
+		bool load_manifest(const std::string &name, std::vector<ChunkRef> &refs, uint64_t &total) const
+		{
+			MappedFile f(manifest_path(name));
+			uint64_t count = 0;
+			size_t head = sizeof(CHUNK_MANIFEST_MAGIC) + 2 * sizeof(uint64_t);
+			if (!f.is_open() || f.size() < head || memcmp(f.data(), CHUNK_MANIFEST_MAGIC, sizeof(CHUNK_MANIFEST_MAGIC)) != 0)
+			{
+				return false;
+			}
+			memcpy(&total, f.data() + sizeof(CHUNK_MANIFEST_MAGIC), sizeof(total));
+			memcpy(&count, f.data() + sizeof(CHUNK_MANIFEST_MAGIC) + sizeof(total), sizeof(count));
+			if (f.size() != head + count * sizeof(ChunkRef))
+			{
+				return false;
+			}
+			refs.resize((size_t)count);
+			if (count)
+			{
+				memcpy(&refs[0], f.data() + head, (size_t)count * sizeof(ChunkRef));
+			}
+			return true;
+		}
+
+		std::string chunk_path(const ChunkRef &r) const
+		{
+			return dir + "/" + chunk_name(r);
+		}
+
+		//store one chunk unless it is already there
+		bool put_chunk(const char *p, size_t n, ChunkRef &r, bool &added)
+		{
+			r.hash = key_hash(p, n);
+			r.crc = crc32c(p, n);
+			r.len = (uint32_t)n;
+			std::string path = chunk_path(r);
+			added = !file_exists(path);
+			if (!added)
+			{
+				return true;
+			}
+			std::string tmp = path + ".tmp";
+			int fd = file_open_write(tmp);
+			if (fd < 0)
+			{
+				return false;
+			}
+			bool ok = write_all(fd, p, n) && file_sync(fd);
+			file_close(fd);
+			return ok && file_replace(tmp, path);
+		}
+
+		bool write_manifest(const std::string &name, const std::vector<ChunkRef> &refs, uint64_t total) const
+		{
+			std::string path = manifest_path(name), tmp = path + ".tmp";
+			int fd = file_open_write(tmp);
+			if (fd < 0)
+			{
+				return false;
+			}
+			uint64_t count = refs.size();
+			bool ok = write_all(fd, CHUNK_MANIFEST_MAGIC, sizeof(CHUNK_MANIFEST_MAGIC))
+				&& write_all(fd, (const char*)&total, sizeof(total))
+				&& write_all(fd, (const char*)&count, sizeof(count))
+				&& (refs.empty() || write_all(fd, (const char*)&refs[0], refs.size() * sizeof(ChunkRef)))
+				&& file_sync(fd);
+			file_close(fd);
+			return ok && file_replace(tmp, path);
+		}
+
+		size_t min_size() const { return min_chunk; }
+		size_t max_size() const { return max_chunk; }
+		uint64_t cut_mask() const { return mask; }
+
+	private:
+		std::string manifest_path(const std::string &name) const
+		{
+			return dir + "/" + name + ".snap";
+		}
+
+		static std::string chunk_name(const ChunkRef &r)
+		{
+			char s[32];
+			snprintf(s, sizeof(s), "%016llx%08x", (unsigned long long)r.hash, (unsigned)r.crc);
+			return std::string(s) + ".chunk";
+		}
+
+		static bool ends_with(const std::string &s, const char *suffix)
+		{
+			size_t n = strlen(suffix);
+			return s.size() > n && s.compare(s.size() - n, n, suffix) == 0;
+		}
+
+		std::string dir;
+		size_t min_chunk;
+		size_t max_chunk;
+		uint64_t mask;
+	};
+
+
+	//Buffer that cuts the stream into chunks as it is written
+	class ChunkBuffer
+	{
+	public:
+		ChunkBuffer() : store(NULL), used(0), scanned(0), h(0), ok(true)
+		{
+			memset(&st, 0, sizeof(st));
+		}
+
+		void attach(ChunkStore *s)
+		{
+			store = s;
+			pending.resize(s->max_size());
+		}
+
+		void write(const char *p, size_t n)
+		{
+			while (n > 0)
+			{
+				size_t k = pending.size() - used < n ? pending.size() - used : n;
+				memcpy(&pending[0] + used, p, k);
+				used += k;
+				st.bytes += k;
+				p += k;
+				n -= k;
+				cut();
+			}
+		}
+		void write_ref(const char *p, size_t n) { write(p, n); }
+
+		char* spare() { return &pending[0] + used; }
+		size_t spare_size() const { return pending.size() - used; }
+		bool reserve(size_t n)
+		{
+			if (n > pending.size() - used)
+			{
+				pending.resize(used + n);
+			}
+			return true;
+		}
+		void commit(size_t n)
+		{
+			used += n;
+			st.bytes += n;
+			cut();
+		}
+
+		size_t size() const { return (size_t)st.bytes; }
+
+		//store the last chunk and write the manifest
+		bool finish(const std::string &name)
+		{
+			if (used > 0)
+			{
+				emit(used);
+			}
+			return ok && store->write_manifest(name, refs, st.bytes);
+		}
+
+		const ChunkStats& stats() const { return st; }
+
+	private:
+		ChunkBuffer(const ChunkBuffer&);
+		ChunkBuffer& operator=(const ChunkBuffer&);
+
+		//cut every chunk boundary found in pending
+		void cut()
+		{
+			const uint64_t *gear = gear_table();
+			size_t min = store->min_size(), max = store->max_size();
+			uint64_t mask = store->cut_mask();
+			for (;;)
+			{
+				//the hash only sees the last 64 bytes: no need to roll it
+				//over the start of a chunk that is too short to cut anyway
+				size_t i = scanned, end = used < max ? used : max;
+				if (i + 64 < min)
+				{
+					i = min - 64;
+				}
+				size_t at = 0;
+				for (; i < end; ++i)
+				{
+					h = (h << 1) + gear[(unsigned char)pending[i]];
+					if (i + 1 >= min && (h & mask) == 0)
+					{
+						at = i + 1;
+						break;
+					}
+				}
+				if (at == 0 && used >= max)
+				{
+					at = max;
+				}
+				if (at == 0)
+				{
+					scanned = i;
+					return;
+				}
+				emit(at);
+			}
+		}
+
+		//store the first n pending bytes as a chunk
+		void emit(size_t n)
+		{
+			ChunkRef r;
+			bool added = false;
+			ok = store->put_chunk(pending.data(), n, r, added) && ok;
+			refs.push_back(r);
+			++st.chunks;
+			if (added)
+			{
+				++st.new_chunks;
+				st.new_bytes += n;
+			}
+			memmove(&pending[0], &pending[0] + n, used - n);
+			used -= n;
+			scanned = 0;
+			h = 0;
+		}
+
+		ChunkStore *store;
+		std::string pending;
+		size_t used;
+		size_t scanned;
+		uint64_t h;
+		std::vector<ChunkRef> refs;
+		ChunkStats st;
+		bool ok;
+	};
+
+
+	class ChunkOutStream : public BasicOutStream<ChunkBuffer>
+	{
+	public:
+		explicit ChunkOutStream(ChunkStore &store)
+		{
+			buf.attach(&store);
+		}
+
+		//end the snapshot and record it under name
+		bool finish(const std::string &name)
+		{
+			return buf.finish(name);
+		}
+
+		const ChunkStats& stats() const
+		{
+			return buf.stats();
+		}
+	};
+
+
+	//a stored snapshot read as one InStream
+	//chunks are mapped as the reads reach them, at most window at a time,
+	//and each is checked against its CRC-32C when it is mapped; a missing
+	//or damaged chunk fails the stream at that point
+	class ChunkReader : public SegmentSource
+	{
+	public:
+		ChunkReader(const ChunkStore &store, const std::string &name, size_t window = 8)
+			: store(store), clock(0), ok(false)
+		{
+			uint64_t total = 0, sum = 0;
+			if (!store.load_manifest(name, refs, total))
+			{
+				return;
+			}
+			for (size_t i = 0; i < refs.size(); ++i)
+			{
+				sum += refs[i].len;
+			}
+			ok = sum == total;
+			if (ok)
+			{
+				slots.resize(window ? window : 1);
+				for (size_t i = 0; i < slots.size(); ++i)
+				{
+					slots[i].file.reset(new MappedFile());
+					slots[i].chunk = refs.size();
+					slots[i].used = 0;
+				}
+				in.reset(new InStream(*this));
+			}
+		}
+
+		//false if the manifest is missing or damaged
+		bool is_open() const
+		{
+			return ok;
+		}
+
+		InStream& stream()
+		{
+			return *in;
+		}
+
+		//the chunks, e.g. to push into an IncrementalDecoder one at a time
+		size_t count() const
+		{
+			return refs.size();
+		}
+
+		size_t length(size_t i) const
+		{
+			return refs[i].len;
+		}
+
+		//chunk i, mapped and checked; valid until window other chunks have
+		//been asked for
+		bool segment(size_t i, IoSlice &s)
+		{
+			if (i >= refs.size())
+			{
+				return false;
+			}
+			Slot *victim = &slots[0];
+			for (size_t k = 0; k < slots.size(); ++k)
+			{
+				if (slots[k].chunk == i)
+				{
+					victim = &slots[k];
+					break;
+				}
+				if (slots[k].used < victim->used)
+				{
+					victim = &slots[k];
+				}
+			}
+			MappedFile &f = *victim->file;
+			if (victim->chunk != i)
+			{
+				victim->chunk = refs.size();
+				if (!f.open(store.chunk_path(refs[i])) || f.size() != refs[i].len
+					|| crc32c(f.data(), f.size()) != refs[i].crc)
+				{
+					f.close();
+					return false;
+				}
+				victim->chunk = i;
+			}
+			victim->used = ++clock;
+			s.base = f.data();
+			s.len = f.size();
+			return true;
+		}
+
+	private:
+		ChunkReader(const ChunkReader&);
+		ChunkReader& operator=(const ChunkReader&);
+
+		//a mapped chunk; chunk == refs.size() when the slot is empty
+		struct Slot
+		{
+			std::unique_ptr<MappedFile> file;
+			size_t chunk;
+			uint64_t used;
+		};
+
+		const ChunkStore &store;
+		std::vector<ChunkRef> refs;
+		std::vector<Slot> slots;
+		uint64_t clock;
+		std::unique_ptr<InStream> in;
+		bool ok;
+	};
+
+
+	template<typename SerializableType>
+	bool ChunkStore::save(const std::string &name, SerializableType &a, ChunkStats *stats)
+	{
+		ChunkOutStream out(*this);
+		out << a;
+		bool ok = out.finish(name);
+		if (stats)
+		{
+			*stats = out.stats();
+		}
+		return ok;
+	}
+
+	template<typename SerializableType>
+	bool ChunkStore::restore(const std::string &name, SerializableType &a)
+	{
+		ChunkReader r(*this, name);
+		if (!r.is_open())
+		{
+			return false;
+		}
+		r.stream() >> a;
+		return r.stream().good();
+	}
+
+}//namespace BS
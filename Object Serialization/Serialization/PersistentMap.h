@@ -0,0 +1,441 @@
+#pragma once
+#include <thread>             //std::thread
+#include <condition_variable> //std::condition_variable
+#include <chrono>
+#include <memory>             //std::unique_ptr
+#include "RecordLog.h"
+
+namespace BS {
+
+	////////////////////////////////////////////
+	//Incrementally persisted std::map
+	//<name>.base      snapshot in the binary map format
+	//<name>.manifest  magic, then the last log generation folded into the base
+	//<name>.wal.<g>   record log of the puts and erases of generation g
+	//Recovery loads the base and replays the logs after the manifest's
+	//generation. Replaying a log the base already holds is harmless, since
+	//every operation sets the final state of its key
+	//A change is logged before it is applied. If logging fails, or the base
+	//cannot be read back, the map stops taking changes: is_open() turns
+	//false and put, erase, sync and compact fail
+	///////////////////////////////////////////
+	static const char PERSISTENT_MAP_MAGIC[8] = { 'B', 'S', 'P', 'M', 'A', 'P', '0', '1' };
+
+	template<typename BasicTypeA, typename BasicTypeB>
+	class PersistentMap
+	{
+	public:
+		explicit PersistentMap(const std::string &filename) : name(filename), gen(1), ops(0), ok(false), stopping(false)
+		{
+			ok = recover();
+		}
+
+		~PersistentMap()
+		{
+			stop_compactor();
+		}
+
+		//false if recovery failed or a log write has failed since
+		bool is_open() const
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			return ok;
+		}
+
+		//log the change, then insert or assign; false (and the map
+		//unchanged) if the change could not be logged
+		bool put(const BasicTypeA &key, const BasicTypeB &value)
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			scratch.clear();
+			scratch << 'I' << key << value;
+			if (!append_op())
+			{
+				return false;
+			}
+			data[key] = value;
+			return true;
+		}
+
+		//false if key is missing or the erase could not be logged
+		bool erase(const BasicTypeA &key)
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			typename std::map<BasicTypeA, BasicTypeB>::iterator it = data.find(key);
+			if (it == data.end())
+			{
+				return false;
+			}
+			scratch.clear();
+			scratch << 'E' << key;
+			if (!append_op())
+			{
+				return false;
+			}
+			data.erase(it);
+			return true;
+		}
+
+		bool get(const BasicTypeA &key, BasicTypeB &value) const
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			typename std::map<BasicTypeA, BasicTypeB>::const_iterator it = data.find(key);
+			if (it == data.end())
+			{
+				return false;
+			}
+			value = it->second;
+			return true;
+		}
+
+		size_t size() const
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			return data.size();
+		}
+
+		//copy of the current contents
+		std::map<BasicTypeA, BasicTypeB> snapshot() const
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			return data;
+		}
+
+		//make every change so far durable
+		bool sync()
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			ok = ok && log->sync();
+			return ok;
+		}
+
+		//start a new log and fold the finished ones into a new base
+		//the live map is not touched: the base is merged with the logged
+		//changes file to file, so writers are only blocked for the log switch
+		bool compact()
+		{
+			std::lock_guard<std::mutex> one_at_a_time(compact_mtx);
+			uint64_t last;
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				if (!ok)
+				{
+					return false;
+				}
+				if (ops == 0)
+				{
+					return true;
+				}
+				ok = log->sync();
+				if (!ok)
+				{
+					return false;
+				}
+				last = gen++;
+				log.reset(new RecordLogWriter(wal_name(gen), 64 * 1024, false));
+				ops = 0;
+			}
+			return fold(last);
+		}
+
+		//compact in the background whenever at least min_ops changes have
+		//been logged, checking every interval_ms
+		void start_compactor(size_t min_ops, int interval_ms = 1000)
+		{
+			stop_compactor();
+			stopping = false;
+			worker = std::thread([this, min_ops, interval_ms]() {
+				std::unique_lock<std::mutex> lk(bg_mtx);
+				while (!stopping)
+				{
+					bg_cv.wait_for(lk, std::chrono::milliseconds(interval_ms));
+					if (!stopping && pending_ops() >= min_ops)
+					{
+						lk.unlock();
+						compact();
+						lk.lock();
+					}
+				}
+			});
+		}
+
+		void stop_compactor()
+		{
+			{
+				std::lock_guard<std::mutex> lk(bg_mtx);
+				stopping = true;
+			}
+			bg_cv.notify_all();
+			if (worker.joinable())
+			{
+				worker.join();
+			}
+		}
+
+		//changes logged since the last compaction
+		size_t pending_ops() const
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			return ops;
+		}
+
+		//generation of the log being written
+		uint64_t generation() const
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			return gen;
+		}
+
+	private:
+		PersistentMap(const PersistentMap&);
+		PersistentMap& operator=(const PersistentMap&);
+
+		//a logged change; erased = true for an erase
+		struct Op
+		{
+			bool erased;
+			BasicTypeB value;
+		};
+		typedef std::map<BasicTypeA, Op> OpMap;
+
+		//append the op in scratch to the log
+		//a failed write may also have dropped earlier buffered ops that are
+		//already in data, so the map takes no more changes after it
+		bool append_op()
+		{
+			ok = ok && log->append_raw(scratch.data(), scratch.size());
+			ops += ok;
+			return ok;
+		}
+
+		std::string wal_name(uint64_t g) const
+		{
+			std::ostringstream os;
+			os << name << ".wal." << g;
+			return os.str();
+		}
+
+		uint64_t read_manifest() const
+		{
+			MappedFile f(name + ".manifest");
+			uint64_t g = 0;
+			if (f.is_open() && f.size() == sizeof(PERSISTENT_MAP_MAGIC) + sizeof(g)
+				&& memcmp(f.data(), PERSISTENT_MAP_MAGIC, sizeof(PERSISTENT_MAP_MAGIC)) == 0)
+			{
+				memcpy(&g, f.data() + sizeof(PERSISTENT_MAP_MAGIC), sizeof(g));
+			}
+			return g;
+		}
+
+		bool write_manifest(uint64_t g) const
+		{
+			std::string tmp = name + ".manifest.tmp";
+			int fd = file_open_write(tmp);
+			if (fd < 0)
+			{
+				return false;
+			}
+			bool ok = write_all(fd, PERSISTENT_MAP_MAGIC, sizeof(PERSISTENT_MAP_MAGIC))
+				&& write_all(fd, (const char*)&g, sizeof(g)) && file_sync(fd);
+			file_close(fd);
+			return ok && file_replace(tmp, name + ".manifest");
+		}
+
+		//apply the changes of log g, in order, to a map or an OpMap
+		//returns false if there is no such log
+		template<typename Target>
+		bool replay(uint64_t g, Target &target, size_t *count = NULL) const
+		{
+			RecordLogReader r(wal_name(g));
+			if (!r.is_open())
+			{
+				return false;
+			}
+			const char *p;
+			size_t n;
+			while (r.next(p, n))
+			{
+				InStream ie(p, n);
+				char op = 0;
+				BasicTypeA key;
+				ie >> op >> key;
+				if (op == 'I')
+				{
+					BasicTypeB value;
+					ie >> value;
+					if (ie.good())
+						apply_put(target, key, value);
+				}
+				else if (op == 'E' && ie.good())
+				{
+					apply_erase(target, key);
+				}
+				if (count)
+					++*count;
+			}
+			return true;
+		}
+
+		static void apply_put(std::map<BasicTypeA, BasicTypeB> &m, const BasicTypeA &k, const BasicTypeB &v) { m[k] = v; }
+		static void apply_erase(std::map<BasicTypeA, BasicTypeB> &m, const BasicTypeA &k) { m.erase(k); }
+		static void apply_put(OpMap &m, const BasicTypeA &k, const BasicTypeB &v) { Op op = { false, v }; m[k] = op; }
+		static void apply_erase(OpMap &m, const BasicTypeA &k) { Op op = { true, BasicTypeB() }; m[k] = op; }
+
+		//false if the base is damaged or the log cannot be opened
+		bool recover()
+		{
+			uint64_t folded = read_manifest();
+			MappedFile base(name + ".base");
+			if (base.is_open() && base.size() > 0)
+			{
+				InStream ie(base.data(), base.size());
+				ie >> data;
+				if (!ie.good() || (size_t)ie.size() != base.size())
+				{
+					data.clear();
+					return false; //truncated or corrupt: do not log on top of it
+				}
+			}
+			uint64_t g = folded + 1;
+			while (replay(g, data, &ops)) //replayed changes still wait for compaction
+			{
+				++g;
+			}
+			gen = g > folded + 1 ? g - 1 : folded + 1; //keep appending to the newest log
+			log.reset(new RecordLogWriter(wal_name(gen), 64 * 1024, false));
+			return log->is_open();
+		}
+
+		//merge the base with logs up to last into a new base, then retire the logs
+		bool fold(uint64_t last)
+		{
+			uint64_t folded = read_manifest();
+			OpMap changes;
+			for (uint64_t g = folded + 1; g <= last; ++g)
+			{
+				replay(g, changes);
+			}
+
+			std::string tmp = name + ".base.tmp";
+			bool ok;
+			{
+				MappedFile base(name + ".base");
+				FileOutStream out(tmp);
+				ok = out.good() && merge(base, changes, out) && out.sync();
+				out.close();
+			}
+			ok = ok && file_replace(tmp, name + ".base") && write_manifest(last);
+			if (ok)
+			{
+				for (uint64_t g = folded + 1; g <= last; ++g)
+				{
+					std::remove(wal_name(g).c_str());
+				}
+			}
+			return ok;
+		}
+
+		//stream base + changes out in the map format: count, keys, count, values
+		//base keys and changes are both sorted, so they are merged in step
+		static bool merge(const MappedFile &base, const OpMap &changes, FileOutStream &out)
+		{
+			const char *p = base.size() > 0 ? base.data() : NULL;
+			size_t n = base.size();
+
+			size_t count = 0;
+			typename OpMap::const_iterator it;
+			for (it = changes.begin(); it != changes.end(); ++it)
+			{
+				count += !it->second.erased;
+			}
+			{
+				InStream ie(p, n);
+				if (n > 0)
+				{
+					ie.for_each<BasicTypeA>([&](BasicTypeA &k) { count += changes.find(k) == changes.end(); });
+				}
+			}
+
+			out << (int)count;
+			it = changes.begin();
+			{
+				InStream ie(p, n);
+				if (n > 0)
+				{
+					ie.for_each<BasicTypeA>([&](BasicTypeA &k) {
+						for (; it != changes.end() && it->first < k; ++it)
+						{
+							if (!it->second.erased)
+								out << it->first;
+						}
+						if (it != changes.end() && !(k < it->first))
+						{
+							if (!it->second.erased)
+								out << it->first;
+							++it;
+						}
+						else
+						{
+							out << k;
+						}
+					});
+				}
+				for (; it != changes.end(); ++it)
+				{
+					if (!it->second.erased)
+						out << it->first;
+				}
+			}
+
+			out << (int)count;
+			it = changes.begin();
+			bool ok = true;
+			{
+				InStream ie(p, n);
+				if (n > 0)
+				{
+					ie.for_each_entry<BasicTypeA, BasicTypeB>([&](BasicTypeA &k, BasicTypeB &v) {
+						for (; it != changes.end() && it->first < k; ++it)
+						{
+							if (!it->second.erased)
+								out << it->second.value;
+						}
+						if (it != changes.end() && !(k < it->first))
+						{
+							if (!it->second.erased)
+								out << it->second.value;
+							++it;
+						}
+						else
+						{
+							out << v;
+						}
+					});
+					ok = ie.good();
+				}
+				for (; it != changes.end(); ++it)
+				{
+					if (!it->second.erased)
+						out << it->second.value;
+				}
+			}
+			return ok;
+		}
+
+		std::string name;
+		mutable std::mutex mtx; //guards data, log, gen, ops and ok
+		std::map<BasicTypeA, BasicTypeB> data;
+		std::unique_ptr<RecordLogWriter> log;
+		SmallOutStream<1024> scratch;
+		uint64_t gen;
+		size_t ops;
+		bool ok;
+
+		std::mutex compact_mtx;
+		std::mutex bg_mtx;
+		std::condition_variable bg_cv;
+		bool stopping;
+		std::thread worker;
+	};
+
+}//namespace BS
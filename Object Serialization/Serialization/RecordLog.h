@@ -0,0 +1,903 @@
+#pragma once
+#include "Serialization.h"
+
+namespace BS {
+
+	////////////////////////////////////////////
+	//Append-only record log
+	//file:  magic (8 bytes), then one frame per record
+	//frame: payload length (uint32), crc32c of length and payload (uint32), payload
+	//A crash can leave a torn frame at the end; readers stop at the last
+	//frame whose checksum matches and writers cut the file back to it.
+	//The length is part of the checksum so that zeros (a preallocated or
+	//zero-filled tail) never pass for an empty frame
+	///////////////////////////////////////////
+	static const char RECORD_LOG_MAGIC[8] = { 'B', 'S', 'R', 'L', 'O', 'G', '0', '2' };
+	static const size_t RECORD_FRAME_HEADER = 2 * sizeof(uint32_t);
+
+	inline uint32_t record_frame_crc(const char *data, uint32_t len)
+	{
+		return crc32c(data, len, crc32c(&len, sizeof(len)));
+	}
+
+	////////////////////////////////////////////
+	//Sidecar indexes, kept next to the log by RecordLogWriter
+	//<log>.idx:  magic, then the file offset of record k as uint64 at slot k
+	//<log>.keydata: magic, then one entry per append_keyed() in append order:
+	//            record offset (uint64), key length (uint32), encoded key
+	//<log>.keys: magic, capacity, count, covered, then an open-addressing
+	//            table of (64-bit key hash, entry position in <log>.keydata);
+	//            position 0 marks a free slot. covered is the length of
+	//            <log>.keydata whose entries are in the table
+	///////////////////////////////////////////
+	static const char RECORD_INDEX_MAGIC[8] = { 'B', 'S', 'R', 'I', 'D', 'X', '0', '1' };
+	static const char RECORD_KEYS_MAGIC[8] = { 'B', 'S', 'R', 'K', 'E', 'Y', '0', '3' };
+	static const char RECORD_KEYDATA_MAGIC[8] = { 'B', 'S', 'R', 'K', 'D', 'T', '0', '1' };
+	static const size_t RECORD_KEYS_HEAD = sizeof(RECORD_KEYS_MAGIC) + 3 * sizeof(uint64_t);
+	static const size_t RECORD_KEY_HEADER = sizeof(uint64_t) + sizeof(uint32_t);
+
+	struct KeySlot
+	{
+		uint64_t hash;
+		uint64_t pos;
+	};
+
+	//the <log>.keydata entry at pos; false for a torn or invalid entry
+	inline bool record_key_entry(const char *p, size_t size, size_t pos, uint64_t &offset, const char *&key, uint32_t &len)
+	{
+		if (pos > size || size - pos < RECORD_KEY_HEADER)
+		{
+			return false;
+		}
+		memcpy(&offset, p + pos, sizeof(offset));
+		memcpy(&len, p + pos + sizeof(offset), sizeof(len));
+		if (offset < sizeof(RECORD_LOG_MAGIC) || len > size - pos - RECORD_KEY_HEADER)
+		{
+			return false; //offset 0 also stops a zero-filled tail
+		}
+		key = p + pos + RECORD_KEY_HEADER;
+		return true;
+	}
+
+
+	//record number -> file offset, read through a mapping of <log>.idx
+	class RecordLogIndex
+	{
+	public:
+		explicit RecordLogIndex(const std::string &logname) : file(logname + ".idx")
+		{}
+
+		bool is_open() const
+		{
+			return file.is_open() && file.size() >= sizeof(RECORD_INDEX_MAGIC)
+				&& memcmp(file.data(), RECORD_INDEX_MAGIC, sizeof(RECORD_INDEX_MAGIC)) == 0;
+		}
+
+		//records covered by the index
+		size_t size() const
+		{
+			return is_open() ? (file.size() - sizeof(RECORD_INDEX_MAGIC)) / sizeof(uint64_t) : 0;
+		}
+
+		//file offset of record k, or 0 if k is out of range
+		uint64_t offset(size_t k) const
+		{
+			if (k >= size())
+			{
+				return 0;
+			}
+			uint64_t off;
+			memcpy(&off, file.data() + sizeof(RECORD_INDEX_MAGIC) + k * sizeof(uint64_t), sizeof(off));
+			return off;
+		}
+
+	private:
+		MappedFile file;
+	};
+
+
+	//user key -> file offset, read through mappings of <log>.keys and
+	//<log>.keydata: lookups probe the mapped table, nothing is loaded up
+	//front, and a slot only matches if the key stored in its entry does,
+	//so a hash collision never returns another key's record
+	class RecordKeyIndex
+	{
+	public:
+		explicit RecordKeyIndex(const std::string &logname)
+			: table(logname + ".keys"), entries(logname + ".keydata"), cap(0), cnt(0), slots(NULL)
+		{
+			if (table.is_open() && table.size() >= RECORD_KEYS_HEAD
+				&& memcmp(table.data(), RECORD_KEYS_MAGIC, sizeof(RECORD_KEYS_MAGIC)) == 0
+				&& entries.is_open() && entries.size() >= sizeof(RECORD_KEYDATA_MAGIC)
+				&& memcmp(entries.data(), RECORD_KEYDATA_MAGIC, sizeof(RECORD_KEYDATA_MAGIC)) == 0)
+			{
+				uint64_t c;
+				memcpy(&c, table.data() + sizeof(RECORD_KEYS_MAGIC), sizeof(c));
+				memcpy(&cnt, table.data() + sizeof(RECORD_KEYS_MAGIC) + sizeof(c), sizeof(cnt));
+				if (c > 0 && (c & (c - 1)) == 0 && (table.size() - RECORD_KEYS_HEAD) / sizeof(KeySlot) >= c)
+				{
+					cap = (size_t)c;
+					slots = table.data() + RECORD_KEYS_HEAD;
+				}
+			}
+		}
+
+		bool is_open() const
+		{
+			return slots != NULL;
+		}
+
+		//distinct keys
+		size_t size() const
+		{
+			return is_open() ? (size_t)cnt : 0;
+		}
+
+		//offset of the latest record appended under key
+		template<typename KeyType>
+		bool find(const KeyType &key, uint64_t &offset) const
+		{
+			SmallOutStream<256> oe;
+			oe << key;
+			return find_encoded(oe.data(), oe.size(), offset);
+		}
+
+		//same, for a key already in its serialized form
+		bool find_encoded(const char *key, size_t n, uint64_t &offset) const
+		{
+			uint64_t h = key_hash(key, n);
+			for (size_t i = 0; i < cap; ++i)
+			{
+				KeySlot slot;
+				memcpy(&slot, slots + ((h + i) & (cap - 1)) * sizeof(KeySlot), sizeof(slot));
+				if (slot.pos == 0)
+				{
+					return false;
+				}
+				const char *k;
+				uint32_t len;
+				if (slot.hash == h && record_key_entry(entries.data(), entries.size(), (size_t)slot.pos, offset, k, len)
+					&& len == n && memcmp(k, key, n) == 0)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+	private:
+		MappedFile table;
+		MappedFile entries;
+		size_t cap;
+		uint64_t cnt;
+		const char *slots;
+	};
+
+
+	//maintains <log>.keydata and the <log>.keys table for RecordLogWriter:
+	//entries are appended, table slots are patched in place, and the whole
+	//table is only rewritten when it grows past half full
+	class RecordKeyWriter
+	{
+	public:
+		RecordKeyWriter() : data_fd(-1), table_fd(-1), data_size(0), covered(0), cnt(0), regrown(false)
+		{}
+
+		~RecordKeyWriter()
+		{
+			close();
+		}
+
+		bool is_open() const
+		{
+			return data_fd >= 0;
+		}
+
+		//open the key files of a log whose frames end at log_end, dropping
+		//entries of frames lost in a crash and any torn entry; the table
+		//catches up with entries it does not cover yet, or is rebuilt if it
+		//is missing or cannot be trusted
+		//nothing is created unless create is set
+		bool open(const std::string &logname, uint64_t log_end, bool create)
+		{
+			name = logname;
+			uint64_t valid = 0;
+			bool cut = false;
+			{
+				MappedFile f(name + ".keydata");
+				if (f.is_open() && f.size() >= sizeof(RECORD_KEYDATA_MAGIC)
+					&& memcmp(f.data(), RECORD_KEYDATA_MAGIC, sizeof(RECORD_KEYDATA_MAGIC)) == 0)
+				{
+					valid = sizeof(RECORD_KEYDATA_MAGIC);
+					uint64_t off;
+					const char *key;
+					uint32_t len;
+					while (record_key_entry(f.data(), f.size(), (size_t)valid, off, key, len) && off < log_end)
+					{
+						valid += RECORD_KEY_HEADER + len;
+					}
+					cut = valid < f.size();
+				}
+				else if (!create)
+				{
+					return false;
+				}
+			}
+			data_fd = file_open_rw(name + ".keydata");
+			table_fd = file_open_rw(name + ".keys");
+			if (data_fd < 0 || table_fd < 0)
+			{
+				close();
+				return false;
+			}
+			if (valid == 0)
+			{
+				valid = sizeof(RECORD_KEYDATA_MAGIC);
+				cut = true;
+				if (!file_truncate(data_fd, 0) || !file_write_at(data_fd, 0, RECORD_KEYDATA_MAGIC, sizeof(RECORD_KEYDATA_MAGIC)))
+				{
+					close();
+					return false;
+				}
+			}
+			file_truncate(data_fd, valid);
+			data_size = valid;
+			load_table(cut); //slots of dropped entries may be in the table
+			return write();
+		}
+
+		//file the record at log offset off under an encoded key
+		void add(uint64_t off, const char *key, size_t n)
+		{
+			uint64_t pos = data_size + pending.size();
+			uint32_t len = (uint32_t)n;
+			pending.append((const char*)&off, sizeof(off));
+			pending.append((const char*)&len, sizeof(len));
+			pending.append(key, n);
+			insert(key_hash(key, n), pos, key, len);
+		}
+
+		//write the pending entries, then the table slots that point at them
+		bool write()
+		{
+			if (data_fd < 0)
+			{
+				return true;
+			}
+			if (!pending.empty())
+			{
+				if (!file_write_at(data_fd, data_size, pending.data(), pending.size()))
+				{
+					drop();
+					return false;
+				}
+				data_size += pending.size();
+				pending.clear();
+			}
+			if (covered == data_size && !regrown && dirty.empty())
+			{
+				return true;
+			}
+			covered = data_size;
+			if (regrown ? rewrite_table() : patch_table())
+			{
+				return true;
+			}
+			regrown = true; //the file may be half patched: rewrite it next time
+			return false;
+		}
+
+		bool sync()
+		{
+			return data_fd < 0 || (file_sync(data_fd) && file_sync(table_fd));
+		}
+
+		//forget the entries not written yet, e.g. after their frames were
+		//lost, and go back to the table on disk
+		void drop()
+		{
+			if (data_fd < 0)
+			{
+				return;
+			}
+			pending.clear();
+			file_truncate(data_fd, data_size);
+			load_table(false);
+		}
+
+		void close()
+		{
+			if (data_fd >= 0)
+			{
+				file_close(data_fd);
+			}
+			if (table_fd >= 0)
+			{
+				file_close(table_fd);
+			}
+			data_fd = table_fd = -1;
+		}
+
+	private:
+		//read the table on disk and add the entries written after it
+		void load_table(bool rebuild)
+		{
+			slots.clear();
+			dirty.clear();
+			cnt = 0;
+			covered = sizeof(RECORD_KEYDATA_MAGIC);
+			regrown = true;
+			{
+				MappedFile f(name + ".keys");
+				uint64_t c = 0, n = 0, cov = 0;
+				if (!rebuild && f.is_open() && f.size() >= RECORD_KEYS_HEAD
+					&& memcmp(f.data(), RECORD_KEYS_MAGIC, sizeof(RECORD_KEYS_MAGIC)) == 0)
+				{
+					memcpy(&c, f.data() + sizeof(RECORD_KEYS_MAGIC), sizeof(c));
+					memcpy(&n, f.data() + sizeof(RECORD_KEYS_MAGIC) + sizeof(c), sizeof(n));
+					memcpy(&cov, f.data() + sizeof(RECORD_KEYS_MAGIC) + 2 * sizeof(c), sizeof(cov));
+				}
+				if (c > 0 && (c & (c - 1)) == 0 && (f.size() - RECORD_KEYS_HEAD) / sizeof(KeySlot) >= c
+					&& cov >= covered && cov <= data_size)
+				{
+					slots.resize((size_t)c);
+					memcpy(&slots[0], f.data() + RECORD_KEYS_HEAD, (size_t)c * sizeof(KeySlot));
+					cnt = n;
+					covered = cov;
+					regrown = false;
+				}
+				else
+				{
+					KeySlot none = { 0, 0 };
+					slots.assign(16, none);
+				}
+			}
+			MappedFile d(name + ".keydata");
+			uint64_t pos = covered, off;
+			const char *key;
+			uint32_t len;
+			while (pos < data_size && record_key_entry(d.data(), d.size(), (size_t)pos, off, key, len))
+			{
+				insert(key_hash(key, len), pos, key, len);
+				pos += RECORD_KEY_HEADER + len;
+			}
+		}
+
+		//a later entry for the same key takes over its slot
+		void insert(uint64_t h, uint64_t pos, const char *key, uint32_t len)
+		{
+			if ((cnt + 1) * 2 > slots.size())
+			{
+				grow();
+			}
+			size_t mask = slots.size() - 1;
+			size_t j = (size_t)h & mask;
+			while (slots[j].pos != 0 && !(slots[j].hash == h && same_key(slots[j].pos, key, len)))
+			{
+				j = (j + 1) & mask;
+			}
+			if (slots[j].pos == 0)
+			{
+				slots[j].hash = h;
+				++cnt;
+			}
+			slots[j].pos = pos;
+			if (!regrown)
+			{
+				dirty.push_back(j);
+			}
+		}
+
+		//the entry at pos holds key
+		bool same_key(uint64_t pos, const char *key, uint32_t len)
+		{
+			char head[RECORD_KEY_HEADER];
+			uint32_t n;
+			if (pos >= data_size)
+			{
+				size_t at = (size_t)(pos - data_size);
+				memcpy(&n, pending.data() + at + sizeof(uint64_t), sizeof(n));
+				return n == len && memcmp(pending.data() + at + RECORD_KEY_HEADER, key, len) == 0;
+			}
+			if (!file_read_at(data_fd, pos, head, sizeof(head)))
+			{
+				return false;
+			}
+			memcpy(&n, head + sizeof(uint64_t), sizeof(n));
+			if (n != len)
+			{
+				return false;
+			}
+			scratch.resize(len);
+			return file_read_at(data_fd, pos + RECORD_KEY_HEADER, &scratch[0], len) && memcmp(scratch.data(), key, len) == 0;
+		}
+
+		void grow()
+		{
+			std::vector<KeySlot> old;
+			old.swap(slots);
+			KeySlot none = { 0, 0 };
+			slots.assign(old.size() * 2, none);
+			size_t mask = slots.size() - 1;
+			for (size_t i = 0; i < old.size(); ++i)
+			{
+				if (old[i].pos == 0)
+				{
+					continue;
+				}
+				size_t j = (size_t)old[i].hash & mask;
+				while (slots[j].pos != 0)
+				{
+					j = (j + 1) & mask;
+				}
+				slots[j] = old[i];
+			}
+			regrown = true;
+			dirty.clear();
+		}
+
+		//changed slots in place, then count and covered
+		bool patch_table()
+		{
+			for (size_t i = 0; i < dirty.size(); ++i)
+			{
+				if (!file_write_at(table_fd, RECORD_KEYS_HEAD + dirty[i] * sizeof(KeySlot), (const char*)&slots[dirty[i]], sizeof(KeySlot)))
+				{
+					return false;
+				}
+			}
+			dirty.clear();
+			uint64_t head[2] = { cnt, covered };
+			return file_write_at(table_fd, sizeof(RECORD_KEYS_MAGIC) + sizeof(uint64_t), (const char*)head, sizeof(head));
+		}
+
+		//the whole table, replacing the old file in one step
+		bool rewrite_table()
+		{
+			std::string tmp = name + ".keys.tmp";
+			int tfd = file_open_write(tmp);
+			if (tfd < 0)
+			{
+				return false;
+			}
+			uint64_t head[3] = { (uint64_t)slots.size(), cnt, covered };
+			IoSlice v[3] = { { RECORD_KEYS_MAGIC, sizeof(RECORD_KEYS_MAGIC) }, { (const char*)head, sizeof(head) },
+				{ (const char*)&slots[0], slots.size() * sizeof(KeySlot) } };
+			bool ret = write_slices(tfd, std::vector<IoSlice>(v, v + 3)) && file_sync(tfd);
+			file_close(tfd);
+			file_close(table_fd); //Windows cannot replace an open file
+			ret = ret && file_replace(tmp, name + ".keys");
+			table_fd = file_open_rw(name + ".keys");
+			if (!ret || table_fd < 0)
+			{
+				return false;
+			}
+			regrown = false;
+			dirty.clear();
+			return true;
+		}
+
+		std::string name;
+		int data_fd;
+		int table_fd;
+		uint64_t data_size;
+		uint64_t covered;
+		uint64_t cnt;
+		bool regrown;
+		std::vector<KeySlot> slots;
+		std::vector<size_t> dirty;
+		std::string pending;
+		std::string scratch;
+	};
+
+
+
+	//reads a record log through a read-only mapping, without copying frames
+	class RecordLogReader
+	{
+	public:
+		explicit RecordLogReader(const std::string &filename) : pos(0), end_valid(0), torn(false), bad(false), ok(false)
+		{
+			if (file.open(filename) && file.size() >= sizeof(RECORD_LOG_MAGIC)
+				&& memcmp(file.data(), RECORD_LOG_MAGIC, sizeof(RECORD_LOG_MAGIC)) == 0)
+			{
+				ok = true;
+				rewind();
+			}
+		}
+
+		bool is_open() const
+		{
+			return ok;
+		}
+
+		//next frame as a view into the mapping; false at the end of the
+		//valid frames
+		bool next(const char *&data, size_t &len)
+		{
+			if (!ok || !frame_at(pos, data, len))
+			{
+				if (ok && pos < file.size())
+				{
+					torn = true;
+				}
+				return false;
+			}
+			pos += RECORD_FRAME_HEADER + len;
+			end_valid = pos;
+			return true;
+		}
+
+		//next record decoded into a; false at the end of the valid frames,
+		//or for a frame that does not decode into a: undecodable() tells
+		//the two apart, and the next call goes on after that frame
+		template<typename SerializableType>
+		bool next(SerializableType &a)
+		{
+			const char *data;
+			size_t len;
+			bad = false;
+			if (!next(data, len))
+			{
+				return false;
+			}
+			InStream ie(data, len);
+			ie >> a;
+			bad = !ie.good();
+			return !bad;
+		}
+
+		//frame at a file offset taken from an index
+		bool read_at(uint64_t off, const char *&data, size_t &len) const
+		{
+			return ok && off >= sizeof(RECORD_LOG_MAGIC) && frame_at(off, data, len);
+		}
+
+		template<typename SerializableType>
+		bool read_at(uint64_t off, SerializableType &a) const
+		{
+			const char *data;
+			size_t len;
+			if (!read_at(off, data, len))
+			{
+				return false;
+			}
+			InStream ie(data, len);
+			ie >> a;
+			return ie.good();
+		}
+
+		//continue iterating from a frame offset
+		void seek(uint64_t off)
+		{
+			pos = end_valid = off;
+			torn = false;
+			bad = false;
+		}
+
+		void rewind()
+		{
+			pos = end_valid = sizeof(RECORD_LOG_MAGIC);
+			torn = false;
+			bad = false;
+		}
+
+		//file offset of the next frame
+		uint64_t offset() const
+		{
+			return pos;
+		}
+
+		//end of the last good frame read so far
+		uint64_t valid_end() const
+		{
+			return end_valid;
+		}
+
+		//true once next() found bytes after the last good frame
+		bool truncated() const
+		{
+			return torn;
+		}
+
+		//true if the last next(a) stopped at a valid frame it could not decode
+		bool undecodable() const
+		{
+			return bad;
+		}
+
+		uint64_t file_size() const
+		{
+			return file.size();
+		}
+
+	protected:
+		//validate the frame at off
+		bool frame_at(uint64_t off, const char *&data, size_t &len) const
+		{
+			if (off + RECORD_FRAME_HEADER > file.size())
+			{
+				return false;
+			}
+			uint32_t n, crc;
+			memcpy(&n, file.data() + off, sizeof(n));
+			memcpy(&crc, file.data() + off + sizeof(n), sizeof(crc));
+			if (n > file.size() - off - RECORD_FRAME_HEADER)
+			{
+				return false;
+			}
+			data = file.data() + off + RECORD_FRAME_HEADER;
+			len = n;
+			return record_frame_crc(data, n) == crc;
+		}
+
+		MappedFile file;
+		uint64_t pos;
+		uint64_t end_valid;
+		bool torn;
+		bool bad;
+		bool ok;
+	};
+
+
+	//appends records to a log file
+	//frames are collected in memory and written together once group_bytes
+	//have accumulated, on flush() and on destruction; sync() also fsyncs
+	//the <log>.idx offset index and, once append_keyed() is used, the
+	//<log>.keydata entries and <log>.keys slots are written after the frames
+	class RecordLogWriter
+	{
+	public:
+		//with_index = false skips the <log>.idx sidecar
+		explicit RecordLogWriter(const std::string &filename, size_t group_bytes = 64 * 1024, bool with_index = true)
+			: name(filename), fd(-1), idx_fd(-1), group(group_bytes), end(0), count(0), written(0), written_count(0)
+		{
+			open(filename, with_index);
+		}
+
+		~RecordLogWriter()
+		{
+			if (fd >= 0)
+			{
+				flush();
+				file_close(fd);
+			}
+			if (idx_fd >= 0)
+			{
+				file_close(idx_fd);
+			}
+		}
+
+		bool is_open() const
+		{
+			return fd >= 0;
+		}
+
+		//encode a and append it as one frame
+		template<typename SerializableType>
+		bool append(const SerializableType &a)
+		{
+			scratch.clear();
+			scratch << a;
+			return append_raw(scratch.data(), scratch.size());
+		}
+
+		//append a and make it findable by key through RecordKeyIndex
+		template<typename KeyType, typename SerializableType>
+		bool append_keyed(const KeyType &key, const SerializableType &a)
+		{
+			if (!keys.is_open() && !keys.open(name, end, true))
+			{
+				return false;
+			}
+			uint64_t off = end;
+			key_scratch.clear();
+			key_scratch << key;
+			if (!append(a))
+			{
+				return false;
+			}
+			keys.add(off, key_scratch.data(), key_scratch.size());
+			return true;
+		}
+
+		//append an already encoded payload
+		bool append_raw(const char *data, size_t len)
+		{
+			if (fd < 0)
+			{
+				return false;
+			}
+			uint32_t hdr[2] = { (uint32_t)len, record_frame_crc(data, (uint32_t)len) };
+			if (idx_fd >= 0)
+			{
+				idx_pending.append((const char*)&end, sizeof(end));
+			}
+			end += RECORD_FRAME_HEADER + len;
+			++count;
+			if (pending.size() + RECORD_FRAME_HEADER + len <= group)
+			{
+				pending.append((const char*)hdr, RECORD_FRAME_HEADER);
+				pending.append(data, len);
+				return true;
+			}
+
+			//too big to buffer: write what is pending and the frame in one go
+			IoSlice v[3] = { { pending.data(), pending.size() }, { (const char*)hdr, RECORD_FRAME_HEADER }, { data, len } };
+			if (!write_slices(fd, std::vector<IoSlice>(v, v + 3)))
+			{
+				drop_unwritten();
+				return false;
+			}
+			return written_out();
+		}
+
+		//write out buffered frames; the index follows the log, so an index
+		//entry never points past the frames on disk
+		//if the write fails, the frames buffered since the last good write
+		//are dropped along with their index entries
+		bool flush()
+		{
+			if (fd < 0)
+			{
+				return false;
+			}
+			if (!pending.empty() && !write_all(fd, pending.data(), pending.size()))
+			{
+				drop_unwritten();
+				return false;
+			}
+			return written_out();
+		}
+
+		//flush and make the frames and indexes durable
+		bool sync()
+		{
+			return flush() && file_sync(fd) && (idx_fd < 0 || file_sync(idx_fd)) && keys.sync();
+		}
+
+		//file offset the next frame will be written at
+		uint64_t offset() const
+		{
+			return end;
+		}
+
+		//records in the file, including those still buffered
+		uint64_t records() const
+		{
+			return count;
+		}
+
+	protected:
+		//open for appending, cutting off a torn tail left by a crash
+		//and bringing <log>.idx in line with the frames that survived
+		void open(const std::string &filename, bool with_index)
+		{
+			uint64_t keep = 0, size = 0;
+			size_t indexed = 0;
+			bool fresh = true;
+			if (with_index)
+			{
+				RecordLogIndex idx(filename);
+				indexed = idx.size();
+			}
+			{
+				RecordLogReader r(filename);
+				if (r.is_open())
+				{
+					const char *data;
+					size_t len;
+					uint64_t off = r.offset();
+					while (r.next(data, len))
+					{
+						if (with_index && count >= indexed)
+						{
+							idx_pending.append((const char*)&off, sizeof(off)); //lost in the crash
+						}
+						++count;
+						off = r.offset();
+					}
+					keep = r.valid_end();
+					size = r.file_size();
+					fresh = false;
+				}
+				else
+				{
+					MappedFile f(filename);
+					if (f.is_open() && f.size() >= sizeof(RECORD_LOG_MAGIC))
+					{
+						return; //not a record log, leave it alone
+					}
+				}
+			}
+
+			fd = file_open_write(filename, true);
+			if (fd < 0)
+			{
+				return;
+			}
+			if (fresh)
+			{
+				file_truncate(fd, 0);
+				write_all(fd, RECORD_LOG_MAGIC, sizeof(RECORD_LOG_MAGIC));
+				keep = sizeof(RECORD_LOG_MAGIC);
+			}
+			else if (size > keep)
+			{
+				file_truncate(fd, keep);
+			}
+			end = keep;
+			written = end;
+			written_count = count;
+			keys.open(filename, end, false);
+			if (!with_index)
+			{
+				return;
+			}
+
+			idx_fd = file_open_write(filename + ".idx", true);
+			if (idx_fd >= 0)
+			{
+				if (fresh || indexed == 0)
+				{
+					file_truncate(idx_fd, 0);
+					write_all(idx_fd, RECORD_INDEX_MAGIC, sizeof(RECORD_INDEX_MAGIC));
+				}
+				else
+				{
+					//drops entries of lost frames and any torn entry
+					file_truncate(idx_fd, sizeof(RECORD_INDEX_MAGIC) + (indexed < count ? indexed : count) * sizeof(uint64_t));
+				}
+				flush_index();
+			}
+		}
+
+		//the buffered frames are on disk: their index entries may follow
+		bool written_out()
+		{
+			pending.clear();
+			written = end;
+			written_count = count;
+			return flush_index();
+		}
+
+		//a write failed: cut the log back to the frames known to be on disk
+		//and forget everything buffered after them
+		void drop_unwritten()
+		{
+			file_truncate(fd, written);
+			end = written;
+			count = written_count;
+			pending.clear();
+			idx_pending.clear();
+			keys.drop();
+		}
+
+		//entries of both sidecar indexes, after the frames they point at
+		bool flush_index()
+		{
+			bool ret = true;
+			if (idx_fd >= 0 && !idx_pending.empty())
+			{
+				ret = write_all(idx_fd, idx_pending.data(), idx_pending.size());
+			}
+			idx_pending.clear();
+			return keys.write() && ret;
+		}
+
+		std::string name;
+		int fd;
+		int idx_fd;
+		size_t group;
+		uint64_t end;
+		uint64_t count;
+		uint64_t written;
+		uint64_t written_count;
+		std::string pending;
+		std::string idx_pending;
+		RecordKeyWriter keys;
+		SmallOutStream<1024> scratch;
+		SmallOutStream<256> key_scratch;
+	};
+
+}//namespace BS
@@ -7,11 +7,40 @@
 #include <map>     //std::map
 #include <utility>    // std::pair
 #include <iterator>  //std::back_inserter
+#include <algorithm> //std::copy
 #include <string.h>  //memcpy
 #include <fstream>  //std::fstream
 #include <iostream>
 #include <string>	//std::string
 #include <cstdlib>
+#include <type_traits> //std::is_base_of
+#include <mutex>     //std::mutex
+#include <atomic>    //std::atomic
+#include <functional> //std::function
+#include <errno.h>
+#include <fcntl.h>   //open
+#include <stdint.h>  //uint32_t
+#include <stdio.h>   //rename
+#ifdef _WIN32
+#include <io.h>      //_open, _write
+#include <sys/stat.h>
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h> //CreateFileMapping
+#else
+#include <unistd.h>  //write
+#include <sys/uio.h> //writev
+#include <sys/stat.h>
+#include <sys/mman.h> //mmap
+#endif
+#if defined(_M_X64) || defined(__x86_64__)
+#define BS_CRC32C_SSE42
+#include <nmmintrin.h> //_mm_crc32_u64
+#ifdef _MSC_VER
+#include <intrin.h>    //__cpuid
+#endif
+#endif
 
 namespace BS{
 
@@ -114,6 +143,8 @@ namespace BS{
 	}
 
 
+	class InStream;
+
 	////////////////////////////////////////////
 	//Serialize for custom class object
 	//If your class object want to be serialized,
@@ -124,230 +155,3057 @@ namespace BS{
 	public:
 		virtual std::string serialize() = 0; //The base class includes two virtual functions
 		virtual int deserialize(std::string&) = 0;
+
+		//read the object straight from an InStream; override it to avoid the
+		//copy of the remaining input the default makes
+		virtual void deserialize_from(InStream &in);
+
+		//encode into caller-owned memory, return the bytes needed (written if <= cap)
+		//the default goes through serialize() and allocates; derive from
+		//InPlaceSerializable instead to use the class with BS::serialize_into
+		virtual size_t serialize_into(char *out, size_t cap) const
+		{
+			std::string x = const_cast<Serializable*>(this)->serialize();
+			if (x.size() <= cap)
+			{
+				memcpy(out, x.data(), x.size());
+			}
+			return x.size();
+		}
+	};
+
+	//opt-in for allocation-free encoding: a class deriving from this writes
+	//serialize_into with a BufferOutStream over (out, cap), never through
+	//serialize(); BS::serialize_into accepts only such classes
+	class InPlaceSerializable : public Serializable
+	{
+	public:
+		virtual size_t serialize_into(char *out, size_t cap) const = 0;
 	};
 
 
+	//caller-owned output buffer: copies while the bytes fit and keeps counting
+	//past the end, so size() is the required size after an overflow
+	class FixedBuffer
+	{
+	public:
+		FixedBuffer(char *out, size_t cap) : out(out), cap(cap), pos(0)
+		{}
+
+		void write(const char *p, size_t n)
+		{
+			if (n > 0 && pos <= cap && n <= cap - pos)
+			{
+				memcpy(out + pos, p, n);
+			}
+			pos += n;
+		}
+		void write_ref(const char *p, size_t n) { write(p, n); }
 
+		//free space for a user type to encode into directly
+		char* spare() { return pos < cap ? out + pos : NULL; }
+		size_t spare_size() const { return pos < cap ? cap - pos : 0; }
+		bool reserve(size_t) { return false; } //never grows
+		void commit(size_t n) { pos += n; }
 
-	//Define input and output stream for serialize & deserialize type
-	//output stream
-	class OutStream
+		size_t size() const { return pos; }
+		bool overflow() const { return pos > cap; }
+
+	private:
+		char *out;
+		size_t cap;
+		size_t pos;
+	};
+
+
+	//growable buffer with N bytes of inline storage, spills to the heap only
+	//when a message outgrows it
+	template<size_t N>
+	class SmallBuffer
 	{
 	public:
+		SmallBuffer() : ptr(inline_buf), cap(N), pos(0)
+		{}
+		~SmallBuffer()
+		{
+			if (ptr != inline_buf)
+			{
+				delete[] ptr;
+			}
+		}
 
-		OutStream() : os(std::ios::binary)
+		void write(const char *p, size_t n)
 		{
+			reserve(n);
+			memcpy(ptr + pos, p, n);
+			pos += n;
 		}
+		void write_ref(const char *p, size_t n) { write(p, n); }
 
-		//outstream for BasicType
-		template<typename SerializableType>
-		OutStream& operator<< (SerializableType& a)
+		char* spare() { return ptr + pos; }
+		size_t spare_size() const { return cap - pos; }
+		bool reserve(size_t n)
 		{
-			std::string x = BS::serialize(a);
-			os.write(x.data(), x.size());
-			return *this;
+			if (n > cap - pos)
+			{
+				grow(pos + n);
+			}
+			return true;
 		}
+		void commit(size_t n) { pos += n; }
 
-		//outstream for vector
-		template<typename BasicType>
-		OutStream& operator<< (std::vector<BasicType>& a)
+		const char* data() const { return ptr; }
+		size_t size() const { return pos; }
+		bool on_heap() const { return ptr != inline_buf; }
+		void clear() { pos = 0; } //keeps any heap block for the next message
+
+	private:
+		SmallBuffer(const SmallBuffer&);
+		SmallBuffer& operator=(const SmallBuffer&);
+
+		void grow(size_t need)
+		{
+			size_t newcap = cap * 2 > need ? cap * 2 : need;
+			char *p = new char[newcap];
+			memcpy(p, ptr, pos);
+			if (ptr != inline_buf)
+			{
+				delete[] ptr;
+			}
+			ptr = p;
+			cap = newcap;
+		}
+
+		char inline_buf[N];
+		char *ptr;
+		size_t cap;
+		size_t pos;
+	};
+
+
+	//recycles serialization buffers between OutStreams
+	//each thread keeps a few buffers of its own, the rest overflow into a
+	//shared list bounded by Limits::global_bytes; anything larger than
+	//Limits::max_buffer is freed instead of being retained
+	class BufferPool
+	{
+	public:
+		struct Limits
 		{
-			int len = a.size();
-			std::string x = BS::serialize(len);
-			os.write(x.data(), x.size());
+			size_t local_buffers;
+			size_t global_bytes;
+			size_t max_buffer;
+		};
 
-			for (int i = 0; i < len; ++i)
+		struct Stats
+		{
+			size_t acquires;
+			size_t hits;
+			size_t retained_buffers;
+			size_t retained_bytes;
+
+			double hit_rate() const
 			{
-				std::string item = BS::serialize(a[i]); //serialize the element stored in vector
-				os.write(item.data(), item.size()); 
+				return acquires ? (double)hits / acquires : 0.0;
 			}
+		};
 
-			return *this;
+		//set before the first OutStream is used
+		static Limits& limits()
+		{
+			static Limits l = { 4, 16 << 20, 1 << 20 };
+			return l;
 		}
 
-		//outstream for list
-		template<typename BasicType>
-		OutStream& operator<< (std::list<BasicType>& a)
+		static Stats stats()
 		{
-			std::vector<BasicType> temp;
-			std::copy(a.begin(), a.end(), std::back_inserter(temp)); //transfer list to vector
-			return this->operator<< (temp);
+			Counters &c = counters();
+			Stats s = { c.acquires, c.hits, c.retained_buffers, c.retained_bytes };
+			return s;
 		}
 
-		//outstream for set
-		template<typename BasicType>
-		OutStream& operator<< (std::set<BasicType>& a)
+		//hand out a recycled buffer, or an empty string on a miss
+		static std::string acquire()
+		{
+			std::string s;
+			++counters().acquires;
+
+			std::vector<std::string> &local = local_cache().free;
+			if (!local.empty())
+			{
+				s.swap(local.back());
+				local.pop_back();
+			}
+			else
+			{
+				Global &g = global();
+				std::lock_guard<std::mutex> lock(g.mtx);
+				if (!g.free.empty())
+				{
+					s.swap(g.free.back());
+					g.free.pop_back();
+					g.bytes -= s.capacity();
+				}
+			}
+
+			if (!s.empty())
+			{
+				++counters().hits;
+				untrack(s.capacity());
+			}
+			return s;
+		}
+
+		//take a buffer back; s is left empty either way
+		static void release(std::string &s)
 		{
-			std::vector<BasicType> temp;
-			std::copy(a.begin(), a.end(), std::back_inserter(temp)); //transfer set to vector
-			return this->operator<< (temp);
+			size_t bytes = s.capacity();
+			if (s.empty() || bytes > limits().max_buffer)
+			{
+				std::string().swap(s);
+				return;
+			}
+
+			std::vector<std::string> &local = local_cache().free;
+			if (local.size() < limits().local_buffers)
+			{
+				local.push_back(std::string());
+				local.back().swap(s);
+				track(bytes);
+				return;
+			}
+			give_global(s);
 		}
 
-		//outstream for map
-		template<typename BasicTypeA, typename BasicTypeB>
-		OutStream& operator<< (std::map<BasicTypeA, BasicTypeB>& a)
+	private:
+		struct Counters
 		{
-			std::vector<BasicTypeA> tempKey;
-			std::vector<BasicTypeB> tempVal;
+			std::atomic<size_t> acquires;
+			std::atomic<size_t> hits;
+			std::atomic<size_t> retained_buffers;
+			std::atomic<size_t> retained_bytes;
+		};
 
-			typename std::map<BasicTypeA, BasicTypeB>::const_iterator it;
-			for (it = a.begin(); it != a.end(); ++it) //transfer map::Key & map::Value to two vectors
+		struct Global
+		{
+			Global() : bytes(0)
+			{}
+			std::mutex mtx;
+			std::vector<std::string> free;
+			size_t bytes;
+		};
+
+		//thread-local free list, handed to the shared list when the thread exits
+		struct LocalCache
+		{
+			LocalCache()
 			{
-				tempKey.push_back(it->first);
-				tempVal.push_back(it->second);
+				free.reserve(limits().local_buffers);
+			}
+			~LocalCache()
+			{
+				for (size_t i = 0; i < free.size(); ++i)
+				{
+					untrack(free[i].capacity());
+					give_global(free[i]);
+				}
 			}
+			std::vector<std::string> free;
+		};
 
-			this->operator<< (tempKey);
-			return this->operator<< (tempVal);
+		static Counters& counters()
+		{
+			static Counters c = {};
+			return c;
 		}
 
-		//outstream for pair
-		template<typename BasicTypeA, typename BasicTypeB>
-		OutStream& operator<< (std::pair<BasicTypeA, BasicTypeB>& a)
+		static Global& global()
 		{
-			BasicTypeA tempfirst=a.first;
-			BasicTypeB tempsecond=a.second;
-	
-			this->operator<< (tempfirst);
-			return this->operator<< (tempsecond);
+			static Global g;
+			return g;
 		}
 
-		std::string str()
+		static LocalCache& local_cache()
 		{
-			return os.str();
+			thread_local LocalCache lc;
+			return lc;
 		}
 
-	public:
-		std::ostringstream os;
+		static void track(size_t bytes)
+		{
+			++counters().retained_buffers;
+			counters().retained_bytes += bytes;
+		}
+
+		static void untrack(size_t bytes)
+		{
+			--counters().retained_buffers;
+			counters().retained_bytes -= bytes;
+		}
+
+		static void give_global(std::string &s)
+		{
+			size_t bytes = s.capacity();
+			Global &g = global();
+			std::lock_guard<std::mutex> lock(g.mtx);
+			if (g.bytes + bytes <= limits().global_bytes)
+			{
+				g.free.push_back(std::string());
+				g.free.back().swap(s);
+				g.bytes += bytes;
+				track(bytes);
+			}
+			else
+			{
+				std::string().swap(s);
+			}
+		}
 	};
 
 
-	//input stream
-	class InStream
+	//growable buffer drawn from BufferPool and given back on destruction
+	//the string's size is the usable capacity, pos the bytes written
+	class PooledBuffer
 	{
 	public:
-
-		InStream(std::string &s) : str(s), total(s.size())
+		PooledBuffer() : s(BufferPool::acquire()), pos(0)
 		{}
-
-		//instream for BasicType
-		template<typename SerializableType>
-		InStream& operator>> (SerializableType& a)
+		~PooledBuffer()
 		{
-			int ret = BS::deserialize(str, a);
-			str = str.substr(ret); 
-			return *this;
+			BufferPool::release(s);
 		}
 
-		//instream for vector
-		template<typename BasicType>
-		InStream& operator>> (std::vector<BasicType>& a)
+		void write(const char *p, size_t n)
 		{
-			int len = 0;
-			int ret = BS::deserialize(str, len);
-			str = str.substr(ret);
+			reserve(n);
+			memcpy(&s[0] + pos, p, n);
+			pos += n;
+		}
+		void write_ref(const char *p, size_t n) { write(p, n); }
 
-			for (int i = 0; i < len; ++i)
+		char* spare() { return s.empty() ? NULL : &s[0] + pos; }
+		size_t spare_size() const { return s.size() - pos; }
+		bool reserve(size_t n)
+		{
+			if (n > s.size() - pos)
 			{
-				BasicType item;
-				int size = BS::deserialize(str, item);
-				str = str.substr(size);
-				a.push_back(item);
+				size_t newsize = s.size() * 2 > pos + n ? s.size() * 2 : pos + n;
+				s.resize(newsize < 256 ? 256 : newsize);
 			}
+			return true;
+		}
+		void commit(size_t n) { pos += n; }
 
-			return *this;
+		const char* data() const { return s.data(); }
+		size_t size() const { return pos; }
+		std::string str() const { return s.substr(0, pos); }
+
+	private:
+		PooledBuffer(const PooledBuffer&);
+		PooledBuffer& operator=(const PooledBuffer&);
+
+		std::string s;
+		size_t pos;
+	};
+
+
+	//one contiguous piece of gathered output, layout-compatible with iovec
+	struct IoSlice
+	{
+		const char *base;
+		size_t len;
+	};
+
+
+	//buffer for gather output: small writes are copied into a pooled buffer,
+	//payloads of at least threshold bytes are only referenced
+	//referenced data must stay alive and unchanged until the output is written
+	class GatherBuffer
+	{
+	public:
+		GatherBuffer() : threshold(4096), total(0)
+		{}
+
+		void set_threshold(size_t t) { threshold = t; }
+
+		void write(const char *p, size_t n)
+		{
+			owned.write(p, n);
+			add_owned(n);
 		}
 
-		//instream for list
-		template<typename BasicType>
-		InStream& operator>> (std::list<BasicType>& a)
+		void write_ref(const char *p, size_t n)
 		{
-			std::vector<BasicType> temp;
-			InStream& ret = this->operator>> (temp);
-			if (temp.size() > 0)
+			if (n < threshold)
 			{
-				std::copy(temp.begin(), temp.end(), std::back_inserter(a));
+				write(p, n);
+				return;
 			}
+			Piece x = { p, 0, n };
+			pieces.push_back(x);
+			total += n;
+		}
 
-			return ret;
+		char* spare() { return owned.spare(); }
+		size_t spare_size() const { return owned.spare_size(); }
+		bool reserve(size_t n) { return owned.reserve(n); }
+		void commit(size_t n)
+		{
+			owned.commit(n);
+			add_owned(n);
 		}
 
-		//instream for set
-		template<typename BasicType>
-		InStream& operator>> (std::set<BasicType>& a)
+		size_t size() const { return total; }
+
+		//slices in output order; valid until the next write
+		std::vector<IoSlice> slices() const
 		{
-			std::vector<BasicType> temp;
-			InStream& ret = this->operator>> (temp);
-			if (temp.size() > 0)
+			std::vector<IoSlice> v;
+			v.reserve(pieces.size());
+			for (size_t i = 0; i < pieces.size(); ++i)
 			{
-				for (size_t i = 0; i < temp.size(); ++i)
-				{
-					a.insert(temp[i]);
-				}
+				IoSlice x = { pieces[i].ref ? pieces[i].ref : owned.data() + pieces[i].off, pieces[i].len };
+				v.push_back(x);
 			}
-
-			return ret;
+			return v;
 		}
 
-		//instream for map
-		template<typename BasicTypeA, typename BasicTypeB>
-		InStream& operator>> (std::map<BasicTypeA, BasicTypeB>& a)
+	private:
+		//ref == NULL: bytes at off in the owned buffer
+		struct Piece
 		{
-			std::vector<BasicTypeA> tempKey;
-			std::vector<BasicTypeB> tempVal;
-
-			this->operator>> (tempKey);
-			InStream& ret = this->operator>> (tempVal);
+			const char *ref;
+			size_t off;
+			size_t len;
+		};
 
-			if (tempKey.size() > 0 && tempVal.size() == tempKey.size())
+		void add_owned(size_t n)
+		{
+			if (!pieces.empty() && pieces.back().ref == NULL)
 			{
-				for (size_t i = 0; i < tempKey.size(); ++i)
-				{
-					a.insert(std::make_pair(tempKey[i], tempVal[i]));
-				}
+				pieces.back().len += n;
+			}
+			else
+			{
+				Piece x = { NULL, owned.size() - n, n };
+				pieces.push_back(x);
 			}
+			total += n;
+		}
 
-			return ret;
+		PooledBuffer owned;
+		std::vector<Piece> pieces;
+		size_t threshold;
+		size_t total;
+	};
+
+
+	//file descriptor helpers for the file and pipe sinks
+	inline int file_open_write(const std::string &filename, bool append = false)
+	{
+#ifdef _WIN32
+		return _open(filename.c_str(), _O_WRONLY | _O_CREAT | _O_BINARY | (append ? _O_APPEND : _O_TRUNC), _S_IREAD | _S_IWRITE);
+#else
+		return open(filename.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+#endif
+	}
+
+	inline void file_close(int fd)
+	{
+#ifdef _WIN32
+		_close(fd);
+#else
+		close(fd);
+#endif
+	}
+
+	//write every byte of p, retrying short writes
+	inline bool write_all(int fd, const char *p, size_t n)
+	{
+		while (n > 0)
+		{
+#ifdef _WIN32
+			int w = _write(fd, p, n > 0x40000000 ? 0x40000000 : (unsigned)n);
+#else
+			ssize_t w = write(fd, p, n);
+			if (w < 0 && errno == EINTR)
+			{
+				continue;
+			}
+#endif
+			if (w <= 0)
+			{
+				return false;
+			}
+			p += w;
+			n -= w;
 		}
+		return true;
+	}
 
-		//instream for pair
-		template<typename BasicTypeA, typename BasicTypeB>
-		InStream& operator>> (std::pair<BasicTypeA, BasicTypeB>& a)
+	//write all slices in order, with writev where the platform has it
+	inline bool write_slices(int fd, const std::vector<IoSlice> &v)
+	{
+#ifdef _WIN32
+		for (size_t i = 0; i < v.size(); ++i)
+		{
+			if (!write_all(fd, v[i].base, v[i].len))
+			{
+				return false;
+			}
+		}
+		return true;
+#else
+		size_t i = 0, off = 0; //off: bytes of v[i] already written
+		while (i < v.size())
 		{
-			BasicTypeA tempfirst;
-			BasicTypeB tempsecond;
+			struct iovec iov[64];
+			int cnt = 0;
+			for (size_t k = i; k < v.size() && cnt < 64; ++k, ++cnt)
+			{
+				size_t skip = (k == i) ? off : 0;
+				iov[cnt].iov_base = (void*)(v[k].base + skip);
+				iov[cnt].iov_len = v[k].len - skip;
+			}
+			ssize_t w = writev(fd, iov, cnt);
+			if (w < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (w < 0)
+			{
+				return false;
+			}
+			size_t left = (size_t)w;
+			while (i < v.size() && left >= v[i].len - off)
+			{
+				left -= v[i].len - off;
+				off = 0;
+				++i;
+			}
+			off += left;
+		}
+		return true;
+#endif
+	}
 
-			this->operator>> (tempfirst);
-			InStream& ret = this->operator>> (tempsecond);
-			a = std::make_pair(tempfirst, tempsecond);
-			return ret;
+	//open for reading and writing in place, creating the file if needed
+	inline int file_open_rw(const std::string &filename)
+	{
+#ifdef _WIN32
+		return _open(filename.c_str(), _O_RDWR | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+		return open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+#endif
+	}
+
+	//write every byte of p at file offset off
+	inline bool file_write_at(int fd, uint64_t off, const char *p, size_t n)
+	{
+#ifdef _WIN32
+		return _lseeki64(fd, (__int64)off, SEEK_SET) >= 0 && write_all(fd, p, n);
+#else
+		while (n > 0)
+		{
+			ssize_t w = pwrite(fd, p, n, (off_t)off);
+			if (w < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (w <= 0)
+			{
+				return false;
+			}
+			p += w;
+			n -= w;
+			off += w;
 		}
+		return true;
+#endif
+	}
 
-		int size() //ΪѾȥ˱лĲ
+	//read n bytes at file offset off; false if they are not all there
+	inline bool file_read_at(int fd, uint64_t off, char *p, size_t n)
+	{
+#ifdef _WIN32
+		if (_lseeki64(fd, (__int64)off, SEEK_SET) < 0)
 		{
-			return total - str.size();
+			return false;
+		}
+#endif
+		while (n > 0)
+		{
+#ifdef _WIN32
+			int r = _read(fd, p, n > 0x40000000 ? 0x40000000 : (unsigned)n);
+#else
+			ssize_t r = pread(fd, p, n, (off_t)off);
+			if (r < 0 && errno == EINTR)
+			{
+				continue;
+			}
+#endif
+			if (r <= 0)
+			{
+				return false;
+			}
+			p += r;
+			n -= r;
+			off += r;
 		}
+		return true;
+	}
 
-	protected:
-		std::string str;
-		int total;
-	};
+	//cut the file at len bytes
+	inline bool file_truncate(int fd, uint64_t len)
+	{
+#ifdef _WIN32
+		return _chsize_s(fd, (__int64)len) == 0;
+#else
+		return ftruncate(fd, (off_t)len) == 0;
+#endif
+	}
 
+	//flush written data to stable storage
+	inline bool file_sync(int fd)
+	{
+#ifdef _WIN32
+		return _commit(fd) == 0;
+#else
+		return fsync(fd) == 0;
+#endif
+	}
 
 
-	//serialize to a binary file
-	template<typename SerializableType>
-	void serialize_to_binaryfile(SerializableType& a, std::string filename) {
-		OutStream oe;
-		oe << a;
-		std::string input = oe.str();
-		std::ofstream file(filename, std::ios_base::out | std::ios_base::binary);
-		if (!file.is_open()) {
-			std::cout << "File open error!\n";
-			return;
+	//rename from over to, replacing to in one step
+	inline bool file_replace(const std::string &from, const std::string &to)
+	{
+#ifdef _WIN32
+		return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+		return rename(from.c_str(), to.c_str()) == 0;
+#endif
+	}
+
+
+	//read-only memory mapping of a whole file
+	class MappedFile
+	{
+	public:
+		MappedFile() : ptr(NULL), len(0), ok(false)
+#ifdef _WIN32
+			, file(INVALID_HANDLE_VALUE), mapping(NULL)
+#endif
+		{}
+		explicit MappedFile(const std::string &filename) : ptr(NULL), len(0), ok(false)
+#ifdef _WIN32
+			, file(INVALID_HANDLE_VALUE), mapping(NULL)
+#endif
+		{
+			open(filename);
 		}
-		file.write(input.c_str(), input.size() + 1);
-		file.close();
+		~MappedFile()
+		{
+			close();
+		}
+
+		bool open(const std::string &filename)
+		{
+			close();
+#ifdef _WIN32
+			file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (file == INVALID_HANDLE_VALUE)
+			{
+				return false;
+			}
+			LARGE_INTEGER sz;
+			GetFileSizeEx(file, &sz);
+			len = (size_t)sz.QuadPart;
+			if (len > 0)
+			{
+				mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+				ptr = mapping ? (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+				if (!ptr)
+				{
+					close();
+					return false;
+				}
+			}
+#else
+			int fd = ::open(filename.c_str(), O_RDONLY);
+			if (fd < 0)
+			{
+				return false;
+			}
+			struct stat st;
+			if (fstat(fd, &st) != 0)
+			{
+				::close(fd);
+				return false;
+			}
+			len = (size_t)st.st_size;
+			if (len > 0)
+			{
+				void *p = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+				ptr = p == MAP_FAILED ? NULL : (const char*)p;
+			}
+			::close(fd);
+			if (len > 0 && !ptr)
+			{
+				len = 0;
+				return false;
+			}
+#endif
+			ok = true;
+			return true;
+		}
+
+		void close()
+		{
+#ifdef _WIN32
+			if (ptr)
+				UnmapViewOfFile(ptr);
+			if (mapping)
+				CloseHandle(mapping);
+			if (file != INVALID_HANDLE_VALUE)
+				CloseHandle(file);
+			mapping = NULL;
+			file = INVALID_HANDLE_VALUE;
+#else
+			if (ptr)
+				munmap((void*)ptr, len);
+#endif
+			ptr = NULL;
+			len = 0;
+			ok = false;
+		}
+
+		bool is_open() const { return ok; }
+		const char* data() const { return ptr; }
+		size_t size() const { return len; }
+
+	private:
+		MappedFile(const MappedFile&);
+		MappedFile& operator=(const MappedFile&);
+
+		const char *ptr;
+		size_t len;
+		bool ok;
+#ifdef _WIN32
+		HANDLE file;
+		HANDLE mapping;
+#endif
+	};
+
+
+	//FNV-1a, used to hash encoded keys for indexes and filters
+	inline uint64_t key_hash(const char *p, size_t n)
+	{
+		uint64_t h = 14695981039346656037ull;
+		for (size_t i = 0; i < n; ++i)
+		{
+			h = (h ^ (unsigned char)p[i]) * 1099511628211ull;
+		}
+		return h;
+	}
+
+
+	//CRC-32C (Castagnoli polynomial), table driven
+	//pass the previous result as crc to checksum data in pieces
+	inline uint32_t crc32c_table(const void *data, size_t n, uint32_t crc = 0)
+	{
+		struct Table
+		{
+			uint32_t v[256];
+			Table()
+			{
+				for (uint32_t i = 0; i < 256; ++i)
+				{
+					uint32_t c = i;
+					for (int k = 0; k < 8; ++k)
+					{
+						c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+					}
+					v[i] = c;
+				}
+			}
+		};
+		static const Table t;
+
+		const unsigned char *p = (const unsigned char*)data;
+		crc = ~crc;
+		for (size_t i = 0; i < n; ++i)
+		{
+			crc = t.v[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+#ifdef BS_CRC32C_SSE42
+	//the same CRC with the SSE4.2 crc32 instruction, 8 bytes at a time
+#ifndef _MSC_VER
+	__attribute__((target("sse4.2")))
+#endif
+	inline uint32_t crc32c_sse42(const void *data, size_t n, uint32_t crc = 0)
+	{
+		const char *p = (const char*)data;
+		uint64_t c = ~crc;
+		for (; n >= 8; p += 8, n -= 8)
+		{
+			uint64_t w;
+			memcpy(&w, p, sizeof(w));
+			c = _mm_crc32_u64(c, w);
+		}
+		uint32_t c32 = (uint32_t)c;
+		for (; n > 0; ++p, --n)
+		{
+			c32 = _mm_crc32_u8(c32, (unsigned char)*p);
+		}
+		return ~c32;
+	}
+
+	inline bool cpu_has_sse42()
+	{
+#ifdef _MSC_VER
+		int r[4];
+		__cpuid(r, 1);
+		return ((r[2] >> 20) & 1) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse4.2") != 0;
+#endif
+	}
+#endif
+
+	//CRC-32C with the fastest implementation the CPU supports
+	inline uint32_t crc32c(const void *data, size_t n, uint32_t crc = 0)
+	{
+#ifdef BS_CRC32C_SSE42
+		static const bool hw = cpu_has_sse42();
+		if (hw)
+		{
+			return crc32c_sse42(data, n, crc);
+		}
+#endif
+		return crc32c_table(data, n, crc);
+	}
+
+
+	//64-bit content hash (XXH64, seed 0), fed in pieces
+	class Hash64
+	{
+	public:
+		Hash64() : total(0), held(0)
+		{
+			v[0] = P1 + P2;
+			v[1] = P2;
+			v[2] = 0;
+			v[3] = 0 - P1;
+		}
+
+		void update(const void *data, size_t n)
+		{
+			const char *p = (const char*)data;
+			total += n;
+			if (held + n < 32)
+			{
+				memcpy(tail + held, p, n);
+				held += n;
+				return;
+			}
+			if (held > 0)
+			{
+				size_t k = 32 - held;
+				memcpy(tail + held, p, k);
+				stripe(tail);
+				p += k;
+				n -= k;
+				held = 0;
+			}
+			for (; n >= 32; p += 32, n -= 32)
+			{
+				stripe(p);
+			}
+			memcpy(tail, p, n);
+			held = n;
+		}
+
+		uint64_t digest() const
+		{
+			uint64_t h;
+			if (total >= 32)
+			{
+				h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+				for (int i = 0; i < 4; ++i)
+				{
+					h = (h ^ round(0, v[i])) * P1 + P4;
+				}
+			}
+			else
+			{
+				h = P5;
+			}
+			h += total;
+
+			const char *p = tail;
+			size_t n = held;
+			for (; n >= 8; p += 8, n -= 8)
+			{
+				h ^= round(0, load64(p));
+				h = rotl(h, 27) * P1 + P4;
+			}
+			if (n >= 4)
+			{
+				uint32_t w;
+				memcpy(&w, p, sizeof(w));
+				h ^= (uint64_t)w * P1;
+				h = rotl(h, 23) * P2 + P3;
+				p += 4;
+				n -= 4;
+			}
+			for (; n > 0; ++p, --n)
+			{
+				h ^= (unsigned char)*p * P5;
+				h = rotl(h, 11) * P1;
+			}
+
+			h ^= h >> 33;
+			h *= P2;
+			h ^= h >> 29;
+			h *= P3;
+			h ^= h >> 32;
+			return h;
+		}
+
+	private:
+		static const uint64_t P1 = 0x9E3779B185EBCA87ull;
+		static const uint64_t P2 = 0xC2B2AE3D27D4EB4Full;
+		static const uint64_t P3 = 0x165667B19E3779F9ull;
+		static const uint64_t P4 = 0x85EBCA77C2B2AE63ull;
+		static const uint64_t P5 = 0x27D4EB2F165667C5ull;
+
+		static uint64_t rotl(uint64_t x, int r)
+		{
+			return (x << r) | (x >> (64 - r));
+		}
+
+		static uint64_t load64(const char *p)
+		{
+			uint64_t w;
+			memcpy(&w, p, sizeof(w));
+			return w;
+		}
+
+		static uint64_t round(uint64_t acc, uint64_t input)
+		{
+			acc += input * P2;
+			return rotl(acc, 31) * P1;
+		}
+
+		void stripe(const char *p)
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				v[i] = round(v[i], load64(p + 8 * i));
+			}
+		}
+
+		uint64_t v[4];
+		uint64_t total;
+		char tail[32];
+		size_t held;
+	};
+
+
+	//types whose encoding is their in-memory bytes
+	template<typename T> struct is_raw : std::false_type {};
+	template<> struct is_raw<char> : std::true_type {};
+	template<> struct is_raw<int> : std::true_type {};
+	template<> struct is_raw<float> : std::true_type {};
+	template<> struct is_raw<double> : std::true_type {};
+
+	//types BS::serialize_into can encode without allocating: raw types,
+	//strings, InPlaceSerializable classes and std containers of those
+	template<typename T> struct encodes_in_place : std::is_base_of<InPlaceSerializable, T> {};
+	template<> struct encodes_in_place<char> : std::true_type {};
+	template<> struct encodes_in_place<int> : std::true_type {};
+	template<> struct encodes_in_place<float> : std::true_type {};
+	template<> struct encodes_in_place<double> : std::true_type {};
+	template<> struct encodes_in_place<std::string> : std::true_type {};
+	template<typename T> struct encodes_in_place<std::vector<T> > : encodes_in_place<T> {};
+	template<typename T> struct encodes_in_place<std::list<T> > : encodes_in_place<T> {};
+	template<typename T> struct encodes_in_place<std::set<T> > : encodes_in_place<T> {};
+	template<typename A, typename B> struct encodes_in_place<std::pair<A, B> >
+		: std::integral_constant<bool, encodes_in_place<A>::value && encodes_in_place<B>::value> {};
+	template<typename A, typename B> struct encodes_in_place<std::map<A, B> >
+		: std::integral_constant<bool, encodes_in_place<A>::value && encodes_in_place<B>::value> {};
+
+
+	//output stream over an arbitrary Buffer, which provides write(p, n),
+	//write_ref(p, n) for bulk payloads, spare(), spare_size(), reserve(n),
+	//commit(n) and size()
+	//the byte layout is the same as OutStream
+	template<typename Buffer>
+	class BasicOutStream
+	{
+	public:
+
+		BasicOutStream()
+		{}
+		explicit BasicOutStream(const Buffer &b) : buf(b)
+		{}
+
+		BasicOutStream& operator<< (const char &a) { return write_raw(a); }
+		BasicOutStream& operator<< (const int &a) { return write_raw(a); }
+		BasicOutStream& operator<< (const float &a) { return write_raw(a); }
+		BasicOutStream& operator<< (const double &a) { return write_raw(a); }
+
+		//outstream for std::string (len+str.data())
+		BasicOutStream& operator<< (const std::string &s)
+		{
+			write_len(s.size());
+			buf.write_ref(s.data(), s.size());
+			return *this;
+		}
+
+		//outstream for user-defined type
+		template<typename SerializableType>
+		BasicOutStream& operator<< (const SerializableType &a)
+		{
+			return write_object(a, std::is_base_of<Serializable, SerializableType>());
+		}
+
+		//outstream for vector
+		template<typename BasicType>
+		BasicOutStream& operator<< (const std::vector<BasicType> &a)
+		{
+			return write_vector(a, is_raw<BasicType>());
+		}
+
+		//outstream for list
+		template<typename BasicType>
+		BasicOutStream& operator<< (const std::list<BasicType> &a)
+		{
+			return write_range(a.size(), a.begin(), a.end());
+		}
+
+		//outstream for set
+		template<typename BasicType>
+		BasicOutStream& operator<< (const std::set<BasicType> &a)
+		{
+			return write_range(a.size(), a.begin(), a.end());
+		}
+
+		//outstream for map (all keys, then all values)
+		template<typename BasicTypeA, typename BasicTypeB>
+		BasicOutStream& operator<< (const std::map<BasicTypeA, BasicTypeB> &a)
+		{
+			typename std::map<BasicTypeA, BasicTypeB>::const_iterator it;
+			write_len(a.size());
+			for (it = a.begin(); it != a.end(); ++it)
+			{
+				*this << it->first;
+			}
+			write_len(a.size());
+			for (it = a.begin(); it != a.end(); ++it)
+			{
+				*this << it->second;
+			}
+			return *this;
+		}
+
+		//outstream for pair
+		template<typename BasicTypeA, typename BasicTypeB>
+		BasicOutStream& operator<< (const std::pair<BasicTypeA, BasicTypeB> &a)
+		{
+			*this << a.first;
+			return *this << a.second;
+		}
+
+		size_t size() const
+		{
+			return buf.size();
+		}
+
+	protected:
+		template<typename PodType>
+		BasicOutStream& write_raw(const PodType &a)
+		{
+			buf.write((const char*)&a, sizeof(PodType));
+			return *this;
+		}
+
+		void write_len(size_t n)
+		{
+			int len = (int)n;
+			write_raw(len);
+		}
+
+		//vector of char/int/float/double: one bulk write of the elements
+		template<typename BasicType>
+		BasicOutStream& write_vector(const std::vector<BasicType> &a, std::true_type)
+		{
+			write_len(a.size());
+			if (!a.empty())
+			{
+				buf.write_ref((const char*)&a[0], a.size() * sizeof(BasicType));
+			}
+			return *this;
+		}
+
+		template<typename BasicType>
+		BasicOutStream& write_vector(const std::vector<BasicType> &a, std::false_type)
+		{
+			return write_range(a.size(), a.begin(), a.end());
+		}
+
+		template<typename Iterator>
+		BasicOutStream& write_range(size_t n, Iterator first, Iterator last)
+		{
+			write_len(n);
+			for (; first != last; ++first)
+			{
+				*this << *first;
+			}
+			return *this;
+		}
+
+		//BS::Serializable: encode straight into the buffer
+		template<typename SerializableType>
+		BasicOutStream& write_object(const SerializableType &a, std::true_type)
+		{
+			size_t n = a.serialize_into(buf.spare(), buf.spare_size());
+			if (n > buf.spare_size() && buf.reserve(n))
+			{
+				n = a.serialize_into(buf.spare(), buf.spare_size());
+			}
+			buf.commit(n);
+			return *this;
+		}
+
+		//any other type with a BS::serialize specialization
+		template<typename SerializableType>
+		BasicOutStream& write_object(const SerializableType &a, std::false_type)
+		{
+			std::string x = BS::serialize(const_cast<SerializableType&>(a));
+			buf.write(x.data(), x.size());
+			return *this;
+		}
+
+		Buffer buf;
+	};
+
+
+	//output stream into caller-owned memory, never allocates
+	class BufferOutStream : public BasicOutStream<FixedBuffer>
+	{
+	public:
+		BufferOutStream(char *out, size_t cap) : BasicOutStream<FixedBuffer>(FixedBuffer(out, cap))
+		{}
+
+		bool overflow() const
+		{
+			return buf.overflow();
+		}
+	};
+
+
+	//output stream for small messages, e.g. SmallOutStream<512>
+	//encodes on the stack and only allocates once N bytes are exceeded
+	template<size_t N>
+	class SmallOutStream : public BasicOutStream<SmallBuffer<N> >
+	{
+	public:
+		const char* data() const
+		{
+			return this->buf.data();
+		}
+
+		std::string str() const
+		{
+			return std::string(this->buf.data(), this->buf.size());
+		}
+
+		bool on_heap() const
+		{
+			return this->buf.on_heap();
+		}
+
+		void clear()
+		{
+			this->buf.clear();
+		}
+	};
+
+
+	//hash of a key in its serialized form
+	template<typename KeyType>
+	uint64_t key_hash(const KeyType &key)
+	{
+		SmallOutStream<256> oe;
+		oe << key;
+		return key_hash(oe.data(), oe.size());
+	}
+
+
+	//gather output: strings and raw vectors of at least threshold bytes are
+	//referenced instead of copied, and written out with writev
+	//the serialized objects must outlive the stream's output
+	class GatherOutStream : public BasicOutStream<GatherBuffer>
+	{
+	public:
+		explicit GatherOutStream(size_t threshold = 4096)
+		{
+			buf.set_threshold(threshold);
+		}
+
+		std::vector<IoSlice> slices() const
+		{
+			return buf.slices();
+		}
+
+		//copy everything into one string
+		std::string str() const
+		{
+			std::vector<IoSlice> v = buf.slices();
+			std::string ret;
+			ret.reserve(buf.size());
+			for (size_t i = 0; i < v.size(); ++i)
+			{
+				ret.append(v[i].base, v[i].len);
+			}
+			return ret;
+		}
+
+		//write to a file or pipe descriptor
+		bool write_to(int fd) const
+		{
+			return write_slices(fd, buf.slices());
+		}
+	};
+
+
+	//buffer that streams to a file descriptor in chunks of cap bytes
+	class FileBuffer
+	{
+	public:
+		FileBuffer() : fd(-1), owns(false), pos(0), total(0), ok(true)
+		{}
+		~FileBuffer()
+		{
+			close();
+			BufferPool::release(s);
+		}
+
+		void attach(int f, bool own, size_t cap)
+		{
+			fd = f;
+			owns = own;
+			ok = fd >= 0;
+			s = BufferPool::acquire();
+			s.resize(cap);
+		}
+
+		void write(const char *p, size_t n)
+		{
+			if (n > s.size() - pos)
+			{
+				flush();
+				if (n >= s.size())
+				{
+					ok = write_all(fd, p, n) && ok; //too big to be worth buffering
+					total += n;
+					return;
+				}
+			}
+			memcpy(&s[0] + pos, p, n);
+			pos += n;
+			total += n;
+		}
+		void write_ref(const char *p, size_t n) { write(p, n); }
+
+		char* spare() { return &s[0] + pos; }
+		size_t spare_size() const { return s.size() - pos; }
+		bool reserve(size_t n)
+		{
+			flush();
+			if (n > s.size())
+			{
+				s.resize(n);
+			}
+			return true;
+		}
+		void commit(size_t n)
+		{
+			pos += n;
+			total += n;
+		}
+
+		size_t size() const { return (size_t)total; }
+
+		bool flush()
+		{
+			if (pos > 0 && fd >= 0)
+			{
+				ok = write_all(fd, s.data(), pos) && ok;
+			}
+			pos = 0;
+			return ok;
+		}
+
+		bool close()
+		{
+			flush();
+			if (owns && fd >= 0)
+			{
+				file_close(fd);
+			}
+			fd = -1;
+			return ok;
+		}
+
+		int handle() const { return fd; }
+		bool good() const { return ok; }
+
+	private:
+		FileBuffer(const FileBuffer&);
+		FileBuffer& operator=(const FileBuffer&);
+
+		int fd;
+		bool owns;
+		std::string s;
+		size_t pos;
+		uint64_t total;
+		bool ok;
+	};
+
+
+	//running CRC-32C, 64-bit hash and length of the bytes through a stream
+	struct StreamChecksum
+	{
+		StreamChecksum() : crc(0), length(0)
+		{}
+
+		void update(const char *p, size_t n)
+		{
+			crc = crc32c(p, n, crc);
+			hash.update(p, n);
+			length += n;
+		}
+
+		uint32_t crc;
+		Hash64 hash;
+		uint64_t length;
+	};
+
+	//appended by a checked stream's finish(); covers everything before it
+	struct ChecksumTrailer
+	{
+		uint64_t length;
+		uint64_t hash;
+		uint32_t crc;
+		char magic[4];
+	};
+	static const char CHECKSUM_TRAILER_MAGIC[4] = { 'B', 'S', 'C', 'K' };
+
+	//wraps any Buffer to checksum the bytes while they are encoded
+	template<typename Buffer>
+	class ChecksumBuffer : public Buffer
+	{
+	public:
+		void write(const char *p, size_t n)
+		{
+			sum.update(p, n);
+			Buffer::write(p, n);
+		}
+
+		void write_ref(const char *p, size_t n)
+		{
+			sum.update(p, n);
+			Buffer::write_ref(p, n);
+		}
+
+		void commit(size_t n)
+		{
+			sum.update(Buffer::spare(), n);
+			Buffer::commit(n);
+		}
+
+		//checksum of the bytes so far
+		ChecksumTrailer trailer() const
+		{
+			ChecksumTrailer t;
+			t.length = sum.length;
+			t.hash = sum.hash.digest();
+			t.crc = sum.crc;
+			memcpy(t.magic, CHECKSUM_TRAILER_MAGIC, sizeof(t.magic));
+			return t;
+		}
+
+		//append the trailer, outside the checksummed bytes
+		ChecksumTrailer write_trailer()
+		{
+			ChecksumTrailer t = trailer();
+			Buffer::write((const char*)&t, sizeof(t));
+			return t;
+		}
+
+	private:
+		StreamChecksum sum;
+	};
+
+
+	//streaming file sink: encodes through a fixed-size buffer straight into
+	//a file or pipe, so memory use does not grow with the output
+	template<typename Buffer>
+	class BasicFileOutStream : public BasicOutStream<Buffer>
+	{
+	public:
+		explicit BasicFileOutStream(const std::string &filename, size_t buffer_bytes = 64 * 1024)
+		{
+			this->buf.attach(file_open_write(filename), true, buffer_bytes);
+		}
+
+		//write to an open descriptor, which stays open
+		explicit BasicFileOutStream(int fd, size_t buffer_bytes = 64 * 1024)
+		{
+			this->buf.attach(fd, false, buffer_bytes);
+		}
+
+		bool flush() { return this->buf.flush(); }
+		bool close() { return this->buf.close(); }
+		bool good() const { return this->buf.good(); }
+
+		//flush and fsync
+		bool sync()
+		{
+			return this->buf.flush() && file_sync(this->buf.handle());
+		}
+
+		//checked sinks only: checksum of the bytes so far
+		ChecksumTrailer checksum() const
+		{
+			return this->buf.trailer();
+		}
+
+		//checked sinks only: append the trailer and return it
+		ChecksumTrailer finish()
+		{
+			return this->buf.write_trailer();
+		}
+	};
+
+	typedef BasicFileOutStream<FileBuffer> FileOutStream;
+	typedef BasicFileOutStream<ChecksumBuffer<FileBuffer> > CheckedFileOutStream;
+
+
+	//serialize into caller-owned memory without allocating
+	//return the bytes written, or the required size if it is larger than cap
+	//user classes must derive from InPlaceSerializable
+	template<typename SerializableType>
+	size_t serialize_into(char *out, size_t cap, const SerializableType& a)
+	{
+		static_assert(encodes_in_place<SerializableType>::value,
+			"BS::serialize_into: derive user classes from BS::InPlaceSerializable");
+		BufferOutStream oe(out, cap);
+		oe << a;
+		return oe.size();
+	}
+
+	//encoded size of a, computed without writing anything
+	template<typename SerializableType>
+	size_t serialized_size(const SerializableType& a)
+	{
+		BufferOutStream oe(NULL, 0);
+		oe << a;
+		return oe.size();
+	}
+
+
+
+
+	//Define input and output stream for serialize & deserialize type
+	//output stream
+	class OutStream : public BasicOutStream<PooledBuffer>
+	{
+	public:
+
+		OutStream()
+		{}
+
+		std::string str() const
+		{
+			return buf.str();
+		}
+
+		const char* data() const
+		{
+			return buf.data();
+		}
+	};
+
+
+	//OutStream that checksums what it encodes
+	class CheckedOutStream : public BasicOutStream<ChecksumBuffer<PooledBuffer> >
+	{
+	public:
+
+		CheckedOutStream()
+		{}
+
+		std::string str() const
+		{
+			return buf.str();
+		}
+
+		const char* data() const
+		{
+			return buf.data();
+		}
+
+		//checksum of the bytes so far
+		ChecksumTrailer checksum() const
+		{
+			return buf.trailer();
+		}
+
+		//append the trailer and return it
+		ChecksumTrailer finish()
+		{
+			return buf.write_trailer();
+		}
+	};
+
+
+	//segments handed to an InStream on demand, e.g. files mapped a few at a
+	//time. segment(i) may invalidate what earlier calls returned; InStream
+	//only reads from the segment it asked for last
+	class SegmentSource
+	{
+	public:
+		virtual ~SegmentSource() {}
+
+		virtual size_t count() const = 0;
+
+		//length of segment i, known without producing it
+		virtual size_t length(size_t i) const = 0;
+
+		//false if segment i cannot be produced, e.g. it is missing or damaged
+		virtual bool segment(size_t i, IoSlice &s) = 0;
+	};
+
+
+	//input stream
+	//reads from one contiguous buffer or from a chain of segments; values may
+	//straddle segment boundaries. The input is not copied, so it must outlive
+	//the stream
+	class InStream
+	{
+	public:
+
+		//s is read in place, so a temporary would be gone before the reads
+		InStream(std::string &&) = delete;
+
+		InStream(const std::string &s) : segs(&single), nsegs(1), seg(0), consumed(0), fail(false), source(NULL), seg_base(NULL), seg_len(0)
+		{
+			single.base = s.data();
+			single.len = s.size();
+			cur = single.base;
+			left = single.len;
+		}
+
+		InStream(const char *p, size_t n) : segs(&single), nsegs(1), seg(0), consumed(0), fail(false), source(NULL), seg_base(NULL), seg_len(0)
+		{
+			single.base = p;
+			single.len = n;
+			cur = p;
+			left = n;
+		}
+
+		//segment chain, e.g. chunks of a ring buffer
+		InStream(const IoSlice *chain, size_t count) : segs(chain), nsegs(count), seg(0), consumed(0), fail(false), source(NULL), seg_base(NULL), seg_len(0)
+		{
+			cur = count ? segs[0].base : NULL;
+			left = count ? segs[0].len : 0;
+		}
+
+		explicit InStream(const std::vector<IoSlice> &chain) : segs(chain.empty() ? NULL : &chain[0]), nsegs(chain.size()), seg(0), consumed(0), fail(false), source(NULL), seg_base(NULL), seg_len(0)
+		{
+			cur = nsegs ? segs[0].base : NULL;
+			left = nsegs ? segs[0].len : 0;
+		}
+
+		//segments pulled from src as the reads reach them
+		explicit InStream(SegmentSource &src) : segs(NULL), nsegs(src.count()), seg(0), cur(NULL), left(0), consumed(0), fail(false), source(&src), seg_base(NULL), seg_len(0)
+		{
+			if (nsegs)
+			{
+				load_segment(0);
+			}
+		}
+
+		InStream& operator>> (char &a) { return read_raw(a); }
+		InStream& operator>> (int &a) { return read_raw(a); }
+		InStream& operator>> (float &a) { return read_raw(a); }
+		InStream& operator>> (double &a) { return read_raw(a); }
+
+		//instream for std::string (len+str.data())
+		InStream& operator>> (std::string &s)
+		{
+			size_t len = read_len();
+			if (len <= left)
+			{
+				s.assign(cur, len); //fast path: the body is inside one segment
+				advance(len);
+			}
+			else if (len > available())
+			{
+				fail = true; //a corrupt length, not worth allocating for
+			}
+			else
+			{
+				s.resize(len);
+				read(len ? &s[0] : NULL, len);
+			}
+			return *this;
+		}
+
+		//instream for user-defined type
+		template<typename SerializableType>
+		InStream& operator>> (SerializableType& a)
+		{
+			return read_object(a, std::is_base_of<Serializable, SerializableType>());
+		}
+
+		//instream for vector
+		template<typename BasicType>
+		InStream& operator>> (std::vector<BasicType>& a)
+		{
+			return read_vector(a, is_raw<BasicType>());
+		}
+
+		//instream for list
+		template<typename BasicType>
+		InStream& operator>> (std::list<BasicType>& a)
+		{
+			size_t len = read_len();
+			for (size_t i = 0; i < len && !fail; ++i)
+			{
+				BasicType item;
+				*this >> item;
+				a.push_back(item);
+			}
+			return *this;
+		}
+
+		//instream for set
+		template<typename BasicType>
+		InStream& operator>> (std::set<BasicType>& a)
+		{
+			size_t len = read_len();
+			for (size_t i = 0; i < len && !fail; ++i)
+			{
+				BasicType item;
+				*this >> item;
+				a.insert(a.end(), item);
+			}
+			return *this;
+		}
+
+		//instream for map (all keys, then all values)
+		template<typename BasicTypeA, typename BasicTypeB>
+		InStream& operator>> (std::map<BasicTypeA, BasicTypeB>& a)
+		{
+			std::vector<BasicTypeA> tempKey;
+			*this >> tempKey;
+			size_t len = read_len();
+			if (len != tempKey.size())
+			{
+				fail = true;
+				return *this;
+			}
+			for (size_t i = 0; i < len && !fail; ++i)
+			{
+				BasicTypeB val;
+				*this >> val;
+				a.insert(a.end(), std::make_pair(tempKey[i], val));
+			}
+			return *this;
+		}
+
+		//instream for pair
+		template<typename BasicTypeA, typename BasicTypeB>
+		InStream& operator>> (std::pair<BasicTypeA, BasicTypeB>& a)
+		{
+			*this >> a.first;
+			return *this >> a.second;
+		}
+
+		//copy the next n bytes, crossing segments as needed
+		bool read(char *dst, size_t n)
+		{
+			while (n > 0)
+			{
+				if (left == 0 && !next_segment())
+				{
+					fail = true;
+					return false;
+				}
+				size_t k = n < left ? n : left;
+				memcpy(dst, cur, k);
+				dst += k;
+				n -= k;
+				advance(k);
+			}
+			return true;
+		}
+
+		//skip n bytes
+		bool skip(size_t n)
+		{
+			while (n > 0)
+			{
+				if (left == 0 && !next_segment())
+				{
+					fail = true;
+					return false;
+				}
+				size_t k = n < left ? n : left;
+				n -= k;
+				advance(k);
+			}
+			return true;
+		}
+
+		//bytes not read yet, across the remaining segments
+		size_t available() const
+		{
+			size_t n = left;
+			for (size_t i = seg + 1; i < nsegs; ++i)
+			{
+				n += source ? source->length(i) : segs[i].len;
+			}
+			return n;
+		}
+
+		//copy of everything not read yet
+		std::string rest()
+		{
+			std::string ret(cur, left);
+			for (size_t i = seg + 1; i < nsegs && !source; ++i)
+			{
+				ret.append(segs[i].base, segs[i].len);
+			}
+			if (source)
+			{
+				Mark here = mark();
+				while (next_segment())
+				{
+					ret.append(cur, left);
+				}
+				seek(here);
+			}
+			return ret;
+		}
+
+		//visit a serialized vector, list or set one element at a time
+		//fn(BasicType&) sees the same scratch object for every element, so
+		//memory stays constant whatever the element count
+		template<typename BasicType, typename Visitor>
+		InStream& for_each(Visitor fn)
+		{
+			size_t len = read_len();
+			BasicType item;
+			for (size_t i = 0; i < len && !fail; ++i)
+			{
+				reset(item);
+				*this >> item;
+				if (!fail)
+				{
+					fn(item);
+				}
+			}
+			return *this;
+		}
+
+		//same as for_each, in batches of up to n elements: fn(std::vector<BasicType>&)
+		template<typename BasicType, typename Visitor>
+		InStream& for_each_batch(size_t n, Visitor fn)
+		{
+			size_t len = read_len();
+			std::vector<BasicType> batch(n < len ? n : len);
+			size_t i = 0;
+			while (i < len && !fail)
+			{
+				size_t k = len - i < batch.size() ? len - i : batch.size();
+				batch.resize(k);
+				for (size_t j = 0; j < k && !fail; ++j)
+				{
+					reset(batch[j]);
+					*this >> batch[j];
+				}
+				if (!fail)
+				{
+					fn(batch);
+				}
+				i += k;
+			}
+			return *this;
+		}
+
+		//visit a serialized map entry by entry: fn(BasicTypeA&, BasicTypeB&)
+		//keys and values are stored apart, so the key section is walked with a
+		//second cursor instead of being held in memory
+		template<typename BasicTypeA, typename BasicTypeB, typename Visitor>
+		InStream& for_each_entry(Visitor fn)
+		{
+			size_t len = read_len();
+			Mark keys = mark();
+			BasicTypeA key;
+			skip_items(key, len, is_raw<BasicTypeA>());
+			if (read_len() != len || fail)
+			{
+				fail = true;
+				return *this;
+			}
+			Mark vals = mark();
+			BasicTypeB val;
+			for (size_t i = 0; i < len && !fail; ++i)
+			{
+				seek(keys);
+				reset(key);
+				*this >> key;
+				keys = mark();
+				seek(vals);
+				reset(val);
+				*this >> val;
+				vals = mark();
+				if (!fail)
+				{
+					fn(key, val);
+				}
+			}
+			return *this;
+		}
+
+		//visit nested containers: fn(InStream&, size_t index) must read exactly
+		//one element, e.g. with another for_each
+		template<typename Visitor>
+		InStream& for_each_nested(Visitor fn)
+		{
+			size_t len = read_len();
+			for (size_t i = 0; i < len && !fail; ++i)
+			{
+				fn(*this, i);
+			}
+			return *this;
+		}
+
+		//apply a patch written by write_delta to the version it was taken
+		//against; a is left untouched if the patch does not fit it
+		template<typename BasicTypeA, typename BasicTypeB>
+		InStream& apply_delta(std::map<BasicTypeA, BasicTypeB> &a)
+		{
+			size_t base = read_len(), len = read_len();
+			std::vector<BasicTypeA> erased;
+			read_items(erased);
+			std::vector<BasicTypeA> keys;
+			std::vector<BasicTypeB> vals;
+			read_items(keys); //inserted
+			read_items(vals);
+			size_t inserted = keys.size();
+			read_items(keys); //modified
+			read_items(vals);
+			if (fail || base != a.size() || keys.size() != vals.size()
+				|| a.size() - erased.size() + inserted != len)
+			{
+				fail = true;
+				return *this;
+			}
+			for (size_t i = 0; i < erased.size(); ++i)
+			{
+				a.erase(erased[i]);
+			}
+			for (size_t i = 0; i < keys.size(); ++i)
+			{
+				a[keys[i]] = vals[i];
+			}
+			return *this;
+		}
+
+		template<typename BasicType>
+		InStream& apply_delta(std::set<BasicType> &a)
+		{
+			size_t base = read_len(), len = read_len();
+			std::vector<BasicType> erased, inserted;
+			read_items(erased);
+			read_items(inserted);
+			if (fail || base != a.size() || a.size() - erased.size() + inserted.size() != len)
+			{
+				fail = true;
+				return *this;
+			}
+			for (size_t i = 0; i < erased.size(); ++i)
+			{
+				a.erase(erased[i]);
+			}
+			a.insert(inserted.begin(), inserted.end());
+			return *this;
+		}
+
+		template<typename BasicType>
+		InStream& apply_delta(std::vector<BasicType> &a)
+		{
+			size_t base = read_len(), len = read_len();
+			size_t n = read_len();
+			std::vector<size_t> offs;
+			std::vector<std::vector<BasicType> > runs;
+			for (size_t i = 0; i < n && !fail; ++i)
+			{
+				offs.push_back(read_len());
+				runs.push_back(std::vector<BasicType>());
+				read_items(runs.back());
+				fail = fail || offs.back() + runs.back().size() > len;
+			}
+			if (fail || base != a.size())
+			{
+				fail = true;
+				return *this;
+			}
+			a.resize(len);
+			for (size_t i = 0; i < n; ++i)
+			{
+				std::copy(runs[i].begin(), runs[i].end(), a.begin() + offs[i]);
+			}
+			return *this;
+		}
+
+		//false after reading past the end of the input
+		bool good() const
+		{
+			return !fail;
+		}
+
+		int size() //ΪѾȥ˱лĲ
+		{
+			return (int)consumed;
+		}
+
+	protected:
+		template<typename PodType>
+		InStream& read_raw(PodType &a)
+		{
+			if (left >= sizeof(PodType))
+			{
+				memcpy(&a, cur, sizeof(PodType));
+				advance(sizeof(PodType));
+			}
+			else if (!read((char*)&a, sizeof(PodType)))
+			{
+				a = PodType();
+			}
+			return *this;
+		}
+
+		size_t read_len()
+		{
+			int len = 0;
+			read_raw(len);
+			if (len < 0 || fail)
+			{
+				fail = true;
+				return 0;
+			}
+			return (size_t)len;
+		}
+
+		//vector of char/int/float/double: one bulk copy
+		template<typename BasicType>
+		InStream& read_vector(std::vector<BasicType> &a, std::true_type)
+		{
+			size_t len = read_len();
+			if (len > left / sizeof(BasicType) && len > available() / sizeof(BasicType))
+			{
+				fail = true; //a corrupt count, not worth allocating for
+				return *this;
+			}
+			size_t old = a.size();
+			a.resize(old + len);
+			if (len > 0 && !read((char*)&a[old], len * sizeof(BasicType)))
+			{
+				a.resize(old);
+			}
+			return *this;
+		}
+
+		template<typename BasicType>
+		InStream& read_vector(std::vector<BasicType> &a, std::false_type)
+		{
+			size_t len = read_len();
+			for (size_t i = 0; i < len && !fail; ++i)
+			{
+				BasicType item;
+				*this >> item;
+				a.push_back(item);
+			}
+			return *this;
+		}
+
+		//BS::Serializable: let the object read itself
+		template<typename SerializableType>
+		InStream& read_object(SerializableType &a, std::true_type)
+		{
+			a.deserialize_from(*this);
+			return *this;
+		}
+
+		//any other type with a BS::deserialize specialization
+		template<typename SerializableType>
+		InStream& read_object(SerializableType &a, std::false_type)
+		{
+			std::string x = rest();
+			skip(BS::deserialize(x, a));
+			return *this;
+		}
+
+		//cursor position, for reading two sections in step
+		struct Mark
+		{
+			size_t seg;
+			const char *cur;
+			size_t left;
+			size_t consumed;
+		};
+
+		Mark mark() const
+		{
+			Mark m = { seg, cur, left, consumed };
+			return m;
+		}
+
+		void seek(const Mark &m)
+		{
+			if (source)
+			{
+				//the segment may have been let go and produced again elsewhere
+				if (m.seg != seg && !load_segment(m.seg))
+				{
+					return;
+				}
+				cur = seg_base + (seg_len - m.left);
+			}
+			else
+			{
+				cur = m.cur;
+			}
+			seg = m.seg;
+			left = m.left;
+			consumed = m.consumed;
+		}
+
+		//empty a reused scratch object before the next element is read into it
+		template<typename T> static void reset(T &) {}
+		template<typename T> static void reset(std::vector<T> &a) { a.clear(); }
+		template<typename T> static void reset(std::list<T> &a) { a.clear(); }
+		template<typename T> static void reset(std::set<T> &a) { a.clear(); }
+		template<typename A, typename B> static void reset(std::map<A, B> &a) { a.clear(); }
+		template<typename A, typename B> static void reset(std::pair<A, B> &a) { reset(a.first); reset(a.second); }
+
+		//int count, then the elements, appended to a
+		template<typename T>
+		void read_items(std::vector<T> &a)
+		{
+			size_t len = read_len();
+			for (size_t i = 0; i < len && !fail; ++i)
+			{
+				a.push_back(T());
+				*this >> a.back();
+			}
+		}
+
+		template<typename T>
+		void skip_items(T &, size_t len, std::true_type)
+		{
+			skip(len * sizeof(T));
+		}
+
+		template<typename T>
+		void skip_items(T &scratch, size_t len, std::false_type)
+		{
+			for (size_t i = 0; i < len && !fail; ++i)
+			{
+				reset(scratch);
+				*this >> scratch;
+			}
+		}
+
+		void advance(size_t n)
+		{
+			cur += n;
+			left -= n;
+			consumed += n;
+		}
+
+		bool next_segment()
+		{
+			while (seg + 1 < nsegs && load_segment(seg + 1))
+			{
+				if (left > 0)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		//make segment i current; a source that cannot produce it fails the stream
+		bool load_segment(size_t i)
+		{
+			IoSlice s = { NULL, 0 };
+			if (!source)
+			{
+				s = segs[i];
+			}
+			else if (!source->segment(i, s))
+			{
+				fail = true;
+				left = 0;
+				return false;
+			}
+			seg = i;
+			cur = seg_base = s.base;
+			left = seg_len = s.len;
+			return true;
+		}
+
+	private:
+		InStream(const InStream&);
+		InStream& operator=(const InStream&);
+
+		IoSlice single;
+		const IoSlice *segs;
+		size_t nsegs;
+		size_t seg;
+		const char *cur;
+		size_t left;
+		size_t consumed;
+		bool fail;
+		SegmentSource *source;
+		const char *seg_base; //start and length of the current segment
+		size_t seg_len;
+	};
+
+
+	//input ending in a ChecksumTrailer: the CRC is brought up to date after
+	//every >>, so verify() at the end only has the last value left to check
+	class CheckedInStream : public InStream
+	{
+	public:
+		CheckedInStream(const char *p, size_t n) : InStream(p, payload(p, n)), base(p), checked(0), crc(0), has_trailer(payload(p, n) != n)
+		{
+			if (has_trailer)
+			{
+				memcpy(&t, p + n - sizeof(t), sizeof(t));
+			}
+		}
+
+		CheckedInStream(std::string &&) = delete;
+
+		explicit CheckedInStream(const std::string &s) : InStream(s.data(), payload(s.data(), s.size())), base(s.data()), checked(0), crc(0), has_trailer(payload(s.data(), s.size()) != s.size())
+		{
+			if (has_trailer)
+			{
+				memcpy(&t, s.data() + s.size() - sizeof(t), sizeof(t));
+			}
+		}
+
+		template<typename T>
+		CheckedInStream& operator>> (T &a)
+		{
+			static_cast<InStream&>(*this) >> a;
+			update();
+			return *this;
+		}
+
+		//true if everything was read and matches the trailer
+		bool verify()
+		{
+			update();
+			return has_trailer && good() && checked == t.length && crc == t.crc;
+		}
+
+		//what the writer computed; zeroed if there is no trailer
+		ChecksumTrailer trailer() const
+		{
+			if (has_trailer)
+			{
+				return t;
+			}
+			ChecksumTrailer none = {};
+			return none;
+		}
+
+	private:
+		//bytes before the trailer, or n if there is none
+		static size_t payload(const char *p, size_t n)
+		{
+			if (n >= sizeof(ChecksumTrailer) && memcmp(p + n - sizeof(CHECKSUM_TRAILER_MAGIC), CHECKSUM_TRAILER_MAGIC, sizeof(CHECKSUM_TRAILER_MAGIC)) == 0)
+			{
+				return n - sizeof(ChecksumTrailer);
+			}
+			return n;
+		}
+
+		void update()
+		{
+			size_t pos = (size_t)size();
+			if (pos > checked)
+			{
+				crc = crc32c(base + checked, pos - checked, crc);
+				checked = pos;
+			}
+		}
+
+		const char *base;
+		size_t checked;
+		uint32_t crc;
+		bool has_trailer;
+		ChecksumTrailer t;
+	};
+
+
+	//default: materialize the rest of the input and go through deserialize()
+	inline void Serializable::deserialize_from(InStream &in)
+	{
+		std::string x = in.rest();
+		in.skip(deserialize(x));
+	}
+
+	////////////////////////////////////////////
+	//Delta encoding: the change from an older version of a container, applied
+	//with InStream::apply_delta on a copy of that version
+	//map:    base size, new size, erased keys, inserted keys + values,
+	//        modified keys + values
+	//set:    base size, new size, erased keys, inserted keys
+	//vector: base size, new size, count of changed runs, then per run its
+	//        offset and elements
+	//each key/value list is an int count followed by the items
+	//elements are compared with ==
+	///////////////////////////////////////////
+	template<typename Stream, typename BasicTypeA, typename BasicTypeB>
+	void write_delta(Stream &out, const std::map<BasicTypeA, BasicTypeB> &base, const std::map<BasicTypeA, BasicTypeB> &cur)
+	{
+		typedef typename std::map<BasicTypeA, BasicTypeB>::const_iterator Iter;
+		std::vector<Iter> erased, inserted, modified;
+		Iter i = base.begin(), j = cur.begin();
+		while (i != base.end() || j != cur.end())
+		{
+			if (j == cur.end() || (i != base.end() && i->first < j->first))
+			{
+				erased.push_back(i++);
+			}
+			else if (i == base.end() || j->first < i->first)
+			{
+				inserted.push_back(j++);
+			}
+			else
+			{
+				if (!(i->second == j->second))
+				{
+					modified.push_back(j);
+				}
+				++i;
+				++j;
+			}
+		}
+
+		out << (int)base.size() << (int)cur.size();
+		out << (int)erased.size();
+		for (size_t k = 0; k < erased.size(); ++k)
+			out << erased[k]->first;
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			const std::vector<Iter> &v = pass == 0 ? inserted : modified;
+			out << (int)v.size();
+			for (size_t k = 0; k < v.size(); ++k)
+				out << v[k]->first;
+			out << (int)v.size();
+			for (size_t k = 0; k < v.size(); ++k)
+				out << v[k]->second;
+		}
+	}
+
+	template<typename Stream, typename BasicType>
+	void write_delta(Stream &out, const std::set<BasicType> &base, const std::set<BasicType> &cur)
+	{
+		typedef typename std::set<BasicType>::const_iterator Iter;
+		std::vector<Iter> erased, inserted;
+		Iter i = base.begin(), j = cur.begin();
+		while (i != base.end() || j != cur.end())
+		{
+			if (j == cur.end() || (i != base.end() && *i < *j))
+			{
+				erased.push_back(i++);
+			}
+			else if (i == base.end() || *j < *i)
+			{
+				inserted.push_back(j++);
+			}
+			else
+			{
+				++i;
+				++j;
+			}
+		}
+
+		out << (int)base.size() << (int)cur.size();
+		out << (int)erased.size();
+		for (size_t k = 0; k < erased.size(); ++k)
+			out << *erased[k];
+		out << (int)inserted.size();
+		for (size_t k = 0; k < inserted.size(); ++k)
+			out << *inserted[k];
+	}
+
+	//runs of changed elements closer than gap are sent as one run
+	template<typename Stream, typename BasicType>
+	void write_delta(Stream &out, const std::vector<BasicType> &base, const std::vector<BasicType> &cur, size_t gap = 4)
+	{
+		std::vector<std::pair<size_t, size_t> > runs; //[begin, end)
+		for (size_t i = 0; i < cur.size(); ++i)
+		{
+			if (i < base.size() && base[i] == cur[i])
+			{
+				continue;
+			}
+			if (!runs.empty() && i - runs.back().second <= gap)
+			{
+				runs.back().second = i + 1;
+			}
+			else
+			{
+				runs.push_back(std::make_pair(i, i + 1));
+			}
+		}
+
+		out << (int)base.size() << (int)cur.size();
+		out << (int)runs.size();
+		for (size_t r = 0; r < runs.size(); ++r)
+		{
+			out << (int)runs[r].first << (int)(runs[r].second - runs[r].first);
+			for (size_t i = runs[r].first; i < runs[r].second; ++i)
+				out << cur[i];
+		}
+	}
+
+	//the delta from base to cur as a byte string
+	template<typename Container>
+	std::string serialize_delta(const Container &base, const Container &cur)
+	{
+		OutStream oe;
+		write_delta(oe, base, cur);
+		return oe.str();
+	}
+
+	//patch a in place; false (and a unchanged) if the patch is not for a
+	template<typename Container>
+	bool apply_delta(Container &a, const std::string &patch)
+	{
+		InStream ie(patch);
+		ie.apply_delta(a);
+		return ie.good();
+	}
+
+
+
+	//cursor over the chunk being pushed; bad is set on malformed input
+	//(e.g. a negative length) and stays set
+	struct PushCursor
+	{
+		const char *p;
+		const char *end;
+		bool bad;
+
+		size_t avail() const
+		{
+			return (size_t)(end - p);
+		}
+	};
+
+	//resumable decoding of one value: feed() takes what it can from the
+	//cursor and returns true once out is complete. The state in between is
+	//kept per level (length read, elements done, the partial element), so
+	//every byte is decoded once however the input is chunked
+	//types without a resumable form (user types) are the exception: their
+	//bytes are held until one whole decode of the object succeeds
+	template<typename T>
+	class PartialValue
+	{
+	public:
+		bool feed(PushCursor &c, T &out)
+		{
+			if (c.avail() == 0)
+			{
+				return false;
+			}
+			IoSlice chain[2];
+			size_t cnt = 0;
+			if (!held.empty())
+			{
+				IoSlice x = { held.data(), held.size() };
+				chain[cnt++] = x;
+			}
+			IoSlice y = { c.p, c.avail() };
+			chain[cnt++] = y;
+
+			T value;
+			InStream ie(chain, cnt);
+			ie >> value;
+			if (!ie.good())
+			{
+				held.append(c.p, c.avail());
+				c.p = c.end;
+				return false;
+			}
+			size_t used = (size_t)ie.size();
+			if (used < held.size())
+			{
+				c.bad = true; //it failed on these bytes before
+				return false;
+			}
+			c.p += used - held.size();
+			held.clear();
+			std::swap(out, value);
+			return true;
+		}
+
+		//input bytes held back for the value in progress
+		size_t pending() const
+		{
+			return held.size();
+		}
+
+	private:
+		std::string held;
+	};
+
+	//char/int/float/double: only the bytes of a split value are kept
+	template<typename PodType>
+	class PartialRaw
+	{
+	public:
+		PartialRaw() : got(0)
+		{}
+
+		bool feed(PushCursor &c, PodType &out)
+		{
+			if (c.avail() == 0)
+			{
+				return false;
+			}
+			if (got == 0 && c.avail() >= sizeof(PodType))
+			{
+				memcpy(&out, c.p, sizeof(PodType));
+				c.p += sizeof(PodType);
+				return true;
+			}
+			size_t k = sizeof(PodType) - got;
+			k = k < c.avail() ? k : c.avail();
+			memcpy(bytes + got, c.p, k);
+			c.p += k;
+			got += k;
+			if (got < sizeof(PodType))
+			{
+				return false;
+			}
+			memcpy(&out, bytes, sizeof(PodType));
+			got = 0;
+			return true;
+		}
+
+		size_t pending() const
+		{
+			return got;
+		}
+
+	private:
+		char bytes[sizeof(PodType)];
+		size_t got;
+	};
+
+	template<> class PartialValue<char> : public PartialRaw<char> {};
+	template<> class PartialValue<int> : public PartialRaw<int> {};
+	template<> class PartialValue<float> : public PartialRaw<float> {};
+	template<> class PartialValue<double> : public PartialRaw<double> {};
+
+	//the int count in front of strings and containers
+	class PartialLen
+	{
+	public:
+		bool feed(PushCursor &c, size_t &len)
+		{
+			int n = 0;
+			if (!raw.feed(c, n))
+			{
+				return false;
+			}
+			if (n < 0)
+			{
+				c.bad = true;
+				return false;
+			}
+			len = (size_t)n;
+			return true;
+		}
+
+		size_t pending() const
+		{
+			return raw.pending();
+		}
+
+	private:
+		PartialRaw<int> raw;
+	};
+
+	//the body is appended to out as it arrives, never sized from the wire
+	template<>
+	class PartialValue<std::string>
+	{
+	public:
+		PartialValue() : has_len(false), len(0)
+		{}
+
+		bool feed(PushCursor &c, std::string &out)
+		{
+			if (!has_len)
+			{
+				if (!head.feed(c, len))
+				{
+					return false;
+				}
+				has_len = true;
+				out.clear();
+			}
+			size_t k = len - out.size();
+			k = k < c.avail() ? k : c.avail();
+			out.append(c.p, k);
+			c.p += k;
+			if (out.size() < len)
+			{
+				return false;
+			}
+			has_len = false;
+			return true;
+		}
+
+		size_t pending() const
+		{
+			return head.pending();
+		}
+
+	private:
+		PartialLen head;
+		bool has_len;
+		size_t len;
+	};
+
+	//list, set and vector of anything but raw types: count, then the elements
+	//appended to out one by one
+	template<typename Container, typename BasicType>
+	class PartialItems
+	{
+	public:
+		PartialItems() : has_len(false), remaining(0)
+		{}
+
+		bool feed(PushCursor &c, Container &out)
+		{
+			if (!has_len)
+			{
+				if (!head.feed(c, remaining))
+				{
+					return false;
+				}
+				has_len = true;
+			}
+			while (remaining > 0)
+			{
+				if (!elem.feed(c, item))
+				{
+					return false;
+				}
+				out.insert(out.end(), item);
+				item = BasicType();
+				--remaining;
+			}
+			has_len = false;
+			return true;
+		}
+
+		size_t pending() const
+		{
+			return head.pending() + elem.pending();
+		}
+
+	private:
+		PartialLen head;
+		PartialValue<BasicType> elem;
+		BasicType item;
+		bool has_len;
+		size_t remaining;
+	};
+
+	//vector of char/int/float/double: bytes are copied straight into out,
+	//which grows with the bytes that have arrived rather than the count
+	template<typename BasicType>
+	class PartialRawVector
+	{
+	public:
+		PartialRawVector() : has_len(false), base(0), total(0), got(0)
+		{}
+
+		bool feed(PushCursor &c, std::vector<BasicType> &out)
+		{
+			if (!has_len)
+			{
+				size_t len = 0;
+				if (!head.feed(c, len))
+				{
+					return false;
+				}
+				has_len = true;
+				base = out.size();
+				total = len * sizeof(BasicType);
+				got = 0;
+			}
+			size_t k = total - got;
+			k = k < c.avail() ? k : c.avail();
+			if (k > 0)
+			{
+				size_t need = base + (got + k + sizeof(BasicType) - 1) / sizeof(BasicType);
+				if (out.size() < need)
+				{
+					out.resize(need);
+				}
+				memcpy((char*)&out[base] + got, c.p, k);
+				c.p += k;
+				got += k;
+			}
+			if (got < total)
+			{
+				return false;
+			}
+			has_len = false;
+			return true;
+		}
+
+		size_t pending() const
+		{
+			return head.pending();
+		}
+
+	private:
+		PartialLen head;
+		bool has_len;
+		size_t base;
+		size_t total;
+		size_t got;
+	};
+
+	template<typename BasicType, bool Raw = is_raw<BasicType>::value>
+	class PartialVector : public PartialItems<std::vector<BasicType>, BasicType> {};
+
+	template<typename BasicType>
+	class PartialVector<BasicType, true> : public PartialRawVector<BasicType> {};
+
+	template<typename BasicType>
+	class PartialValue<std::vector<BasicType> > : public PartialVector<BasicType> {};
+
+	template<typename BasicType>
+	class PartialValue<std::list<BasicType> > : public PartialItems<std::list<BasicType>, BasicType> {};
+
+	template<typename BasicType>
+	class PartialValue<std::set<BasicType> > : public PartialItems<std::set<BasicType>, BasicType> {};
+
+	template<typename BasicTypeA, typename BasicTypeB>
+	class PartialValue<std::pair<BasicTypeA, BasicTypeB> >
+	{
+	public:
+		PartialValue() : has_first(false)
+		{}
+
+		bool feed(PushCursor &c, std::pair<BasicTypeA, BasicTypeB> &out)
+		{
+			if (!has_first)
+			{
+				if (!first.feed(c, out.first))
+				{
+					return false;
+				}
+				has_first = true;
+			}
+			if (!second.feed(c, out.second))
+			{
+				return false;
+			}
+			has_first = false;
+			return true;
+		}
+
+		size_t pending() const
+		{
+			return first.pending() + second.pending();
+		}
+
+	private:
+		PartialValue<BasicTypeA> first;
+		PartialValue<BasicTypeB> second;
+		bool has_first;
+	};
+
+	//map: all keys, then the value count, then the values
+	template<typename BasicTypeA, typename BasicTypeB>
+	class PartialValue<std::map<BasicTypeA, BasicTypeB> >
+	{
+	public:
+		PartialValue() : has_keys(false), has_len(false), next(0)
+		{}
+
+		bool feed(PushCursor &c, std::map<BasicTypeA, BasicTypeB> &out)
+		{
+			if (!has_keys)
+			{
+				if (!key_in.feed(c, keys))
+				{
+					return false;
+				}
+				has_keys = true;
+			}
+			if (!has_len)
+			{
+				size_t len = 0;
+				if (!head.feed(c, len))
+				{
+					return false;
+				}
+				if (len != keys.size())
+				{
+					c.bad = true;
+					return false;
+				}
+				has_len = true;
+				next = 0;
+			}
+			while (next < keys.size())
+			{
+				if (!val_in.feed(c, val))
+				{
+					return false;
+				}
+				typename std::map<BasicTypeA, BasicTypeB>::iterator it = out.insert(out.end(), std::make_pair(keys[next], BasicTypeB()));
+				std::swap(it->second, val);
+				val = BasicTypeB();
+				++next;
+			}
+			keys.clear();
+			has_keys = has_len = false;
+			return true;
+		}
+
+		size_t pending() const
+		{
+			return key_in.pending() + head.pending() + val_in.pending();
+		}
+
+	private:
+		PartialValue<std::vector<BasicTypeA> > key_in;
+		PartialLen head;
+		PartialValue<BasicTypeB> val_in;
+		std::vector<BasicTypeA> keys;
+		BasicTypeB val;
+		bool has_keys;
+		bool has_len;
+		size_t next;
+	};
+
+
+	//input side of the incremental decoders: the chunk being pushed and
+	//whether the input has turned out to be malformed
+	//once it has, push() ignores further chunks instead of holding them
+	class PushInput
+	{
+	public:
+		PushInput()
+		{
+			in.p = in.end = NULL;
+			in.bad = false;
+		}
+
+		//malformed input, e.g. a negative length
+		bool error() const
+		{
+			return in.bad;
+		}
+
+	protected:
+		//false if the chunk is to be ignored
+		bool begin(const char *p, size_t n)
+		{
+			in.p = p;
+			in.end = p + n;
+			return !in.bad;
+		}
+
+		void end()
+		{
+			in.p = in.end = NULL;
+		}
+
+		PushCursor in;
+	};
+
+
+	//push-style decoder: feed bytes as they arrive with push(), which returns
+	//true once the whole value has been decoded and handed to the callback
+	//user types should override deserialize_from so a truncated object is
+	//detected; the default path cannot tell
+	template<typename T>
+	class IncrementalDecoder : public PushInput
+	{
+	public:
+		typedef std::function<void(T&)> Callback;
+
+		explicit IncrementalDecoder(const Callback &cb) : cb(cb), value(), finished(false)
+		{}
+
+		bool push(const char *p, size_t n)
+		{
+			if (!finished && begin(p, n) && reader.feed(in, value))
+			{
+				finished = true;
+				cb(value);
+			}
+			end();
+			return finished;
+		}
+
+		bool done() const
+		{
+			return finished;
+		}
+
+		//input bytes held back for a value that has not arrived completely
+		size_t pending() const
+		{
+			return finished ? 0 : reader.pending();
+		}
+
+	private:
+		Callback cb;
+		PartialValue<T> reader;
+		T value;
+		bool finished;
+	};
+
+
+	//element-wise decoding shared by vector, list and set:
+	//each element goes to the callback as soon as its bytes are complete
+	template<typename BasicType>
+	class ElementDecoder : public PushInput
+	{
+	public:
+		typedef std::function<void(BasicType&)> Callback;
+
+		explicit ElementDecoder(const Callback &cb) : cb(cb), item(), has_len(false), remaining(0)
+		{}
+
+		bool push(const char *p, size_t n)
+		{
+			if (!done() && begin(p, n))
+			{
+				if (!has_len)
+				{
+					has_len = head.feed(in, remaining);
+				}
+				while (has_len && remaining > 0 && elem.feed(in, item))
+				{
+					--remaining;
+					cb(item);
+					item = BasicType();
+				}
+			}
+			end();
+			return done();
+		}
+
+		bool done() const
+		{
+			return has_len && remaining == 0;
+		}
+
+		//elements still to come, once the length is known
+		size_t left() const
+		{
+			return remaining;
+		}
+
+		//input bytes held back for an element that has not arrived completely
+		size_t pending() const
+		{
+			return head.pending() + elem.pending();
+		}
+
+	private:
+		Callback cb;
+		PartialLen head;
+		PartialValue<BasicType> elem;
+		BasicType item;
+		bool has_len;
+		size_t remaining;
+	};
+
+	template<typename BasicType>
+	class IncrementalDecoder<std::vector<BasicType> > : public ElementDecoder<BasicType>
+	{
+	public:
+		explicit IncrementalDecoder(const typename ElementDecoder<BasicType>::Callback &cb) : ElementDecoder<BasicType>(cb)
+		{}
+	};
+
+	template<typename BasicType>
+	class IncrementalDecoder<std::list<BasicType> > : public ElementDecoder<BasicType>
+	{
+	public:
+		explicit IncrementalDecoder(const typename ElementDecoder<BasicType>::Callback &cb) : ElementDecoder<BasicType>(cb)
+		{}
+	};
+
+	template<typename BasicType>
+	class IncrementalDecoder<std::set<BasicType> > : public ElementDecoder<BasicType>
+	{
+	public:
+		explicit IncrementalDecoder(const typename ElementDecoder<BasicType>::Callback &cb) : ElementDecoder<BasicType>(cb)
+		{}
+	};
+
+	//map: the keys come first in the format, so they are held until their
+	//values arrive; each (key, value) goes to the callback as its value completes
+	//the key vector grows with the keys that have arrived, not the count
+	template<typename BasicTypeA, typename BasicTypeB>
+	class IncrementalDecoder<std::map<BasicTypeA, BasicTypeB> > : public PushInput
+	{
+	public:
+		typedef std::function<void(const BasicTypeA&, BasicTypeB&)> Callback;
+
+		explicit IncrementalDecoder(const Callback &cb) : cb(cb), val(), state(Keys), next(0)
+		{}
+
+		bool push(const char *p, size_t n)
+		{
+			if (state != Done && begin(p, n))
+			{
+				step();
+			}
+			end();
+			return state == Done;
+		}
+
+		bool done() const
+		{
+			return state == Done;
+		}
+
+		//input bytes held back for a key or value that has not arrived completely
+		size_t pending() const
+		{
+			return key_in.pending() + head.pending() + val_in.pending();
+		}
+
+	private:
+		enum State { Keys, ValLen, Vals, Done };
+
+		void step()
+		{
+			if (state == Keys)
+			{
+				if (!key_in.feed(in, keys))
+					return;
+				state = ValLen;
+			}
+			if (state == ValLen)
+			{
+				size_t len = 0;
+				if (!head.feed(in, len))
+					return;
+				if (len != keys.size())
+				{
+					in.bad = true;
+					return;
+				}
+				state = len ? Vals : Done;
+			}
+			while (state == Vals && val_in.feed(in, val))
+			{
+				cb(keys[next++], val);
+				val = BasicTypeB();
+				state = next < keys.size() ? Vals : Done;
+			}
+		}
+
+		Callback cb;
+		PartialValue<std::vector<BasicTypeA> > key_in;
+		PartialLen head;
+		PartialValue<BasicTypeB> val_in;
+		std::vector<BasicTypeA> keys;
+		BasicTypeB val;
+		State state;
+		size_t next;
+	};
+
+
+	//serialize to a binary file
+	template<typename SerializableType>
+	void serialize_to_binaryfile(SerializableType& a, std::string filename) {
+		GatherOutStream oe;
+		oe << a;
+		oe << '\0'; //the file format has always ended with a NUL
+		int fd = file_open_write(filename);
+		if (fd < 0) {
+			std::cout << "File open error!\n";
+			return;
+		}
+		oe.write_to(fd);
+		file_close(fd);
+	}
+
+	//serialize to a file followed by a checksum trailer, computed while
+	//writing; sum, if given, receives it
+	template<typename SerializableType>
+	bool serialize_to_checked_file(SerializableType& a, std::string filename, ChecksumTrailer *sum = NULL) {
+		CheckedFileOutStream oe(filename);
+		if (!oe.good()) {
+			std::cout << "File open error!\n";
+			return false;
+		}
+		oe << a;
+		ChecksumTrailer t = oe.finish();
+		if (sum) {
+			*sum = t;
+		}
+		return oe.close();
+	}
+
+	//deserialize a file written by serialize_to_checked_file; false if the
+	//checksum does not match
+	template<typename SerializableType>
+	bool deserialize_from_checked_file(SerializableType& a, std::string filename) {
+		MappedFile file(filename);
+		if (!file.is_open()) {
+			std::cout << "File open error!\n";
+			return false;
+		}
+		CheckedInStream ie(file.data(), file.size());
+		ie >> a;
+		return ie.verify();
 	}
 
 	//deserialize from a binary file
@@ -0,0 +1,172 @@
+#pragma once
+#include <thread>     //std::thread
+#include <chrono>
+#include <memory>     //std::unique_ptr
+#ifndef _WIN32
+#include <sys/wait.h> //waitpid
+#endif
+#include "Serialization.h"
+
+namespace BS {
+
+	////////////////////////////////////////////
+	//Point-in-time snapshots written in the background
+	//start() forks; the child serializes its copy-on-write view of memory
+	//into <file>.tmp, syncs it and renames it over <file>, while the parent
+	//goes on mutating. Only the fork itself stalls the caller.
+	//The child runs with just the forking thread: the writer must not take
+	//locks that other threads may hold (the output buffer is set up before
+	//the fork, so BS streams themselves are safe).
+	//Without fork (Windows) the snapshot is written before start() returns.
+	///////////////////////////////////////////
+	enum SnapshotStatus
+	{
+		SNAPSHOT_IDLE,
+		SNAPSHOT_RUNNING,
+		SNAPSHOT_DONE,
+		SNAPSHOT_FAILED
+	};
+
+	class BackgroundSnapshot
+	{
+	public:
+		typedef std::function<void(FileOutStream&)> Writer;
+		typedef std::function<void(bool)> Callback;
+
+		BackgroundSnapshot() : st(SNAPSHOT_IDLE), pause_us(0)
+		{}
+
+		~BackgroundSnapshot()
+		{
+			wait();
+		}
+
+		//write(out) fills the snapshot; done(ok) is called from a watcher thread
+		//once the file is in place. Returns false if a snapshot is still
+		//running or the file cannot be created
+		bool start(const std::string &filename, Writer write, Callback done = Callback())
+		{
+			if (status() == SNAPSHOT_RUNNING)
+			{
+				return false;
+			}
+			if (watcher.joinable())
+			{
+				watcher.join();
+			}
+
+			std::string tmp = filename + ".tmp";
+			std::unique_ptr<FileOutStream> out(new FileOutStream(tmp));
+			if (!out->good())
+			{
+				st = SNAPSHOT_FAILED;
+				return false;
+			}
+			st = SNAPSHOT_RUNNING;
+
+#ifdef _WIN32
+			bool ok = write_file(*out, write, tmp, filename);
+			pause_us = 0;
+			st = ok ? SNAPSHOT_DONE : SNAPSHOT_FAILED;
+			if (done)
+			{
+				done(ok);
+			}
+			return true;
+#else
+			std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+			pid_t pid = fork();
+			pause_us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+			if (pid == 0)
+			{
+				//child: no destructors, no atexit handlers of the parent
+				bool ok = false;
+				try
+				{
+					ok = write_file(*out, write, tmp, filename);
+				}
+				catch (...)
+				{
+				}
+				_exit(ok ? 0 : 1);
+			}
+			out.reset(); //the parent's copy of the buffer is empty: this only closes the descriptor
+			if (pid < 0)
+			{
+				std::remove(tmp.c_str());
+				st = SNAPSHOT_FAILED;
+				return false;
+			}
+
+			watcher = std::thread([this, pid, done]() {
+				int code = 0;
+				while (waitpid(pid, &code, 0) < 0 && errno == EINTR)
+				{
+				}
+				bool ok = WIFEXITED(code) && WEXITSTATUS(code) == 0;
+				st = ok ? SNAPSHOT_DONE : SNAPSHOT_FAILED;
+				if (done)
+				{
+					done(ok);
+				}
+			});
+			return true;
+#endif
+		}
+
+		SnapshotStatus status() const
+		{
+			return (SnapshotStatus)st.load();
+		}
+
+		bool running() const
+		{
+			return status() == SNAPSHOT_RUNNING;
+		}
+
+		//block until the running snapshot ends; true if it was written
+		bool wait()
+		{
+			if (watcher.joinable())
+			{
+				watcher.join();
+			}
+			return status() == SNAPSHOT_DONE;
+		}
+
+		//how long start() stalled the caller, in microseconds
+		uint64_t pause_micros() const
+		{
+			return pause_us;
+		}
+
+	private:
+		BackgroundSnapshot(const BackgroundSnapshot&);
+		BackgroundSnapshot& operator=(const BackgroundSnapshot&);
+
+		static bool write_file(FileOutStream &out, Writer &write, const std::string &tmp, const std::string &filename)
+		{
+			write(out);
+			bool ok = out.good() && out.sync();
+			ok = out.close() && ok;
+			return ok && file_replace(tmp, filename);
+		}
+
+		std::atomic<int> st;
+		uint64_t pause_us;
+		std::thread watcher;
+	};
+
+
+	//snapshot one object in the serialize_to_binaryfile format
+	template<typename SerializableType>
+	bool snapshot_to_binaryfile(BackgroundSnapshot &snap, SerializableType& a, const std::string &filename, BackgroundSnapshot::Callback done = BackgroundSnapshot::Callback())
+	{
+		SerializableType *p = &a;
+		return snap.start(filename, [p](FileOutStream &out) {
+			out << *p;
+			out << '\0';
+		}, done);
+	}
+
+}//namespace BS
@@ -0,0 +1,412 @@
+#pragma once
+#include "Serialization.h"
+
+namespace BS {
+
+	////////////////////////////////////////////
+	//Sorted table: a std::map persisted for point and range lookups
+	//file:   magic, data blocks, index, bloom filter, footer
+	//block:  entry count (int), then per entry: key, value size (int), value
+	//index:  per block (block offset, offset of its first key among the
+	//        keys that follow) as uint64, then the first keys themselves
+	//footer: SortedTableFooter, ending with the magic again
+	//Lookups binary search the index in the mapping and decode one block
+	///////////////////////////////////////////
+	static const char SORTED_TABLE_MAGIC[8] = { 'B', 'S', 'S', 'T', 'A', 'B', '0', '1' };
+
+	struct SortedTableFooter
+	{
+		uint64_t index_off;
+		uint64_t blocks;
+		uint64_t bloom_off;
+		uint64_t bloom_bits;
+		uint64_t bloom_hashes;
+		uint64_t entries;
+		char magic[8];
+	};
+
+	//bit positions of a key in the bloom filter, by double hashing
+	inline uint64_t bloom_bit(uint64_t h, uint64_t i, uint64_t bits)
+	{
+		uint64_t h2 = (h >> 33) | (h << 31) | 1;
+		return (h + i * h2) % bits;
+	}
+
+
+	//writes entries in ascending key order into a sorted table file
+	template<typename BasicTypeA, typename BasicTypeB>
+	class SortedTableWriter
+	{
+	public:
+		//bits_per_key = 0 leaves the bloom filter out
+		SortedTableWriter(const std::string &filename, size_t block_bytes = 4096, int bits_per_key = 10)
+			: fd(file_open_write(filename)), block_size(block_bytes), bloom_per_key(bits_per_key), off(0), in_block(0), entries(0), ok(true)
+		{
+			if (fd < 0)
+			{
+				ok = false;
+				return;
+			}
+			write(SORTED_TABLE_MAGIC, sizeof(SORTED_TABLE_MAGIC));
+		}
+
+		~SortedTableWriter()
+		{
+			finish();
+		}
+
+		bool is_open() const
+		{
+			return fd >= 0;
+		}
+
+		//keys must come in ascending order, as std::map iterates them
+		void add(const BasicTypeA &key, const BasicTypeB &value)
+		{
+			if (fd < 0)
+			{
+				return;
+			}
+			if (in_block == 0)
+			{
+				uint64_t entry[2] = { off, first_keys.size() };
+				index.append((const char*)entry, sizeof(entry));
+				encode(key);
+				first_keys.append(scratch.data(), scratch.size());
+			}
+
+			encode(key);
+			block.append(scratch.data(), scratch.size());
+			encode(value);
+			int vlen = (int)scratch.size();
+			block.append((const char*)&vlen, sizeof(vlen));
+			block.append(scratch.data(), scratch.size());
+			++in_block;
+			++entries;
+			if (bloom_per_key > 0)
+			{
+				hashes.push_back(key_hash(key));
+			}
+
+			if (block.size() >= block_size)
+			{
+				flush_block();
+			}
+		}
+
+		//write the index, filter and footer; returns false if any write failed
+		bool finish()
+		{
+			if (fd < 0)
+			{
+				return ok;
+			}
+			flush_block();
+
+			SortedTableFooter f;
+			f.blocks = index.size() / (2 * sizeof(uint64_t));
+			f.index_off = off;
+			write(index.data(), index.size());
+			write(first_keys.data(), first_keys.size());
+
+			f.bloom_off = off;
+			f.bloom_bits = 0;
+			f.bloom_hashes = 0;
+			if (bloom_per_key > 0 && !hashes.empty())
+			{
+				f.bloom_bits = hashes.size() * bloom_per_key;
+				f.bloom_hashes = (uint64_t)(bloom_per_key * 0.69 + 0.5);
+				f.bloom_hashes = f.bloom_hashes < 1 ? 1 : (f.bloom_hashes > 30 ? 30 : f.bloom_hashes);
+				std::vector<char> bits((size_t)(f.bloom_bits + 7) / 8, 0);
+				for (size_t i = 0; i < hashes.size(); ++i)
+				{
+					for (uint64_t k = 0; k < f.bloom_hashes; ++k)
+					{
+						uint64_t b = bloom_bit(hashes[i], k, f.bloom_bits);
+						bits[(size_t)(b / 8)] |= (char)(1 << (b % 8));
+					}
+				}
+				write(&bits[0], bits.size());
+			}
+			f.entries = entries;
+			memcpy(f.magic, SORTED_TABLE_MAGIC, sizeof(f.magic));
+			write((const char*)&f, sizeof(f));
+
+			ok = ok && file_sync(fd);
+			file_close(fd);
+			fd = -1;
+			return ok;
+		}
+
+	private:
+		SortedTableWriter(const SortedTableWriter&);
+		SortedTableWriter& operator=(const SortedTableWriter&);
+
+		template<typename T>
+		void encode(const T &a)
+		{
+			scratch.clear();
+			scratch << a;
+		}
+
+		void flush_block()
+		{
+			if (in_block == 0)
+			{
+				return;
+			}
+			int count = (int)in_block;
+			write((const char*)&count, sizeof(count));
+			write(block.data(), block.size());
+			block.clear();
+			in_block = 0;
+		}
+
+		void write(const char *p, size_t n)
+		{
+			ok = write_all(fd, p, n) && ok;
+			off += n;
+		}
+
+		int fd;
+		size_t block_size;
+		int bloom_per_key;
+		uint64_t off;
+		size_t in_block;
+		uint64_t entries;
+		bool ok;
+		std::string block;
+		SmallOutStream<256> scratch;
+		std::string index;
+		std::string first_keys;
+		std::vector<uint64_t> hashes;
+	};
+
+
+	//persist a whole map as a sorted table
+	template<typename BasicTypeA, typename BasicTypeB>
+	bool write_sorted_table(const std::map<BasicTypeA, BasicTypeB> &a, const std::string &filename, size_t block_bytes = 4096, int bits_per_key = 10)
+	{
+		SortedTableWriter<BasicTypeA, BasicTypeB> w(filename, block_bytes, bits_per_key);
+		typename std::map<BasicTypeA, BasicTypeB>::const_iterator it;
+		for (it = a.begin(); it != a.end(); ++it)
+		{
+			w.add(it->first, it->second);
+		}
+		return w.finish();
+	}
+
+
+	//point and range lookups on a mapped sorted table
+	template<typename BasicTypeA, typename BasicTypeB>
+	class SortedTable
+	{
+	public:
+		explicit SortedTable(const std::string &filename) : file(filename), ok(false)
+		{
+			if (!file.is_open() || file.size() < sizeof(SORTED_TABLE_MAGIC) + sizeof(SortedTableFooter))
+			{
+				return;
+			}
+			memcpy(&footer, file.data() + file.size() - sizeof(footer), sizeof(footer));
+			ok = memcmp(file.data(), SORTED_TABLE_MAGIC, sizeof(SORTED_TABLE_MAGIC)) == 0
+				&& memcmp(footer.magic, SORTED_TABLE_MAGIC, sizeof(SORTED_TABLE_MAGIC)) == 0
+				&& footer.index_off + footer.blocks * 2 * sizeof(uint64_t) <= footer.bloom_off
+				&& footer.bloom_off + (footer.bloom_bits + 7) / 8 + sizeof(footer) <= file.size();
+		}
+
+		bool is_open() const
+		{
+			return ok;
+		}
+
+		size_t size() const
+		{
+			return ok ? (size_t)footer.entries : 0;
+		}
+
+		//false if key is not in the table
+		bool get(const BasicTypeA &key, BasicTypeB &value) const
+		{
+			if (!ok || !may_contain(key))
+			{
+				return false;
+			}
+			size_t b = find_block(key);
+			if (b == footer.blocks)
+			{
+				return false;
+			}
+
+			BlockCursor c(*this, b);
+			BasicTypeA k;
+			while (c.next_key(k))
+			{
+				if (k < key)
+				{
+					c.skip_value();
+				}
+				else if (key < k)
+				{
+					return false;
+				}
+				else
+				{
+					return c.read_value(value);
+				}
+			}
+			return false;
+		}
+
+		//visit entries with lo <= key < hi in order: fn(const BasicTypeA&, BasicTypeB&)
+		//returns the number of entries visited
+		template<typename Visitor>
+		size_t range(const BasicTypeA &lo, const BasicTypeA &hi, Visitor fn) const
+		{
+			if (!ok || !(lo < hi))
+			{
+				return 0;
+			}
+			size_t b = find_block(lo);
+			b = b == footer.blocks ? 0 : b;
+			size_t count = 0;
+			BasicTypeA k;
+			BasicTypeB v;
+			for (; b < footer.blocks; ++b)
+			{
+				BlockCursor c(*this, b);
+				while (c.next_key(k))
+				{
+					if (!(k < hi))
+					{
+						return count;
+					}
+					if (k < lo)
+					{
+						c.skip_value();
+						continue;
+					}
+					v = BasicTypeB();
+					if (!c.read_value(v))
+					{
+						return count;
+					}
+					fn(k, v);
+					++count;
+				}
+			}
+			return count;
+		}
+
+		//bloom filter test: false means key is certainly absent
+		bool may_contain(const BasicTypeA &key) const
+		{
+			if (footer.bloom_bits == 0)
+			{
+				return true;
+			}
+			uint64_t h = key_hash(key);
+			const char *bits = file.data() + footer.bloom_off;
+			for (uint64_t k = 0; k < footer.bloom_hashes; ++k)
+			{
+				uint64_t b = bloom_bit(h, k, footer.bloom_bits);
+				if (!(bits[(size_t)(b / 8)] & (1 << (b % 8))))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+	private:
+		//reads the entries of one block in place
+		class BlockCursor
+		{
+		public:
+			BlockCursor(const SortedTable &t, size_t b) : ie(t.block_data(b), t.block_end(b) - t.block_data(b)), left(0)
+			{
+				int n = 0;
+				ie >> n;
+				left = n > 0 ? n : 0;
+			}
+
+			bool next_key(BasicTypeA &k)
+			{
+				if (left == 0)
+				{
+					return false;
+				}
+				--left;
+				k = BasicTypeA();
+				ie >> k >> vlen;
+				return ie.good() && vlen >= 0;
+			}
+
+			void skip_value()
+			{
+				ie.skip(vlen);
+			}
+
+			bool read_value(BasicTypeB &v)
+			{
+				ie >> v;
+				return ie.good();
+			}
+
+		private:
+			InStream ie;
+			size_t left;
+			int vlen;
+		};
+
+		uint64_t index_entry(size_t b, int field) const
+		{
+			uint64_t x;
+			memcpy(&x, file.data() + footer.index_off + (b * 2 + field) * sizeof(uint64_t), sizeof(x));
+			return x;
+		}
+
+		const char* block_data(size_t b) const
+		{
+			return file.data() + index_entry(b, 0);
+		}
+
+		const char* block_end(size_t b) const
+		{
+			return file.data() + (b + 1 < footer.blocks ? index_entry(b + 1, 0) : footer.index_off);
+		}
+
+		BasicTypeA first_key(size_t b) const
+		{
+			const char *keys = file.data() + footer.index_off + footer.blocks * 2 * sizeof(uint64_t);
+			InStream ie(keys + index_entry(b, 1), file.data() + footer.bloom_off - keys - index_entry(b, 1));
+			BasicTypeA k = BasicTypeA();
+			ie >> k;
+			return k;
+		}
+
+		//last block whose first key is <= key, or blocks if key precedes them all
+		size_t find_block(const BasicTypeA &key) const
+		{
+			size_t lo = 0, hi = (size_t)footer.blocks;
+			while (lo < hi)
+			{
+				size_t mid = lo + (hi - lo) / 2;
+				if (key < first_key(mid))
+				{
+					hi = mid;
+				}
+				else
+				{
+					lo = mid + 1;
+				}
+			}
+			return lo == 0 ? (size_t)footer.blocks : lo - 1;
+		}
+
+		MappedFile file;
+		SortedTableFooter footer;
+		bool ok;
+	};
+
+}//namespace BS
@@ -10,13 +10,809 @@
 #include <fstream>  //std::fstream
 #include <iostream>
 #include <string> //std::string
+#include <memory> //std::unique_ptr
 #include <cstdlib>
 #include <assert.h> //assert
+#include <stdio.h>  //FILE
+#include <algorithm> //std::reverse
+#if defined(_M_X64) || defined(__x86_64__)
+#define XML_SERI_SSSE3
+#include <tmmintrin.h> //SSSE3
+#ifdef _MSC_VER
+#include <intrin.h>   //__cpuid
+#endif
+#endif
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h> //CreateFileMapping
+#else
+#include <fcntl.h>    //open
+#include <unistd.h>   //close
+#include <sys/stat.h> //fstat
+#include <sys/mman.h> //mmap
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
 #include "tinyxml2.h"
 
 namespace XML_Seri {
 
 	using namespace tinyxml2;
+
+	////////////////////////////////////////////
+	//Pull parser: walks XML text and yields one event at a time
+	//START_ELEMENT (name, attributes), TEXT (entities decoded), END_ELEMENT
+	//A file is read in blocks, so memory grows with the longest token and
+	//the nesting depth, not with the document. Declarations, comments and
+	//DOCTYPEs are skipped, CDATA is text, whitespace-only text is dropped
+	///////////////////////////////////////////
+	class XMLPullReader {
+	public:
+		enum Event { START_ELEMENT, TEXT, END_ELEMENT, END_DOCUMENT, PARSE_ERROR };
+
+		explicit XMLPullReader(const std::string &file_name, size_t buffer_bytes = 64 * 1024)
+			: data(NULL), pos(0), end(0), fp(NULL), ev(END_DOCUMENT), pending_end(false), failed(false) {
+#ifdef _MSC_VER
+			fopen_s(&fp, file_name.c_str(), "rb");
+#else
+			fp = fopen(file_name.c_str(), "rb");
+#endif
+			store.resize(buffer_bytes < 16 ? 16 : buffer_bytes);
+			data = &store[0];
+		}
+
+		//parse the text in [first, last), which must outlive the reader
+		XMLPullReader(const char *first, const char *last)
+			: data(first), pos(0), end(last - first), fp(NULL), ev(END_DOCUMENT), pending_end(false), failed(false) {
+		}
+
+		~XMLPullReader() {
+			if (fp) {
+				fclose(fp);
+			}
+		}
+
+		bool is_open() const { return fp != NULL || store.empty(); } //text in memory is always open
+		bool good() const { return !failed; }
+		Event event() const { return ev; }
+		size_t depth() const { return open.size(); }
+
+		//element name of the last START_ELEMENT or END_ELEMENT
+		const std::string& name() const { return tag; }
+		//content of the last TEXT
+		const std::string& text() const { return content; }
+
+		//attribute of the last START_ELEMENT, or NULL
+		const char* attribute(const char *attr) const {
+			for (size_t i = 0; i < attrs.size(); ++i) {
+				if (attrs[i].first == attr) {
+					return attrs[i].second.c_str();
+				}
+			}
+			return NULL;
+		}
+
+		Event next() {
+			if (failed) {
+				return ev = PARSE_ERROR;
+			}
+			if (pending_end) { //<name/>
+				pending_end = false;
+				open.pop_back();
+				return ev = END_ELEMENT;
+			}
+			for (;;) {
+				if (pos == end && !refill()) {
+					if (!open.empty()) {
+						return fail();
+					}
+					return ev = END_DOCUMENT;
+				}
+				if (data[pos] != '<') {
+					size_t k = find("<");
+					size_t n = k == npos ? end - pos : k;
+					bool blank = true;
+					for (size_t i = 0; i < n && blank; ++i) {
+						blank = XMLUtil::IsWhiteSpace(data[pos + i]);
+					}
+					if (!blank) {
+						decode(data + pos, n, content);
+					}
+					pos += n;
+					if (!blank && !open.empty()) {
+						return ev = TEXT;
+					}
+					continue;
+				}
+
+				if (!available(2)) {
+					return fail();
+				}
+				char c = data[pos + 1];
+				if (c == '/') {
+					size_t k = find(">");
+					if (k == npos) {
+						return fail();
+					}
+					tag.assign(data + pos + 2, k - 2);
+					trim(tag);
+					pos += k + 1;
+					if (open.empty() || open.back() != tag) {
+						return fail();
+					}
+					open.pop_back();
+					return ev = END_ELEMENT;
+				}
+				if (c == '?') {
+					if (!skip_past("?>")) {
+						return fail();
+					}
+					continue;
+				}
+				if (c == '!') {
+					if (available(9) && memcmp(data + pos, "<![CDATA[", 9) == 0) {
+						size_t k = find("]]>");
+						if (k == npos) {
+							return fail();
+						}
+						content.assign(data + pos + 9, k - 9);
+						pos += k + 3;
+						return ev = TEXT;
+					}
+					bool comment = available(4) && memcmp(data + pos, "<!--", 4) == 0;
+					if (!skip_past(comment ? "-->" : ">")) {
+						return fail();
+					}
+					continue;
+				}
+				return start_tag();
+			}
+		}
+
+		//move to the next child element of the current one: true on its
+		//START_ELEMENT, false once the current element has ended
+		bool next_element() {
+			for (;;) {
+				switch (next()) {
+				case START_ELEMENT:
+					return true;
+				case TEXT:
+					break;
+				default:
+					return false;
+				}
+			}
+		}
+
+		//after START_ELEMENT: skip everything up to and including its end
+		void skip_element() {
+			size_t d = open.size();
+			while (open.size() >= d && next() != PARSE_ERROR && ev != END_DOCUMENT) {
+			}
+		}
+
+		//after START_ELEMENT: skip the remaining children and the end tag
+		void finish_element() {
+			while (next_element()) {
+				skip_element();
+			}
+		}
+
+		//after START_ELEMENT: its text, up to and including its end tag
+		//(text inside child elements is skipped)
+		std::string read_text() {
+			std::string ret;
+			for (;;) {
+				switch (next()) {
+				case TEXT:
+					ret += content;
+					break;
+				case START_ELEMENT:
+					skip_element();
+					break;
+				default:
+					return ret;
+				}
+			}
+		}
+
+		//after START_ELEMENT: the attribute attr if it has one, else its text;
+		//either way up to and including its end tag
+		std::string read_value(const char *attr) {
+			if (const char *v = attribute(attr)) {
+				std::string ret(v);
+				finish_element();
+				return ret;
+			}
+			return read_text();
+		}
+
+	private:
+		XMLPullReader(const XMLPullReader&);
+		XMLPullReader& operator=(const XMLPullReader&);
+
+		static const size_t npos = (size_t)-1;
+
+		Event fail() {
+			failed = true;
+			return ev = PARSE_ERROR;
+		}
+
+		//keep the unread bytes and read more after them; false at the end
+		bool refill() {
+			if (fp == NULL) {
+				return false;
+			}
+			if (pos > 0) {
+				memmove(&store[0], &store[0] + pos, end - pos);
+				end -= pos;
+				pos = 0;
+			}
+			if (end == store.size()) {
+				store.resize(store.size() * 2);
+			}
+			size_t n = fread(&store[0] + end, 1, store.size() - end, fp);
+			data = &store[0];
+			end += n;
+			return n > 0;
+		}
+
+		bool available(size_t n) {
+			while (end - pos < n) {
+				if (!refill()) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		//offset of delim from pos, or npos
+		size_t find(const char *delim) {
+			size_t n = strlen(delim), from = 0;
+			for (;;) {
+				while (pos + from + n <= end) {
+					const char *p = (const char*)memchr(data + pos + from, delim[0], end - pos - from - n + 1);
+					if (p == NULL) {
+						break;
+					}
+					if (memcmp(p, delim, n) == 0) {
+						return p - (data + pos);
+					}
+					from = p - (data + pos) + 1;
+				}
+				from = end - pos >= n ? end - pos - n + 1 : 0;
+				if (!refill()) {
+					return npos;
+				}
+			}
+		}
+
+		bool skip_past(const char *delim) {
+			size_t k = find(delim);
+			if (k == npos) {
+				return false;
+			}
+			pos += k + strlen(delim);
+			return true;
+		}
+
+		Event start_tag() {
+			//find the closing '>', which may also appear inside quoted values
+			size_t i = 1;
+			char quote = 0;
+			for (;;) {
+				for (; pos + i < end; ++i) {
+					char c = data[pos + i];
+					if (quote) {
+						quote = c == quote ? 0 : quote;
+					}
+					else if (c == '"' || c == '\'') {
+						quote = c;
+					}
+					else if (c == '>') {
+						break;
+					}
+				}
+				if (pos + i < end) {
+					break;
+				}
+				if (!refill()) {
+					return fail();
+				}
+			}
+
+			const char *p = data + pos + 1, *e = data + pos + i;
+			pos += i + 1;
+			pending_end = e > p && e[-1] == '/';
+			if (pending_end) {
+				--e;
+			}
+			const char *q = p;
+			while (q < e && !XMLUtil::IsWhiteSpace(*q)) {
+				++q;
+			}
+			tag.assign(p, q - p);
+			if (tag.empty()) {
+				return fail();
+			}
+
+			attrs.clear();
+			for (;;) {
+				while (q < e && XMLUtil::IsWhiteSpace(*q)) {
+					++q;
+				}
+				if (q == e) {
+					break;
+				}
+				const char *n = q;
+				while (q < e && *q != '=' && !XMLUtil::IsWhiteSpace(*q)) {
+					++q;
+				}
+				std::string attr(n, q - n);
+				while (q < e && XMLUtil::IsWhiteSpace(*q)) {
+					++q;
+				}
+				if (q == e || *q != '=') {
+					return fail();
+				}
+				++q;
+				while (q < e && XMLUtil::IsWhiteSpace(*q)) {
+					++q;
+				}
+				if (q == e || (*q != '"' && *q != '\'')) {
+					return fail();
+				}
+				char qc = *q++;
+				const char *v = q;
+				while (q < e && *q != qc) {
+					++q;
+				}
+				if (q == e) {
+					return fail();
+				}
+				attrs.push_back(std::make_pair(attr, std::string()));
+				decode(v, q - v, attrs.back().second);
+				++q;
+			}
+			open.push_back(tag);
+			return ev = START_ELEMENT;
+		}
+
+		static void trim(std::string &s) {
+			size_t b = 0, e = s.size();
+			while (b < e && XMLUtil::IsWhiteSpace(s[b])) {
+				++b;
+			}
+			while (e > b && XMLUtil::IsWhiteSpace(s[e - 1])) {
+				--e;
+			}
+			s = s.substr(b, e - b);
+		}
+
+		//copy p[0..n) into out, replacing the predefined and numeric entities
+		static void decode(const char *p, size_t n, std::string &out) {
+			out.clear();
+			const char *e = p + n;
+			while (p < e) {
+				const char *amp = (const char*)memchr(p, '&', e - p);
+				if (amp == NULL) {
+					out.append(p, e - p);
+					break;
+				}
+				out.append(p, amp - p);
+				p = amp;
+				const char *semi = (const char*)memchr(p, ';', e - p);
+				size_t len = semi ? semi - p + 1 : 0;
+				if (len == 5 && memcmp(p, "&amp;", 5) == 0) { out += '&'; }
+				else if (len == 4 && memcmp(p, "&lt;", 4) == 0) { out += '<'; }
+				else if (len == 4 && memcmp(p, "&gt;", 4) == 0) { out += '>'; }
+				else if (len == 6 && memcmp(p, "&quot;", 6) == 0) { out += '"'; }
+				else if (len == 6 && memcmp(p, "&apos;", 6) == 0) { out += '\''; }
+				else if (len > 3 && p[1] == '#') {
+					char utf8[10] = { 0 };
+					int length = 0;
+					std::string ref(p, len);
+					XMLUtil::GetCharacterRef(ref.c_str(), utf8, &length);
+					if (length == 0) {
+						out.append(p, len);
+					}
+					else {
+						out.append(utf8, length);
+					}
+				}
+				else {
+					out += '&';
+					len = 1;
+				}
+				p += len;
+			}
+		}
+
+		std::vector<char> store; //file input
+		const char *data;
+		size_t pos;
+		size_t end;
+		FILE *fp;
+
+		Event ev;
+		std::string tag;
+		std::string content;
+		std::vector<std::pair<std::string, std::string> > attrs;
+		std::vector<std::string> open; //names of the open elements
+		bool pending_end;
+		bool failed;
+	};
+
+
+	////////////////////////////////////////////
+	//Base64 (RFC 4648, '=' padded)
+	//With SSSE3, 12 bytes are encoded and 16 characters decoded per step,
+	//after W. Mula and D. Lemire, "Faster Base64 Encoding and Decoding using
+	//AVX2 Instructions"; the tail, padding and white space go a byte at a time
+	///////////////////////////////////////////
+	static const char BASE64_CHARS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	inline size_t base64_encode_scalar(const unsigned char *in, size_t n, char *out) {
+		char *o = out;
+		for (; n >= 3; in += 3, n -= 3) {
+			uint32_t v = (uint32_t)in[0] << 16 | (uint32_t)in[1] << 8 | in[2];
+			*o++ = BASE64_CHARS[v >> 18];
+			*o++ = BASE64_CHARS[(v >> 12) & 63];
+			*o++ = BASE64_CHARS[(v >> 6) & 63];
+			*o++ = BASE64_CHARS[v & 63];
+		}
+		if (n > 0) {
+			uint32_t v = (uint32_t)in[0] << 16 | (n > 1 ? (uint32_t)in[1] << 8 : 0);
+			*o++ = BASE64_CHARS[v >> 18];
+			*o++ = BASE64_CHARS[(v >> 12) & 63];
+			*o++ = n > 1 ? BASE64_CHARS[(v >> 6) & 63] : '=';
+			*o++ = '=';
+		}
+		return o - out;
+	}
+
+	//6-bit value of a base64 character, or -1
+	inline int base64_value(char c) {
+		if (c >= 'A' && c <= 'Z') return c - 'A';
+		if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+		if (c >= '0' && c <= '9') return c - '0' + 52;
+		if (c == '+') return 62;
+		if (c == '/') return 63;
+		return -1;
+	}
+
+	//decode [p, end) after the len bytes already in out, skipping white space
+	//and stopping at '='; false on a bad character or more than cap bytes
+	inline bool base64_decode_scalar(const char *p, const char *end, unsigned char *out, size_t cap, size_t &len) {
+		uint32_t acc = 0;
+		int bits = 0;
+		for (; p < end && *p != '='; ++p) {
+			if (XMLUtil::IsWhiteSpace(*p)) {
+				continue;
+			}
+			int v = base64_value(*p);
+			if (v < 0) {
+				return false;
+			}
+			acc = acc << 6 | (uint32_t)v;
+			bits += 6;
+			if (bits >= 8) {
+				bits -= 8;
+				if (len == cap) {
+					return false;
+				}
+				out[len++] = (unsigned char)(acc >> bits);
+			}
+		}
+		return true;
+	}
+
+#ifdef XML_SERI_SSSE3
+#ifndef _MSC_VER
+	__attribute__((target("ssse3")))
+#endif
+	inline size_t base64_encode_ssse3(const unsigned char *in, size_t n, char *out) {
+		const __m128i spread = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+		char *o = out;
+		for (; n >= 16; in += 12, n -= 12, o += 16) { //loads 16 bytes, uses 12
+			//each 3 bytes a,b,c as the 32 bits b,a,c,b: shift the four 6-bit fields into bytes
+			__m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)in), spread);
+			__m128i i02 = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+			__m128i i13 = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+			__m128i idx = _mm_or_si128(i02, i13);
+			//'A' + i, then +6 from 26 ('a'), -75 from 52 ('0'), -15 at 62 ('+'), +3 at 63 ('/')
+			__m128i off = _mm_set1_epi8('A');
+			off = _mm_add_epi8(off, _mm_and_si128(_mm_cmpgt_epi8(idx, _mm_set1_epi8(25)), _mm_set1_epi8(6)));
+			off = _mm_add_epi8(off, _mm_and_si128(_mm_cmpgt_epi8(idx, _mm_set1_epi8(51)), _mm_set1_epi8(-75)));
+			off = _mm_add_epi8(off, _mm_and_si128(_mm_cmpgt_epi8(idx, _mm_set1_epi8(61)), _mm_set1_epi8(-15)));
+			off = _mm_add_epi8(off, _mm_and_si128(_mm_cmpgt_epi8(idx, _mm_set1_epi8(62)), _mm_set1_epi8(3)));
+			_mm_storeu_si128((__m128i*)o, _mm_add_epi8(idx, off));
+		}
+		return (o - out) + base64_encode_scalar(in, n, o);
+	}
+
+#ifndef _MSC_VER
+	__attribute__((target("ssse3")))
+#endif
+	inline __m128i base64_range(__m128i c, char lo, char hi) {
+		return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(lo - 1)), _mm_cmpgt_epi8(_mm_set1_epi8(hi + 1), c));
+	}
+
+#ifndef _MSC_VER
+	__attribute__((target("ssse3")))
+#endif
+	inline bool base64_decode_ssse3(const char *p, const char *end, unsigned char *out, size_t cap, size_t &len) {
+		const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+		while (end - p >= 16 && cap - len >= 12) {
+			__m128i c = _mm_loadu_si128((const __m128i*)p);
+			__m128i upper = base64_range(c, 'A', 'Z');
+			__m128i lower = base64_range(c, 'a', 'z');
+			__m128i digit = base64_range(c, '0', '9');
+			__m128i plus = _mm_cmpeq_epi8(c, _mm_set1_epi8('+'));
+			__m128i slash = _mm_cmpeq_epi8(c, _mm_set1_epi8('/'));
+			__m128i valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, _mm_or_si128(plus, slash)));
+			if (_mm_movemask_epi8(valid) != 0xffff) {
+				break; //padding, white space or an error: the byte loop sorts it out
+			}
+			__m128i delta = _mm_or_si128(_mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-65)), _mm_and_si128(lower, _mm_set1_epi8(-71))),
+				_mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(4)), _mm_or_si128(_mm_and_si128(plus, _mm_set1_epi8(19)), _mm_and_si128(slash, _mm_set1_epi8(16)))));
+			__m128i v = _mm_add_epi8(c, delta);
+			//four 6-bit values to 24 bits, then the three bytes of each in order
+			v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+			v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+			v = _mm_shuffle_epi8(v, pack);
+			char tmp[16];
+			_mm_storeu_si128((__m128i*)tmp, v);
+			memcpy(out + len, tmp, 12);
+			len += 12;
+			p += 16;
+		}
+		return base64_decode_scalar(p, end, out, cap, len);
+	}
+
+	inline bool cpu_has_ssse3() {
+#ifdef _MSC_VER
+		int r[4];
+		__cpuid(r, 1);
+		return ((r[2] >> 9) & 1) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("ssse3") != 0;
+#endif
+	}
+#endif
+
+	inline std::string base64_encode(const void *data, size_t n) {
+		std::string out((n + 2) / 3 * 4, '\0');
+		if (n == 0) {
+			return out;
+		}
+#ifdef XML_SERI_SSSE3
+		static const bool simd = cpu_has_ssse3();
+		if (simd) {
+			base64_encode_ssse3((const unsigned char*)data, n, &out[0]);
+			return out;
+		}
+#endif
+		base64_encode_scalar((const unsigned char*)data, n, &out[0]);
+		return out;
+	}
+
+	//decode n characters into at most cap bytes; len is set to the bytes written
+	inline bool base64_decode(const char *p, size_t n, void *out, size_t cap, size_t &len) {
+		len = 0;
+#ifdef XML_SERI_SSSE3
+		static const bool simd = cpu_has_ssse3();
+		if (simd) {
+			return base64_decode_ssse3(p, p + n, (unsigned char*)out, cap, len);
+		}
+#endif
+		return base64_decode_scalar(p, p + n, (unsigned char*)out, cap, len);
+	}
+
+
+	////////////////////////////////////////////
+	//Compact number arrays
+	//XML_ARRAY_ITEMS   <v><item>1</item><item>2</item></v>  (default)
+	//XML_ARRAY_TEXT    <v enc="text" n="2">1 2</v>
+	//XML_ARRAY_BASE64  <v enc="base64" n="2">AQAAAAIAAAA=</v>  little-endian bytes
+	//Applies to std::vector, std::list and std::set of int, float and double.
+	//Writers use the format set for the calling thread; readers go by enc
+	///////////////////////////////////////////
+	enum XMLArrayFormat { XML_ARRAY_ITEMS, XML_ARRAY_TEXT, XML_ARRAY_BASE64 };
+
+	inline XMLArrayFormat& xml_array_format() {
+		static thread_local XMLArrayFormat format = XML_ARRAY_ITEMS;
+		return format;
+	}
+
+	inline bool host_little_endian() {
+		const uint16_t one = 1;
+		return *(const unsigned char*)&one == 1;
+	}
+
+	template<typename T>
+	void swap_bytes(std::vector<T> &v) {
+		for (size_t i = 0; i < v.size(); ++i) {
+			unsigned char *b = (unsigned char*)&v[i];
+			std::reverse(b, b + sizeof(T));
+		}
+	}
+
+	inline bool text_to_number(const char *p, int &v) { return XMLUtil::ToInt(p, &v); }
+	inline bool text_to_number(const char *p, float &v) { return XMLUtil::ToFloat(p, &v); }
+	inline bool text_to_number(const char *p, double &v) { return XMLUtil::ToDouble(p, &v); }
+
+	//element types without a compact form
+	template<typename T>
+	struct XMLArray
+	{
+		enum { compact = 0 };
+		static const char* name(XMLArrayFormat) { return ""; }
+		static std::string encode(const std::vector<T>&, XMLArrayFormat) { return std::string(); }
+		static bool decode(const char*, const char*, const char*, std::vector<T>&) { return false; }
+	};
+
+	template<typename T>
+	struct XMLNumberArray
+	{
+		enum { compact = 1 };
+
+		static const char* name(XMLArrayFormat format) {
+			return format == XML_ARRAY_BASE64 ? "base64" : "text";
+		}
+
+		//the element text in the given format
+		static std::string encode(const std::vector<T> &value, XMLArrayFormat format) {
+			if (format == XML_ARRAY_BASE64) {
+				if (host_little_endian()) {
+					return base64_encode(value.data(), value.size() * sizeof(T));
+				}
+				std::vector<T> le(value);
+				swap_bytes(le);
+				return base64_encode(le.data(), le.size() * sizeof(T));
+			}
+			std::string text(value.size() * (XMLUtil::MAX_NUMBER_CHARS + 1), '\0');
+			char *p = text.empty() ? NULL : &text[0];
+			for (size_t i = 0; i < value.size(); ++i) {
+				if (i > 0) {
+					*p++ = ' ';
+				}
+				p = XMLUtil::AppendNumber(value[i], p);
+			}
+			text.resize(value.empty() ? 0 : p - text.data());
+			return text;
+		}
+
+		//append the numbers in text to value; enc and count are the attributes
+		static bool decode(const char *enc, const char *count, const char *text, std::vector<T> &value) {
+			uint64_t n = 0;
+			if (count && !XMLUtil::ToUnsigned64(count, &n)) {
+				return false;
+			}
+			size_t first = value.size();
+			if (strcmp(enc, "base64") == 0) {
+				size_t len = strlen(text);
+				size_t room = (len / 4 * 3 + 3) / sizeof(T) + 1;
+				value.resize(first + room);
+				size_t bytes = 0;
+				bool ok = base64_decode(text, len, &value[first], room * sizeof(T), bytes);
+				value.resize(first + bytes / sizeof(T));
+				if (!host_little_endian()) {
+					std::vector<T> tail(value.begin() + first, value.end());
+					swap_bytes(tail);
+					std::copy(tail.begin(), tail.end(), value.begin() + first);
+				}
+				return ok && bytes % sizeof(T) == 0 && (!count || value.size() - first == n);
+			}
+			if (strcmp(enc, "text") == 0) {
+				value.reserve(first + (size_t)n);
+				for (const char *p = text;;) {
+					while (XMLUtil::IsWhiteSpace(*p)) {
+						++p;
+					}
+					if (!*p) {
+						break;
+					}
+					T v = T();
+					if (!text_to_number(p, v)) {
+						return false;
+					}
+					value.push_back(v);
+					while (*p && !XMLUtil::IsWhiteSpace(*p)) {
+						++p;
+					}
+				}
+				return !count || value.size() - first == n;
+			}
+			return false;
+		}
+	};
+
+	template<> struct XMLArray<int> : XMLNumberArray<int> {};
+	template<> struct XMLArray<float> : XMLNumberArray<float> {};
+	template<> struct XMLArray<double> : XMLNumberArray<double> {};
+
+
+	////////////////////////////////////////////
+	//Attribute layout
+	//XML_LAYOUT_ELEMENTS    <p><first>2</first><second>3.1</second></p>  (default)
+	//XML_LAYOUT_ATTRIBUTES  <p first="2" second="3.1"/>
+	//Scalars (char, int, float, double, std::string) become attributes:
+	//<int v="5"/>, pairs of scalars <p first=".." second=".."/>, and map
+	//entries with a scalar key <e k=".." v=".."/> (or <e k=".."><v>..</v></e>)
+	//in place of the Key and Val lists. Readers take either layout
+	///////////////////////////////////////////
+	enum XMLLayout { XML_LAYOUT_ELEMENTS, XML_LAYOUT_ATTRIBUTES };
+
+	inline XMLLayout& xml_layout() {
+		static thread_local XMLLayout layout = XML_LAYOUT_ELEMENTS;
+		return layout;
+	}
+
+	//types that fit in an attribute
+	template<typename T>
+	struct XMLScalar
+	{
+		enum { scalar = 0 };
+		static void print(XMLPrinter&, const char*, const T&) {}
+		static void set(XMLElement*, const char*, const T&) {}
+		static void parse(const char*, T&) {}
+	};
+
+	template<typename T>
+	struct XMLNumberScalar
+	{
+		enum { scalar = 1 };
+		static void print(XMLPrinter &printer, const char *attr, const T &value) { printer.PushAttribute(attr, value); }
+		static void set(XMLElement *xmlElement, const char *attr, const T &value) { xmlElement->SetAttribute(attr, value); }
+		static void parse(const char *text, T &value) {
+			T tempvalue;
+			if (text_to_number(text, tempvalue)) {
+				value = tempvalue;
+			}
+		}
+	};
+
+	template<> struct XMLScalar<int> : XMLNumberScalar<int> {};
+	template<> struct XMLScalar<float> : XMLNumberScalar<float> {};
+	template<> struct XMLScalar<double> : XMLNumberScalar<double> {};
+
+	template<>
+	struct XMLScalar<char>
+	{
+		enum { scalar = 1 };
+		static void print(XMLPrinter &printer, const char *attr, const char &ch) {
+			char text[2] = { ch, '\0' };
+			printer.PushAttribute(attr, text);
+		}
+		static void set(XMLElement *xmlElement, const char *attr, const char &ch) {
+			char text[2] = { ch, '\0' };
+			xmlElement->SetAttribute(attr, text);
+		}
+		static void parse(const char *text, char &ch) { ch = text[0]; }
+	};
+
+	template<>
+	struct XMLScalar<std::string>
+	{
+		enum { scalar = 1 };
+		static void print(XMLPrinter &printer, const char *attr, const std::string &value) { printer.PushAttribute(attr, value.c_str()); }
+		static void set(XMLElement *xmlElement, const char *attr, const std::string &value) { xmlElement->SetAttribute(attr, value.c_str()); }
+		static void parse(const char *text, std::string &value) { value = text; }
+	};
+
+
+	//a new element whose name is stored once per document, not once per element
+	inline XMLElement* new_element(XMLElement *parent, const std::string &name) {
+		XMLDocument *doc = parent->GetDocument();
+		return doc->NewElement(doc->Intern(name.c_str(), name.size()), true);
+	}
+
+
 	class XMLBase {
 	public:
 		template<typename T>
@@ -32,6 +828,16 @@ namespace XML_Seri {
 				std::cerr << "missing XML writing function for value type : " << typeid(T).name() << std::endl;
 				assert(false);
 			}
+			static void print(XMLPrinter & printer, const std::string & name, const T & value)
+			{
+				std::cerr << "missing XML writing function for value type : " << typeid(T).name() << std::endl;
+				assert(false);
+			}
+			static void reader(XMLPullReader & in, T & value)
+			{
+				std::cerr << "missing XML reading function for value type : " << typeid(T).name() << std::endl;
+				assert(false);
+			}
 		};
 
 
@@ -41,6 +847,12 @@ namespace XML_Seri {
 		{
 			static void reader(XMLElement *xmlElement, std::vector<T> &value)
 			{
+				const char *enc = xmlElement->Attribute("enc");
+				if (enc) {
+					const char *text = xmlElement->GetText();
+					XMLArray<T>::decode(enc, xmlElement->Attribute("n"), text ? text : "", value);
+					return;
+				}
 				tinyxml2::XMLElement * childElement = xmlElement->FirstChildElement();
 				while (childElement)
 				{
@@ -50,14 +862,61 @@ namespace XML_Seri {
 					childElement = childElement->NextSiblingElement();
 				}
 			}
+			//the same from pull events; in is on the START_ELEMENT of the vector
+			static void reader(XMLPullReader &in, std::vector<T> &value)
+			{
+				if (const char *enc = in.attribute("enc")) {
+					std::string e(enc);
+					const char *n = in.attribute("n");
+					std::string count(n ? n : "");
+					std::string text = in.read_text();
+					XMLArray<T>::decode(e.c_str(), n ? count.c_str() : NULL, text.c_str(), value);
+					return;
+				}
+				while (in.next_element())
+				{
+					T childValue = T();
+					VarType<T>::reader(in, childValue);
+					value.push_back(childValue);
+				}
+			}
 			static void writer(XMLElement * xmlElement, const std::string & name, const std::vector<T> & value)
 			{
-				XMLElement * newElement = xmlElement->GetDocument()->NewElement(name.c_str());
+				XMLElement * newElement = new_element(xmlElement, name);
+				XMLArrayFormat format = xml_array_format();
+				if (XMLArray<T>::compact && format != XML_ARRAY_ITEMS) {
+					newElement->SetAttribute("enc", XMLArray<T>::name(format));
+					newElement->SetAttribute("n", (uint64_t)value.size());
+					if (!value.empty()) {
+						newElement->SetText(XMLArray<T>::encode(value, format).c_str());
+					}
+					xmlElement->InsertEndChild(newElement);
+					return;
+				}
 				for (auto &item : value) {
 					VarType<T>::writer(newElement, "item", item);
 				}
 				xmlElement->InsertEndChild(newElement);
 			}
+			//same output as writer, straight into the printer
+			static void print(XMLPrinter & printer, const std::string & name, const std::vector<T> & value)
+			{
+				printer.OpenElement(name.c_str());
+				XMLArrayFormat format = xml_array_format();
+				if (XMLArray<T>::compact && format != XML_ARRAY_ITEMS) {
+					printer.PushAttribute("enc", XMLArray<T>::name(format));
+					printer.PushAttribute("n", (uint64_t)value.size());
+					if (!value.empty()) {
+						printer.PushText(XMLArray<T>::encode(value, format).c_str());
+					}
+					printer.CloseElement();
+					return;
+				}
+				for (auto &item : value) {
+					VarType<T>::print(printer, "item", item);
+				}
+				printer.CloseElement();
+			}
 		};
 
 
@@ -73,12 +932,40 @@ namespace XML_Seri {
 					std::copy(temp.begin(), temp.end(), std::back_inserter(value));
 				}
 			}
+			static void reader(XMLPullReader &in, std::list<T> &value)
+			{
+				if (in.attribute("enc")) {
+					std::vector<T> temp;
+					VarType<std::vector<T>>::reader(in, temp);
+					value.insert(value.end(), temp.begin(), temp.end());
+					return;
+				}
+				while (in.next_element())
+				{
+					T childValue = T();
+					VarType<T>::reader(in, childValue);
+					value.push_back(childValue);
+				}
+			}
 			static void writer(XMLElement * xmlElement, const std::string & name, const std::list<T> & value)
 			{
 				std::vector<T> temp;
 				std::copy(value.begin(), value.end(), std::back_inserter(temp));
 				VarType<std::vector<T>>::writer(xmlElement, name, temp);
 			}
+			static void print(XMLPrinter & printer, const std::string & name, const std::list<T> & value)
+			{
+				if (XMLArray<T>::compact && xml_array_format() != XML_ARRAY_ITEMS) {
+					std::vector<T> temp(value.begin(), value.end());
+					VarType<std::vector<T>>::print(printer, name, temp);
+					return;
+				}
+				printer.OpenElement(name.c_str());
+				for (auto &item : value) {
+					VarType<T>::print(printer, "item", item);
+				}
+				printer.CloseElement();
+			}
 		};
 
 
@@ -97,12 +984,40 @@ namespace XML_Seri {
 					}
 				}
 			}
+			static void reader(XMLPullReader &in, std::set<T> &value)
+			{
+				if (in.attribute("enc")) {
+					std::vector<T> temp;
+					VarType<std::vector<T>>::reader(in, temp);
+					value.insert(temp.begin(), temp.end());
+					return;
+				}
+				while (in.next_element())
+				{
+					T childValue = T();
+					VarType<T>::reader(in, childValue);
+					value.insert(childValue);
+				}
+			}
 			static void writer(XMLElement * xmlElement, const std::string & name, const std::set<T> & value)
 			{
 				std::vector<T> temp;
 				std::copy(value.begin(), value.end(), std::back_inserter(temp));
 				VarType<std::vector<T>>::writer(xmlElement, name, temp);
 			}
+			static void print(XMLPrinter & printer, const std::string & name, const std::set<T> & value)
+			{
+				if (XMLArray<T>::compact && xml_array_format() != XML_ARRAY_ITEMS) {
+					std::vector<T> temp(value.begin(), value.end());
+					VarType<std::vector<T>>::print(printer, name, temp);
+					return;
+				}
+				printer.OpenElement(name.c_str());
+				for (auto &item : value) {
+					VarType<T>::print(printer, "item", item);
+				}
+				printer.CloseElement();
+			}
 		};
 
 
@@ -112,10 +1027,32 @@ namespace XML_Seri {
 		{
 			static void reader(XMLElement * xmlElement, std::map<TA, TB> &value)
 			{
+				tinyxml2::XMLElement * KeyElement = xmlElement->FirstChildElement();
+				if (!KeyElement) {
+					return;
+				}
+				if (strcmp(KeyElement->Name(), "e") == 0) {
+					//entries come sorted: each one goes in at the end
+					for (tinyxml2::XMLElement *e = KeyElement; e; e = e->NextSiblingElement()) {
+						TA key = TA();
+						TB val = TB();
+						const char *k = e->Attribute("k");
+						XMLScalar<TA>::parse(k ? k : "", key);
+						if (XMLScalar<TB>::scalar) {
+							const char *v = e->Attribute("v");
+							XMLScalar<TB>::parse(v ? v : "", val);
+						}
+						else if (tinyxml2::XMLElement *v = e->FirstChildElement()) {
+							VarType<TB>::reader(v, val);
+						}
+						value.emplace_hint(value.end(), key, val);
+					}
+					return;
+				}
+
 				std::vector<TA> tempKey;
 				std::vector<TB> tempVal;
-				tinyxml2::XMLElement * KeyElement = xmlElement->FirstChildElement();
-				tinyxml2::XMLElement * ValElement = xmlElement->FirstChildElement()->NextSiblingElement();
+				tinyxml2::XMLElement * ValElement = KeyElement->NextSiblingElement();
 
 				if (KeyElement&&ValElement) {
 					VarType<std::vector<TA>>::reader(KeyElement, tempKey);
@@ -130,23 +1067,117 @@ namespace XML_Seri {
 					}
 				}
 			}
+			static void reader(XMLPullReader &in, std::map<TA, TB> &value)
+			{
+				if (!in.next_element()) {
+					return;
+				}
+				if (in.name() == "e") {
+					do {
+						TA key = TA();
+						TB val = TB();
+						const char *k = in.attribute("k");
+						XMLScalar<TA>::parse(k ? k : "", key);
+						if (XMLScalar<TB>::scalar) {
+							const char *v = in.attribute("v");
+							XMLScalar<TB>::parse(v ? v : "", val);
+							in.finish_element();
+						}
+						else if (in.next_element()) {
+							VarType<TB>::reader(in, val);
+							in.finish_element();
+						}
+						value.emplace_hint(value.end(), key, val);
+					} while (in.next_element());
+					return;
+				}
+
+				std::vector<TA> tempKey;
+				std::vector<TB> tempVal;
+				VarType<std::vector<TA>>::reader(in, tempKey);
+				if (in.next_element()) {
+					VarType<std::vector<TB>>::reader(in, tempVal);
+					in.finish_element();
+				}
+
+				if (tempKey.size() > 0 && tempVal.size() == tempKey.size())
+				{
+					for (size_t i = 0; i < tempKey.size(); ++i)
+					{
+						value.insert(std::make_pair(tempKey[i], tempVal[i]));
+					}
+				}
+			}
 
 			static void writer(XMLElement * xmlElement, const std::string & name, const std::map<TA,TB> & value)
 			{
+				tinyxml2::XMLElement * mapElement = new_element(xmlElement, name);
+				typename std::map<TA, TB>::const_iterator it;
+				if (entries()) {
+					for (it = value.begin(); it != value.end(); ++it)
+					{
+						tinyxml2::XMLElement * e = xmlElement->GetDocument()->NewElement("e", true);
+						XMLScalar<TA>::set(e, "k", it->first);
+						if (XMLScalar<TB>::scalar)
+							XMLScalar<TB>::set(e, "v", it->second);
+						else
+							VarType<TB>::writer(e, "v", it->second);
+						mapElement->InsertEndChild(e);
+					}
+					xmlElement->InsertEndChild(mapElement);
+					return;
+				}
+
 				std::vector<TA> tempKey;
 				std::vector<TB> tempVal;
-				typename std::map<TA, TB>::const_iterator it;
 				for (it = value.begin(); it != value.end(); ++it)
 				{
 					tempKey.push_back(it->first);
 					tempVal.push_back(it->second);
 				}
 
-				tinyxml2::XMLElement * mapElement = xmlElement->GetDocument()->NewElement(name.c_str());
 				VarType<std::vector<TA>>::writer(mapElement, "Key", tempKey);
 				VarType<std::vector<TB>>::writer(mapElement, "Val", tempVal);
 				xmlElement->InsertEndChild(mapElement);
 			}
+			static void print(XMLPrinter & printer, const std::string & name, const std::map<TA, TB> & value)
+			{
+				typename std::map<TA, TB>::const_iterator it;
+				printer.OpenElement(name.c_str());
+				if (entries()) {
+					for (it = value.begin(); it != value.end(); ++it)
+					{
+						printer.OpenElement("e");
+						XMLScalar<TA>::print(printer, "k", it->first);
+						if (XMLScalar<TB>::scalar)
+							XMLScalar<TB>::print(printer, "v", it->second);
+						else
+							VarType<TB>::print(printer, "v", it->second);
+						printer.CloseElement();
+					}
+					printer.CloseElement();
+					return;
+				}
+				printer.OpenElement("Key");
+				for (it = value.begin(); it != value.end(); ++it)
+				{
+					VarType<TA>::print(printer, "item", it->first);
+				}
+				printer.CloseElement();
+				printer.OpenElement("Val");
+				for (it = value.begin(); it != value.end(); ++it)
+				{
+					VarType<TB>::print(printer, "item", it->second);
+				}
+				printer.CloseElement();
+				printer.CloseElement();
+			}
+
+			//one <e k=".." v=".."/> per entry: the key fits in an attribute and the layout asks for it
+			static bool entries()
+			{
+				return XMLScalar<TA>::scalar && xml_layout() == XML_LAYOUT_ATTRIBUTES;
+			}
 		};
 
 
@@ -156,8 +1187,17 @@ namespace XML_Seri {
 		{
 			static void reader(XMLElement * xmlElement, std::pair<TA, TB> &value)
 			{
-				TA tempfirst;
-				TB tempsecond;
+				TA tempfirst = TA();
+				TB tempsecond = TB();
+
+				const char *first = xmlElement->Attribute("first");
+				const char *second = xmlElement->Attribute("second");
+				if (first && second) {
+					XMLScalar<TA>::parse(first, tempfirst);
+					XMLScalar<TB>::parse(second, tempsecond);
+					value = std::make_pair(tempfirst, tempsecond);
+					return;
+				}
 
 				tinyxml2::XMLElement * firstElement = xmlElement->FirstChildElement();
 				tinyxml2::XMLElement * secondElement = xmlElement->FirstChildElement()->NextSiblingElement();
@@ -167,17 +1207,64 @@ namespace XML_Seri {
 
 				value = std::make_pair(tempfirst, tempsecond);
 			}
+			static void reader(XMLPullReader &in, std::pair<TA, TB> &value)
+			{
+				TA tempfirst = TA();
+				TB tempsecond = TB();
+				const char *first = in.attribute("first");
+				const char *second = in.attribute("second");
+				if (first && second) {
+					XMLScalar<TA>::parse(first, tempfirst);
+					XMLScalar<TB>::parse(second, tempsecond);
+					in.finish_element();
+					value = std::make_pair(tempfirst, tempsecond);
+					return;
+				}
+				if (in.next_element()) {
+					VarType<TA>::reader(in, tempfirst);
+					if (in.next_element()) {
+						VarType<TB>::reader(in, tempsecond);
+						in.finish_element();
+					}
+				}
+				value = std::make_pair(tempfirst, tempsecond);
+			}
 
 			static void writer(XMLElement * xmlElement, const std::string & name, const std::pair<TA, TB> & value)
 			{
 				TA tempfirst = value.first;
 				TB tempsecond = value.second;
-				tinyxml2::XMLElement * newElement = xmlElement->GetDocument()->NewElement(name.c_str());
+				tinyxml2::XMLElement * newElement = new_element(xmlElement, name);
+				if (attributes()) {
+					XMLScalar<TA>::set(newElement, "first", tempfirst);
+					XMLScalar<TB>::set(newElement, "second", tempsecond);
+					xmlElement->InsertEndChild(newElement);
+					return;
+				}
 				VarType<TA>::writer(newElement, "first", tempfirst);
 				VarType<TB>::writer(newElement, "second", tempsecond);
 
 				xmlElement->InsertEndChild(newElement);
 			}
+			static void print(XMLPrinter & printer, const std::string & name, const std::pair<TA, TB> & value)
+			{
+				printer.OpenElement(name.c_str());
+				if (attributes()) {
+					XMLScalar<TA>::print(printer, "first", value.first);
+					XMLScalar<TB>::print(printer, "second", value.second);
+				}
+				else {
+					VarType<TA>::print(printer, "first", value.first);
+					VarType<TB>::print(printer, "second", value.second);
+				}
+				printer.CloseElement();
+			}
+
+			//both members fit in attributes and the layout asks for them
+			static bool attributes()
+			{
+				return XMLScalar<TA>::scalar && XMLScalar<TB>::scalar && xml_layout() == XML_LAYOUT_ATTRIBUTES;
+			}
 		};
 
 		//read&write for char
@@ -185,14 +1272,37 @@ namespace XML_Seri {
 		struct VarType<char>
 		{
 			static void reader(tinyxml2::XMLElement * xmlElement, char &ch) {
-				memcpy(&ch, xmlElement->GetText(), sizeof(char));
+				if (const char *v = xmlElement->Attribute("v")) {
+					ch = v[0];
+					return;
+				}
+				const char *text = xmlElement->GetText();
+				ch = text ? text[0] : '\0';
+			}
+			static void reader(XMLPullReader &in, char &ch) {
+				std::string text = in.read_value("v");
+				ch = text.empty() ? '\0' : text[0];
 			}
 
 			static void writer(tinyxml2::XMLElement * xmlElement, const std::string & name, const char &ch) {
-				tinyxml2::XMLElement * newElement = xmlElement->GetDocument()->NewElement(name.c_str());
-				newElement->SetText((const char*)&ch);
+				char text[2] = { ch, '\0' };
+				tinyxml2::XMLElement * newElement = new_element(xmlElement, name);
+				if (xml_layout() == XML_LAYOUT_ATTRIBUTES)
+					XMLScalar<char>::set(newElement, "v", ch);
+				else
+					newElement->SetText(text);
 				xmlElement->InsertEndChild(newElement);
 			}
+
+			static void print(XMLPrinter & printer, const std::string & name, const char &ch) {
+				char text[2] = { ch, '\0' };
+				printer.OpenElement(name.c_str());
+				if (xml_layout() == XML_LAYOUT_ATTRIBUTES)
+					XMLScalar<char>::print(printer, "v", ch);
+				else
+					printer.PushText(text);
+				printer.CloseElement();
+			}
 		};
 
 
@@ -202,17 +1312,41 @@ namespace XML_Seri {
 		{
 			static void reader(tinyxml2::XMLElement * xmlElement, int &value)
 			{
+				if (const char *v = xmlElement->Attribute("v")) {
+					XMLScalar<int>::parse(v, value);
+					return;
+				}
 				int tempvalue;
 				xmlElement->QueryIntText(&tempvalue);
 				value = tempvalue;
 			}
+			static void reader(XMLPullReader &in, int &value)
+			{
+				int tempvalue;
+				if (XMLUtil::ToInt(in.read_value("v").c_str(), &tempvalue)) {
+					value = tempvalue;
+				}
+			}
 
 			static void writer(tinyxml2::XMLElement * xmlElement, const std::string & name, const int & value)
 			{
-				tinyxml2::XMLElement * newElement = xmlElement->GetDocument()->NewElement(name.c_str());
-				newElement->SetText(value);
+				tinyxml2::XMLElement * newElement = new_element(xmlElement, name);
+				if (xml_layout() == XML_LAYOUT_ATTRIBUTES)
+					XMLScalar<int>::set(newElement, "v", value);
+				else
+					newElement->SetText(value);
 				xmlElement->InsertEndChild(newElement);
 			}
+
+			static void print(XMLPrinter & printer, const std::string & name, const int & value)
+			{
+				printer.OpenElement(name.c_str());
+				if (xml_layout() == XML_LAYOUT_ATTRIBUTES)
+					XMLScalar<int>::print(printer, "v", value);
+				else
+					printer.PushText(value);
+				printer.CloseElement();
+			}
 		};
 
 
@@ -222,17 +1356,41 @@ namespace XML_Seri {
 		{
 			static void reader(tinyxml2::XMLElement * xmlElement, float &value)
 			{
+				if (const char *v = xmlElement->Attribute("v")) {
+					XMLScalar<float>::parse(v, value);
+					return;
+				}
 				float tempvalue;
 				xmlElement->QueryFloatText(&tempvalue);
 				value = tempvalue;
 			}
+			static void reader(XMLPullReader &in, float &value)
+			{
+				float tempvalue;
+				if (XMLUtil::ToFloat(in.read_value("v").c_str(), &tempvalue)) {
+					value = tempvalue;
+				}
+			}
 
 			static void writer(tinyxml2::XMLElement * xmlElement, const std::string & name, const float & value)
 			{
-				tinyxml2::XMLElement * newElement = xmlElement->GetDocument()->NewElement(name.c_str());
-				newElement->SetText(value);
+				tinyxml2::XMLElement * newElement = new_element(xmlElement, name);
+				if (xml_layout() == XML_LAYOUT_ATTRIBUTES)
+					XMLScalar<float>::set(newElement, "v", value);
+				else
+					newElement->SetText(value);
 				xmlElement->InsertEndChild(newElement);
 			}
+
+			static void print(XMLPrinter & printer, const std::string & name, const float & value)
+			{
+				printer.OpenElement(name.c_str());
+				if (xml_layout() == XML_LAYOUT_ATTRIBUTES)
+					XMLScalar<float>::print(printer, "v", value);
+				else
+					printer.PushText(value);
+				printer.CloseElement();
+			}
 		};
 
 
@@ -242,17 +1400,41 @@ namespace XML_Seri {
 		{
 			static void reader(tinyxml2::XMLElement * xmlElement, double &value)
 			{
+				if (const char *v = xmlElement->Attribute("v")) {
+					XMLScalar<double>::parse(v, value);
+					return;
+				}
 				double tempvalue;
 				xmlElement->QueryDoubleText(&tempvalue);
 				value = tempvalue;
 			}
+			static void reader(XMLPullReader &in, double &value)
+			{
+				double tempvalue;
+				if (XMLUtil::ToDouble(in.read_value("v").c_str(), &tempvalue)) {
+					value = tempvalue;
+				}
+			}
 
 			static void writer(tinyxml2::XMLElement * xmlElement, const std::string & name, const double & value)
 			{
-				tinyxml2::XMLElement * newElement = xmlElement->GetDocument()->NewElement(name.c_str());
-				newElement->SetText(value);
+				tinyxml2::XMLElement * newElement = new_element(xmlElement, name);
+				if (xml_layout() == XML_LAYOUT_ATTRIBUTES)
+					XMLScalar<double>::set(newElement, "v", value);
+				else
+					newElement->SetText(value);
 				xmlElement->InsertEndChild(newElement);
 			}
+
+			static void print(XMLPrinter & printer, const std::string & name, const double & value)
+			{
+				printer.OpenElement(name.c_str());
+				if (xml_layout() == XML_LAYOUT_ATTRIBUTES)
+					XMLScalar<double>::print(printer, "v", value);
+				else
+					printer.PushText(value);
+				printer.CloseElement();
+			}
 		};
 
 
@@ -262,39 +1444,302 @@ namespace XML_Seri {
 		{
 			static void reader(tinyxml2::XMLElement * xmlElement, std::string &value)
 			{
+				if (const char *v = xmlElement->Attribute("v")) {
+					value = v;
+					return;
+				}
 				value = xmlElement->GetText();
 			}
+			static void reader(XMLPullReader &in, std::string &value)
+			{
+				value = in.read_value("v");
+			}
 
 			static void writer(tinyxml2::XMLElement * xmlElement, const std::string & name, const std::string & value)
 			{
-				tinyxml2::XMLElement * newElement = xmlElement->GetDocument()->NewElement(name.c_str());
-				newElement->SetText(value.c_str());
+				tinyxml2::XMLElement * newElement = new_element(xmlElement, name);
+				if (xml_layout() == XML_LAYOUT_ATTRIBUTES)
+					XMLScalar<std::string>::set(newElement, "v", value);
+				else
+					newElement->SetText(value.c_str());
 				xmlElement->InsertEndChild(newElement);
 			}
+
+			static void print(XMLPrinter & printer, const std::string & name, const std::string & value)
+			{
+				printer.OpenElement(name.c_str());
+				if (xml_layout() == XML_LAYOUT_ATTRIBUTES)
+					XMLScalar<std::string>::print(printer, "v", value);
+				else
+					printer.PushText(value.c_str());
+				printer.CloseElement();
+			}
 		};
 
 
 	};//end XMLBase
 
 
-	//stream in from xml
+	//stream in from xml; the caller deletes the document
+	//serialized files are parsed without line numbers (errors still get one)
 	XMLDocument* ReadFromFile(const std::string &file_name) {
 		std::ifstream fileStream(file_name);
 		std::stringstream stringBuffer;
 		stringBuffer << fileStream.rdbuf();
 		
 		XMLDocument *xmlDoc = new XMLDocument();
+		xmlDoc->SetTrackLineNumbers(false);
 		xmlDoc->Parse(stringBuffer.str().c_str());
 		return xmlDoc;
 	}
 
-	//deserialize from a xml file
+	//XMLDocument parsed in place in a private, copy-on-write mapping of the
+	//file: no copy of the input is made, and only the pages the parser writes
+	//to (terminators, decoded entities) get private copies
+	class XMLMappedDocument : public XMLDocument {
+	public:
+		XMLMappedDocument() : base(NULL), span(0), heap(false) {}
+		~XMLMappedDocument() {
+			Clear(); //nodes point into the mapping
+			unmap();
+		}
+
+		//a missing or empty file leaves an empty document (Error() is set)
+		XMLError LoadFileInSitu(const std::string &file_name) {
+			Clear();
+			unmap();
+			size_t len = 0;
+			if (!map(file_name, len)) {
+				return ParseInSitu(NULL, 0);
+			}
+			XMLError err = ParseInSitu(base, len);
+			if (err != tinyxml2::XML_SUCCESS && !TrackLineNumbers()) {
+				//the failed pass wrote into the mapping: map afresh and parse
+				//again, counting lines, to find where the error is
+				SetTrackLineNumbers(true);
+				err = LoadFileInSitu(file_name);
+				SetTrackLineNumbers(false);
+			}
+			return err;
+		}
+
+	private:
+		//map the file with at least one zero byte after its end
+		bool map(const std::string &file_name, size_t &len) {
+#ifdef _WIN32
+			HANDLE file = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (file == INVALID_HANDLE_VALUE) {
+				return false;
+			}
+			LARGE_INTEGER sz;
+			bool ok = GetFileSizeEx(file, &sz) && sz.QuadPart > 0;
+			HANDLE mapping = ok ? CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL) : NULL;
+			char *view = mapping ? (char*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0) : NULL;
+			if (mapping) {
+				CloseHandle(mapping);
+			}
+			CloseHandle(file);
+			if (view == NULL) {
+				return false;
+			}
+			len = (size_t)sz.QuadPart;
+			SYSTEM_INFO si;
+			GetSystemInfo(&si);
+			if (len % si.dwPageSize != 0) {
+				base = view; //the rest of the last page reads as zeros
+				return true;
+			}
+			//no room for the terminator: fall back to one copy
+			base = new char[len + 1];
+			memcpy(base, view, len);
+			base[len] = 0;
+			heap = true;
+			UnmapViewOfFile(view);
+			return true;
+#else
+			int fd = open(file_name.c_str(), O_RDONLY);
+			if (fd < 0) {
+				return false;
+			}
+			struct stat st;
+			if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+				close(fd);
+				return false;
+			}
+			len = (size_t)st.st_size;
+			size_t page = (size_t)sysconf(_SC_PAGESIZE);
+			span = (len / page + 1) * page; //always a zero byte past the end
+			void *p = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (p != MAP_FAILED && mmap(p, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+				munmap(p, span);
+				p = MAP_FAILED;
+			}
+			close(fd);
+			if (p == MAP_FAILED) {
+				return false;
+			}
+			base = (char*)p;
+			return true;
+#endif
+		}
+
+		void unmap() {
+			if (base == NULL) {
+				return;
+			}
+#ifdef _WIN32
+			if (heap) {
+				delete[] base;
+			}
+			else {
+				UnmapViewOfFile(base);
+			}
+#else
+			munmap(base, span);
+#endif
+			base = NULL;
+			heap = false;
+		}
+
+		char *base;
+		size_t span;
+		bool heap;
+	};
+
+	//parse a file in place in a copy-on-write mapping; the caller deletes
+	//the document
+	XMLDocument* ReadFromFileInSitu(const std::string &file_name) {
+		XMLMappedDocument *xmlDoc = new XMLMappedDocument();
+		xmlDoc->SetTrackLineNumbers(false);
+		xmlDoc->LoadFileInSitu(file_name);
+		return xmlDoc;
+	}
+
+	//XMLDocument for loading many similar files one after another: each load
+	//recycles the node pools and the read buffer of the last one, so once
+	//warmed up a load allocates nothing unless the file is larger
+	class XMLReusableDocument : public XMLDocument {
+	public:
+		XMLReusableDocument() {
+			SetTrackLineNumbers(false);
+		}
+		~XMLReusableDocument() {
+			Clear(); //nodes point into the buffer
+		}
+
+		//a missing or empty file leaves an empty document (Error() is set)
+		XMLError LoadFileInSitu(const std::string &file_name) {
+			Recycle();
+			size_t len = 0;
+			if (!read(file_name, len)) {
+				return ParseInSitu(NULL, 0);
+			}
+			XMLError err = ParseInSitu(&buffer[0], len);
+			if (err != tinyxml2::XML_SUCCESS && !TrackLineNumbers()) {
+				//the failed pass wrote into the buffer: read it again and
+				//parse counting lines, to find where the error is
+				SetTrackLineNumbers(true);
+				err = LoadFileInSitu(file_name);
+				SetTrackLineNumbers(false);
+			}
+			return err;
+		}
+
+	private:
+		XMLReusableDocument(const XMLReusableDocument&);
+		XMLReusableDocument& operator=(const XMLReusableDocument&);
+
+		//the file, zero terminated, into buffer
+		bool read(const std::string &file_name, size_t &len) {
+			FILE *fp = NULL;
+#ifdef _MSC_VER
+			fopen_s(&fp, file_name.c_str(), "rb");
+#else
+			fp = fopen(file_name.c_str(), "rb");
+#endif
+			if (fp == NULL) {
+				return false;
+			}
+			bool ok = fseek(fp, 0, SEEK_END) == 0;
+			long size = ok ? ftell(fp) : -1;
+			ok = size > 0 && fseek(fp, 0, SEEK_SET) == 0;
+			if (ok) {
+				len = (size_t)size;
+				if (buffer.size() < len + 1) {
+					buffer.resize(len + 1);
+				}
+				ok = fread(&buffer[0], 1, len, fp) == len;
+				buffer[len] = 0;
+			}
+			fclose(fp);
+			return ok;
+		}
+
+		std::vector<char> buffer;
+	};
+
+	//a document from the calling thread's cache, given back (recycled) when
+	//the handle goes out of scope; handles may nest, and threads never
+	//share a document. Block sizes set on a document stay with it
+	class XMLPooledDocument {
+	public:
+		//documents kept per thread
+		enum { CACHE_SIZE = 4 };
+
+		XMLPooledDocument() : doc(take()) {}
+		~XMLPooledDocument() {
+			give_back(doc);
+		}
+
+		XMLReusableDocument* get() const { return doc; }
+		XMLReusableDocument* operator->() const { return doc; }
+		XMLReusableDocument& operator*() const { return *doc; }
+
+	private:
+		XMLPooledDocument(const XMLPooledDocument&);
+		XMLPooledDocument& operator=(const XMLPooledDocument&);
+
+		static std::vector<std::unique_ptr<XMLReusableDocument>>& cache() {
+			static thread_local std::vector<std::unique_ptr<XMLReusableDocument>> docs;
+			return docs;
+		}
+
+		static XMLReusableDocument* take() {
+			std::vector<std::unique_ptr<XMLReusableDocument>> &docs = cache();
+			if (docs.empty()) {
+				return new XMLReusableDocument();
+			}
+			XMLReusableDocument *d = docs.back().release();
+			docs.pop_back();
+			return d;
+		}
+
+		static void give_back(XMLReusableDocument *d) {
+			d->Recycle();
+			d->SetTrackLineNumbers(false);
+			std::vector<std::unique_ptr<XMLReusableDocument>> &docs = cache();
+			if (docs.size() < CACHE_SIZE) {
+				docs.push_back(std::unique_ptr<XMLReusableDocument>(d));
+			}
+			else {
+				delete d;
+			}
+		}
+
+		XMLReusableDocument *doc;
+	};
+
+	//deserialize from a xml file, straight from pull events: no DOM
 	template<typename SerializableType>
 	void deserialize_xml(SerializableType& a, const std::string &name, const std::string &file_name) {
-		XMLDocument *xmlDoc = ReadFromFile(file_name);
-		XMLElement *xmlNode = xmlDoc->RootElement()->FirstChildElement();
-		if (xmlNode) {
-			XMLBase::VarType<SerializableType>::reader(xmlNode, a);
+		XMLPullReader in(file_name);
+		if (!in.is_open()) {
+			std::cout << "File open error!\n";
+			return;
+		}
+		//the root element, then its first child
+		if (in.next_element() && in.next_element()) {
+			XMLBase::VarType<SerializableType>::reader(in, a);
 		}
 	}
 
@@ -307,18 +1752,73 @@ namespace XML_Seri {
 		fileStream << buffer;
 	}
 
+	//XML output printed straight into a buffered file, no DOM in between
+	//opens with the XML declaration; the file is closed with the writer
+	class XMLFileWriter {
+	public:
+		explicit XMLFileWriter(const std::string &file_name, size_t buffer_bytes = 64 * 1024)
+			: fp(open_file(file_name)), xmlPrinter(fp) {
+			if (fp) {
+				setvbuf(fp, NULL, _IOFBF, buffer_bytes);
+			}
+			xmlPrinter.PushDeclaration("xml version=\"1.0\" encoding=\"UTF-8\"");
+		}
+		~XMLFileWriter() {
+			if (fp) {
+				fclose(fp);
+			}
+		}
+
+		bool is_open() const { return fp != NULL; }
+		XMLPrinter& printer() { return xmlPrinter; }
+
+	private:
+		XMLFileWriter(const XMLFileWriter&);
+		XMLFileWriter& operator=(const XMLFileWriter&);
+
+		static FILE* open_file(const std::string &file_name) {
+#ifdef _MSC_VER
+			FILE *f = NULL;
+			fopen_s(&f, file_name.c_str(), "w");
+			return f;
+#else
+			return fopen(file_name.c_str(), "w");
+#endif
+		}
+
+		FILE *fp;
+		XMLPrinter xmlPrinter;
+	};
+
 	//serialize to a xml file
 	template<typename SerializableType>
 	void serialize_xml(SerializableType& a, const std::string &name, const std::string &file_name) {
-		XMLDocument* xmlDoc = new XMLDocument();
-		XMLDeclaration * xmlDecl = xmlDoc->NewDeclaration();
-		xmlDoc->InsertFirstChild(xmlDecl);
+		XMLFileWriter xmlFile(file_name);
+		if (!xmlFile.is_open()) {
+			std::cout << "File open error!\n";
+			return;
+		}
+		xmlFile.printer().OpenElement("serialization");
+		XMLBase::VarType<SerializableType>::print(xmlFile.printer(), name, a);
+		xmlFile.printer().CloseElement();
+	}
 
-		XMLElement * rootElement = xmlDoc->NewElement("serialization");
-		XMLBase::VarType<SerializableType>::writer(rootElement, name, a);
-		xmlDoc->InsertEndChild(rootElement);
+	//the same with number arrays written in the given format
+	template<typename SerializableType>
+	void serialize_xml(SerializableType& a, const std::string &name, const std::string &file_name, XMLArrayFormat format) {
+		XMLArrayFormat saved = xml_array_format();
+		xml_array_format() = format;
+		serialize_xml(a, name, file_name);
+		xml_array_format() = saved;
+	}
 
-		WriteToFile(xmlDoc, file_name);
+	//the same in the given layout
+	template<typename SerializableType>
+	void serialize_xml(SerializableType& a, const std::string &name, const std::string &file_name, XMLLayout layout) {
+		XMLLayout saved = xml_layout();
+		xml_layout() = layout;
+		serialize_xml(a, name, file_name);
+		xml_layout() = saved;
 	}
 
 	////////////////////////////////////////////
@@ -11,6 +11,31 @@ int main()
 	TEST_Set();
 	TEST_Map();
 	TEST_Pair();
+	TEST_SerializeInto();
+	TEST_SmallOutStream();
+	TEST_BufferPool();
+	TEST_GatherOutStream();
+	TEST_ScatterInput();
+	TEST_IncrementalDecoder();
+	TEST_Visitor();
+	TEST_RecordLog();
+	TEST_RecordIndex();
+	TEST_SortedTable();
+	TEST_PersistentMap();
+	TEST_Snapshot();
+	TEST_Delta();
+	TEST_ChunkStore();
+	TEST_Checksum();
+	TEST_XMLStreamWriter();
+	TEST_XMLPullReader();
+	TEST_XMLInSitu();
+	TEST_XMLScan();
+	TEST_XMLNoLineNumbers();
+	TEST_XMLNumbers();
+	TEST_XMLCompactArray();
+	TEST_XMLAttributeLayout();
+	TEST_XMLReusableDocument();
+	TEST_XMLInternNames();
 }
 
 
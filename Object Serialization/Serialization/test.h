@@ -1,9 +1,14 @@
 #pragma once
 #include "Serialization.h"
 #include "XML_Serialization.h"
+#include "RecordLog.h"
+#include "SortedTable.h"
+#include "PersistentMap.h"
+#include "Snapshot.h"
+#include "ChunkStore.h"
 
 //UserDefinedType for binary serialization
-class cbox : public BS::Serializable
+class cbox : public BS::InPlaceSerializable
 {
 public:
 	int a;
@@ -59,6 +64,18 @@ public:
 		return x.size();
 	}
 
+	virtual void deserialize_from(BS::InStream &in)
+	{
+		in >> a >> b >> str;
+	}
+
+	virtual size_t serialize_into(char *out, size_t cap) const
+	{
+		BS::BufferOutStream oe(out, cap);
+		oe << a << b << str;
+		return oe.size();
+	}
+
 	void display() {
 		std::cout << "a:" << a << ", b: " << b << ", str: " << str << std::endl;
 	}
@@ -113,27 +130,25 @@ public:
 	}
 
 	void deserialize_xml(const std::string &name, const std::string &file_name) {
-		tinyxml2::XMLDocument *xmlDoc = XML_Seri::ReadFromFile(file_name);
-		tinyxml2::XMLElement *xmlNode = xmlDoc->RootElement()->FirstChildElement();
-		XML_Seri::XMLBase::VarType<int>::reader(xmlNode, a);
-		xmlNode = xmlNode->NextSiblingElement();
-		XML_Seri::XMLBase::VarType<double>::reader(xmlNode, b);
-		xmlNode = xmlNode->NextSiblingElement();
-		XML_Seri::XMLBase::VarType<std::string>::reader(xmlNode, str);
+		XML_Seri::XMLPullReader in(file_name);
+		if (!in.next_element()) //root
+			return;
+		if (in.next_element())
+			XML_Seri::XMLBase::VarType<int>::reader(in, a);
+		if (in.next_element())
+			XML_Seri::XMLBase::VarType<double>::reader(in, b);
+		if (in.next_element())
+			XML_Seri::XMLBase::VarType<std::string>::reader(in, str);
 	}
 
 	void serialize_xml(const std::string &name, const std::string &file_name) {
-		tinyxml2::XMLDocument* xmlDoc = new tinyxml2::XMLDocument();
-		tinyxml2::XMLDeclaration * xmlDecl = xmlDoc->NewDeclaration();
-		xmlDoc->InsertFirstChild(xmlDecl);
-
-		tinyxml2::XMLElement * rootElement = xmlDoc->NewElement(name.c_str());
-		XML_Seri::XMLBase::VarType<int>::writer(rootElement, "int", a);
-		XML_Seri::XMLBase::VarType<double>::writer(rootElement, "double", b);
-		XML_Seri::XMLBase::VarType<std::string>::writer(rootElement, "std_str", str);
-
-		xmlDoc->InsertEndChild(rootElement);
-		XML_Seri::WriteToFile(xmlDoc, file_name);
+		XML_Seri::XMLFileWriter xmlFile(file_name);
+		tinyxml2::XMLPrinter &printer = xmlFile.printer();
+		printer.OpenElement(name.c_str());
+		XML_Seri::XMLBase::VarType<int>::print(printer, "int", a);
+		XML_Seri::XMLBase::VarType<double>::print(printer, "double", b);
+		XML_Seri::XMLBase::VarType<std::string>::print(printer, "std_str", str);
+		printer.CloseElement();
 	}
 
 };
@@ -430,3 +445,1595 @@ void TEST_Pair() {
 
 }
 
+//written against the original interface: serialize/deserialize only
+class legacy_box : public BS::Serializable
+{
+public:
+	legacy_box(int v = 0) : v(v) {}
+
+	virtual std::string serialize()
+	{
+		BS::OutStream os;
+		os << v;
+		return os.str();
+	}
+
+	virtual int deserialize(std::string &s)
+	{
+		BS::InStream x(s);
+		x >> v;
+		return x.size();
+	}
+
+	int v;
+};
+
+void TEST_SerializeInto() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_SerializeInto=================\n";
+	std::cout << "====================================\n";
+
+	//user-defined type into a caller-owned buffer
+	cbox box(11, 6.6, "Hello World"), box1;
+	char buf[64];
+	size_t n = BS::serialize_into(buf, sizeof(buf), box);
+	std::string expect = box.serialize();
+	ASSERT_EQ(n, expect.size());
+	ASSERT_TRUE(memcmp(buf, expect.data(), n) == 0);
+	std::string data(buf, n);
+	box1.deserialize(data);
+	ASSERT_EQ(box, box1);
+
+	//overflow reports the required size
+	char small[8];
+	ASSERT_EQ(BS::serialize_into(small, sizeof(small), box), n);
+	ASSERT_EQ(BS::serialized_size(box), n);
+
+	//containers match OutStream byte for byte
+	std::map<std::string, int> m;
+	m["first"] = 1;
+	m["second"] = 2;
+	BS::OutStream oe;
+	oe << m;
+	char mbuf[128];
+	size_t mn = BS::serialize_into(mbuf, sizeof(mbuf), m);
+	ASSERT_TRUE(oe.str() == std::string(mbuf, mn));
+
+	//the allocation-free path is opt-in; classes on the original
+	//interface still encode through the streams
+	static_assert(BS::encodes_in_place<std::vector<cbox> >::value, "cbox encodes in place");
+	static_assert(!BS::encodes_in_place<std::vector<legacy_box> >::value, "legacy_box allocates");
+	legacy_box lb(42), lb1;
+	BS::OutStream ol;
+	ol << lb;
+	ASSERT_EQ(BS::serialized_size(lb), ol.str().size());
+	std::string ldata = ol.str();
+	BS::InStream il(ldata);
+	il >> lb1;
+	ASSERT_EQ(lb1.v, 42);
+}
+
+void TEST_SmallOutStream() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_SmallOutStream=================\n";
+	std::cout << "====================================\n";
+
+	//small record stays in the inline buffer
+	cbox box(11, 6.6, "Hello World");
+	BS::SmallOutStream<256> se;
+	se << box;
+	ASSERT_TRUE(!se.on_heap());
+	ASSERT_TRUE(se.str() == box.serialize());
+
+	//large record spills to the heap and keeps the same bytes
+	std::vector<std::string> n(16, "a string long enough to overflow the inline buffer");
+	BS::OutStream oe;
+	oe << n;
+	BS::SmallOutStream<64> sn;
+	sn << n;
+	ASSERT_TRUE(sn.on_heap());
+	ASSERT_TRUE(sn.str() == oe.str());
+
+	std::vector<std::string> n1;
+	std::string data = sn.str();
+	BS::InStream ie(data);
+	ie >> n1;
+	ASSERT_TRUE(n == n1);
+}
+
+void TEST_BufferPool() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_BufferPool=================\n";
+	std::cout << "====================================\n";
+
+	cbox box(11, 6.6, "Hello World");
+	std::string first;
+	{
+		BS::OutStream oe;
+		oe << box;
+		first = oe.str();
+	}
+	BS::BufferPool::Stats before = BS::BufferPool::stats();
+	ASSERT_TRUE(before.retained_buffers > 0);
+	ASSERT_TRUE(before.retained_bytes > 0);
+
+	//the next OutStream on this thread reuses the released buffer
+	{
+		BS::OutStream oe;
+		oe << box;
+		ASSERT_TRUE(oe.str() == first);
+	}
+	BS::BufferPool::Stats after = BS::BufferPool::stats();
+	ASSERT_EQ(after.acquires, before.acquires + 1);
+	ASSERT_EQ(after.hits, before.hits + 1);
+	ASSERT_TRUE(after.hit_rate() > 0.0);
+}
+
+void TEST_GatherOutStream() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_GatherOutStream=================\n";
+	std::cout << "====================================\n";
+
+	std::vector<std::string> n;
+	n.push_back("small");
+	n.push_back(std::string(100000, 'x'));
+	n.push_back("tail");
+	std::vector<char> blob(50000, 'y');
+
+	BS::GatherOutStream ge(1024);
+	ge << n << blob;
+	std::vector<BS::IoSlice> v = ge.slices();
+
+	//large bodies are referenced, not copied
+	bool referenced = false;
+	for (size_t i = 0; i < v.size(); ++i)
+	{
+		if (v[i].base == n[1].data())
+			referenced = true;
+	}
+	ASSERT_TRUE(referenced);
+	ASSERT_EQ(v.back().base, (const char*)&blob[0]);
+
+	BS::OutStream oe;
+	oe << n << blob;
+	ASSERT_TRUE(ge.str() == oe.str());
+
+	//file sink uses writev
+	BS::serialize_to_binaryfile(n, "test_file\\test_gather.data");
+	std::vector<std::string> n1;
+	BS::desrialize_from_binaryfile(n1, "test_file\\test_gather.data");
+	ASSERT_TRUE(n == n1);
+}
+
+void TEST_ScatterInput() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_ScatterInput=================\n";
+	std::cout << "====================================\n";
+
+	std::vector<cbox> boxes, boxes1;
+	for (int i = 0; i < 10; ++i)
+	{
+		boxes.push_back(cbox(i, i * 0.5, "scatter"));
+	}
+	std::map<std::string, int> m, m1;
+	m["first"] = 1;
+	m["second"] = 2;
+	std::vector<double> d(5, 2.5), d1;
+
+	BS::OutStream oe;
+	oe << boxes << m << d;
+	std::string data = oe.str();
+
+	//cut the payload into 7-byte segments so values straddle boundaries
+	std::vector<BS::IoSlice> chain;
+	for (size_t off = 0; off < data.size(); off += 7)
+	{
+		BS::IoSlice x = { data.data() + off, data.size() - off < 7 ? data.size() - off : 7 };
+		chain.push_back(x);
+	}
+	BS::InStream ie(chain);
+	ie >> boxes1 >> m1 >> d1;
+	ASSERT_TRUE(ie.good());
+	ASSERT_EQ(ie.size(), (int)data.size());
+	ASSERT_EQ(boxes.size(), boxes1.size());
+	for (size_t i = 0; i < boxes.size() && i < boxes1.size(); ++i)
+	{
+		ASSERT_TRUE(boxes[i] == boxes1[i]);
+	}
+	ASSERT_TRUE(m == m1);
+	ASSERT_TRUE(d == d1);
+
+	//reading past the end is reported
+	int extra;
+	ie >> extra;
+	ASSERT_TRUE(!ie.good());
+
+	//a corrupt length larger than the input fails before allocating
+	const char huge[] = { '\xff', '\xff', '\xff', '\x7f', 'a', 'b', 'c', 'd' };
+	BS::IoSlice hs[2] = { { huge, 4 }, { huge + 4, 4 } };
+	std::string hstr;
+	BS::InStream hi(hs, 2);
+	hi >> hstr;
+	ASSERT_TRUE(!hi.good() && hstr.empty());
+	std::vector<double> hvec;
+	BS::InStream hv(huge, sizeof(huge));
+	hv >> hvec;
+	ASSERT_TRUE(!hv.good() && hvec.empty());
+
+	//streams read their input in place, so temporaries are rejected
+	static_assert(!std::is_constructible<BS::InStream, std::string&&>::value, "InStream from a temporary");
+	static_assert(!std::is_constructible<BS::CheckedInStream, std::string&&>::value, "CheckedInStream from a temporary");
+}
+
+void TEST_IncrementalDecoder() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_IncrementalDecoder=================\n";
+	std::cout << "====================================\n";
+
+	std::vector<cbox> boxes, boxes1;
+	for (int i = 0; i < 20; ++i)
+	{
+		boxes.push_back(cbox(i, i * 0.25, "incremental"));
+	}
+	std::map<std::string, int> m, m1;
+	m["first"] = 1;
+	m["second"] = 2;
+	m["third"] = 3;
+
+	BS::OutStream oe;
+	oe << boxes;
+	std::string data = oe.str();
+	BS::OutStream om;
+	om << m;
+	std::string mdata = om.str();
+
+	//feed 5 bytes at a time, elements arrive as they complete
+	BS::IncrementalDecoder<std::vector<cbox> > dec([&](cbox &b) { boxes1.push_back(b); });
+	size_t seen_midway = 0;
+	for (size_t off = 0; off < data.size(); off += 5)
+	{
+		dec.push(data.data() + off, data.size() - off < 5 ? data.size() - off : 5);
+		if (off < data.size() / 2)
+			seen_midway = boxes1.size();
+	}
+	ASSERT_TRUE(dec.done());
+	ASSERT_TRUE(seen_midway > 0 && seen_midway < boxes.size());
+	ASSERT_EQ(boxes.size(), boxes1.size());
+	for (size_t i = 0; i < boxes.size() && i < boxes1.size(); ++i)
+	{
+		ASSERT_TRUE(boxes[i] == boxes1[i]);
+	}
+
+	BS::IncrementalDecoder<std::map<std::string, int> > mdec([&](const std::string &k, int &v) { m1[k] = v; });
+	for (size_t off = 0; off < mdata.size(); off += 3)
+	{
+		mdec.push(mdata.data() + off, mdata.size() - off < 3 ? mdata.size() - off : 3);
+	}
+	ASSERT_TRUE(mdec.done());
+	ASSERT_TRUE(m == m1);
+
+	double d = 0.0;
+	BS::IncrementalDecoder<double> ddec([&](double &v) { d = v; });
+	double pi = 3.14;
+	ASSERT_TRUE(!ddec.push((const char*)&pi, 3));
+	ASSERT_TRUE(ddec.push((const char*)&pi + 3, sizeof(pi) - 3));
+	ASSERT_EQ(d, pi);
+
+	//nested values resume where the last chunk stopped: one byte at a time
+	//gives what a whole decode gives, and only split scalars are held back
+	std::map<std::string, std::vector<int> > nested, nested1;
+	nested["small"] = std::vector<int>(3, 7);
+	for (int i = 0; i < 5000; ++i)
+	{
+		nested["large"].push_back(i);
+	}
+	nested["empty"];
+	BS::OutStream on;
+	on << nested;
+	std::string ndata = on.str();
+	BS::IncrementalDecoder<std::map<std::string, std::vector<int> > > ndec([&](const std::string &k, std::vector<int> &v) { nested1[k] = v; });
+	size_t most_held = 0;
+	for (size_t off = 0; off < ndata.size(); ++off)
+	{
+		ndec.push(ndata.data() + off, 1);
+		most_held = ndec.pending() > most_held ? ndec.pending() : most_held;
+	}
+	ASSERT_TRUE(ndec.done());
+	ASSERT_TRUE(nested == nested1);
+	ASSERT_TRUE(most_held < sizeof(int));
+
+	std::list<std::pair<int, std::string> > pairs, pairs1;
+	pairs.push_back(std::make_pair(1, std::string("one")));
+	pairs.push_back(std::make_pair(2, std::string()));
+	BS::OutStream op;
+	op << pairs;
+	std::string pdata = op.str();
+	BS::IncrementalDecoder<std::list<std::pair<int, std::string> > > pdec([&](std::pair<int, std::string> &v) { pairs1.push_back(v); });
+	for (size_t off = 0; off < pdata.size(); off += 2)
+	{
+		pdec.push(pdata.data() + off, pdata.size() - off < 2 ? pdata.size() - off : 2);
+	}
+	ASSERT_TRUE(pdec.done());
+	ASSERT_TRUE(pairs == pairs1);
+
+	//a huge count is not trusted: nothing is sized from it up front
+	const char huge[] = { '\xff', '\xff', '\xff', '\x7f' };
+	BS::IncrementalDecoder<std::map<std::string, int> > hdec([&](const std::string &, int &) {});
+	ASSERT_TRUE(!hdec.push(huge, sizeof(huge)));
+	ASSERT_TRUE(!hdec.error());
+	ASSERT_EQ(hdec.pending(), (size_t)0);
+
+	//after an error further chunks are dropped, not held
+	const char negative[] = { '\xff', '\xff', '\xff', '\xff' };
+	BS::IncrementalDecoder<std::vector<cbox> > edec([&](cbox &) {});
+	ASSERT_TRUE(!edec.push(negative, sizeof(negative)));
+	ASSERT_TRUE(edec.error());
+	std::string junk(1 << 16, 'x');
+	for (int i = 0; i < 16; ++i)
+	{
+		edec.push(junk.data(), junk.size());
+	}
+	ASSERT_EQ(edec.pending(), (size_t)0);
+}
+
+void TEST_Visitor() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_Visitor=================\n";
+	std::cout << "====================================\n";
+
+	std::vector<cbox> boxes;
+	int expect = 0;
+	for (int i = 0; i < 10; ++i)
+	{
+		boxes.push_back(cbox(i, 1.0, "visit"));
+		expect += i;
+	}
+	std::map<std::string, int> m;
+	m["first"] = 1;
+	m["second"] = 2;
+	m["third"] = 3;
+	std::vector<std::vector<int> > nested(3, std::vector<int>(4, 5));
+
+	BS::OutStream oe;
+	oe << boxes << boxes << m << nested;
+	std::string data = oe.str();
+	BS::InStream ie(data);
+
+	//aggregate without materializing the vector
+	int sum = 0;
+	ie.for_each<cbox>([&](cbox &b) { sum += b.a; });
+	ASSERT_EQ(sum, expect);
+
+	size_t batches = 0, count = 0;
+	ie.for_each_batch<cbox>(4, [&](std::vector<cbox> &batch) { ++batches; count += batch.size(); });
+	ASSERT_EQ(batches, (size_t)3);
+	ASSERT_EQ(count, boxes.size());
+
+	std::map<std::string, int> m1;
+	ie.for_each_entry<std::string, int>([&](std::string &k, int &v) { m1[k] = v; });
+	ASSERT_TRUE(m == m1);
+
+	int inner = 0;
+	ie.for_each_nested([&](BS::InStream &in, size_t) {
+		in.for_each<int>([&](int &v) { inner += v; });
+	});
+	ASSERT_EQ(inner, 3 * 4 * 5);
+	ASSERT_TRUE(ie.good());
+	ASSERT_EQ(ie.size(), (int)data.size());
+}
+
+void TEST_RecordLog() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_RecordLog=================\n";
+	std::cout << "====================================\n";
+
+	const char *file = "test_file\\test_recordlog.data";
+	std::remove(file);
+	{
+		BS::RecordLogWriter w(file, 256);
+		for (int i = 0; i < 100; ++i)
+		{
+			w.append(cbox(i, i * 0.5, "record"));
+		}
+	}
+	{
+		//reopening appends to the same file
+		BS::RecordLogWriter w(file);
+		ASSERT_EQ(w.records(), (uint64_t)100);
+		w.append(cbox(100, 50.0, "record"));
+	}
+
+	BS::RecordLogReader r(file);
+	ASSERT_TRUE(r.is_open());
+	cbox box;
+	int count = 0;
+	bool same = true;
+	while (r.next(box))
+	{
+		cbox expect(count, count * 0.5, "record");
+		same = same && box == expect;
+		++count;
+	}
+	ASSERT_EQ(count, 101);
+	ASSERT_TRUE(same);
+	ASSERT_TRUE(!r.truncated());
+	uint64_t good_end = r.valid_end();
+
+	//a torn frame at the end is skipped by readers and cut off by writers
+	{
+		std::ofstream f(file, std::ios_base::out | std::ios_base::binary | std::ios_base::app);
+		f.write("\x40\0\0\0garbage", 11);
+	}
+	BS::RecordLogReader r1(file);
+	count = 0;
+	while (r1.next(box))
+	{
+		++count;
+	}
+	ASSERT_EQ(count, 101);
+	ASSERT_TRUE(r1.truncated());
+	{
+		BS::RecordLogWriter w(file);
+		ASSERT_EQ(w.offset(), good_end);
+	}
+	BS::RecordLogReader r2(file);
+	ASSERT_EQ(r2.file_size(), good_end);
+
+	//so is a zero-filled tail: zeros never pass for an empty frame
+	{
+		std::ofstream f(file, std::ios_base::out | std::ios_base::binary | std::ios_base::app);
+		f.write(std::string(4096, '\0').data(), 4096);
+	}
+	BS::RecordLogReader r3(file);
+	count = 0;
+	while (r3.next(box))
+	{
+		++count;
+	}
+	ASSERT_EQ(count, 101);
+	ASSERT_TRUE(r3.truncated());
+	ASSERT_TRUE(!r3.undecodable());
+	{
+		BS::RecordLogWriter w(file);
+		ASSERT_EQ(w.records(), (uint64_t)101);
+		ASSERT_EQ(w.offset(), good_end);
+		w.append_raw("xy", 2); //a valid frame that is no cbox
+		w.append(cbox(101, 50.5, "record"));
+	}
+	BS::RecordLogIndex idx(file);
+	ASSERT_EQ(idx.size(), (size_t)103);
+
+	//a frame that does not decode is reported, and reading goes on after it
+	BS::RecordLogReader r4(file);
+	count = 0;
+	int undecodable = 0;
+	for (;;)
+	{
+		if (r4.next(box))
+			++count;
+		else if (r4.undecodable())
+			++undecodable;
+		else
+			break;
+	}
+	ASSERT_EQ(count, 102);
+	ASSERT_EQ(undecodable, 1);
+	ASSERT_EQ(box.a, 101);
+	ASSERT_TRUE(!r4.truncated());
+}
+
+void TEST_RecordIndex() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_RecordIndex=================\n";
+	std::cout << "====================================\n";
+
+	std::string file = "test_file\\test_recordindex.data";
+	std::remove(file.c_str());
+	std::remove((file + ".idx").c_str());
+	std::remove((file + ".keys").c_str());
+	std::remove((file + ".keydata").c_str());
+	{
+		BS::RecordLogWriter w(file, 128);
+		for (int i = 0; i < 50; ++i)
+		{
+			std::ostringstream key;
+			key << "key" << i;
+			w.append_keyed(key.str(), cbox(i, i * 2.0, "indexed"));
+		}
+	}
+
+	uint64_t last = 0;
+	{
+		//record number -> offset
+		BS::RecordLogIndex idx(file);
+		BS::RecordLogReader r(file);
+		ASSERT_EQ(idx.size(), (size_t)50);
+		cbox box;
+		ASSERT_TRUE(r.read_at(idx.offset(37), box));
+		ASSERT_EQ(box.a, 37);
+		last = idx.offset(49);
+
+		//user key -> offset
+		BS::RecordKeyIndex keys(file);
+		ASSERT_EQ(keys.size(), (size_t)50);
+		uint64_t off = 0;
+		ASSERT_TRUE(keys.find(std::string("key12"), off));
+		ASSERT_TRUE(r.read_at(off, box));
+		ASSERT_EQ(box.a, 12);
+		ASSERT_TRUE(!keys.find(std::string("missing"), off));
+	}
+
+	//a missing index is rebuilt when the writer reopens the log
+	std::remove((file + ".idx").c_str());
+	{
+		BS::RecordLogWriter w(file);
+	}
+	BS::RecordLogIndex idx1(file);
+	ASSERT_EQ(idx1.size(), (size_t)50);
+	ASSERT_EQ(idx1.offset(49), last);
+
+	//sync() appends the new key entries and patches their slots in place
+	//instead of rewriting the table; a repeated key is found at its latest
+	//record and counted once
+	size_t data_before = 0, data_after = 0, table_before = 0, table_after = 0;
+	{
+		std::ifstream in((file + ".keydata").c_str(), std::ios::binary | std::ios::ate);
+		data_before = (size_t)in.tellg();
+		std::ifstream tin((file + ".keys").c_str(), std::ios::binary | std::ios::ate);
+		table_before = (size_t)tin.tellg();
+	}
+	{
+		BS::RecordLogWriter w(file);
+		w.append_keyed(std::string("key12"), cbox(112, 1.0, "again"));
+		w.append_keyed(std::string("key50"), cbox(50, 1.0, "new"));
+		ASSERT_TRUE(w.sync());
+		std::ifstream in((file + ".keydata").c_str(), std::ios::binary | std::ios::ate);
+		data_after = (size_t)in.tellg();
+		std::ifstream tin((file + ".keys").c_str(), std::ios::binary | std::ios::ate);
+		table_after = (size_t)tin.tellg();
+	}
+	BS::OutStream k12;
+	k12 << std::string("key12");
+	ASSERT_EQ(data_after - data_before, 2 * (BS::RECORD_KEY_HEADER + k12.str().size()));
+	ASSERT_EQ(table_after, table_before);
+	BS::RecordKeyIndex keys1(file);
+	BS::RecordLogReader r1(file);
+	ASSERT_EQ(keys1.size(), (size_t)51);
+	uint64_t off = 0;
+	cbox box;
+	ASSERT_TRUE(keys1.find(std::string("key12"), off) && r1.read_at(off, box));
+	ASSERT_EQ(box.a, 112);
+	ASSERT_TRUE(keys1.find(std::string("key50"), off) && r1.read_at(off, box));
+	ASSERT_EQ(box.a, 50);
+	ASSERT_TRUE(keys1.find_encoded(k12.str().data(), k12.str().size(), off) && r1.read_at(off, box));
+	ASSERT_EQ(box.a, 112);
+
+	//keys match on their encoded bytes, not the hash alone
+	ASSERT_TRUE(!keys1.find(std::string("key99"), off));
+	ASSERT_TRUE(!keys1.find(12, off));
+
+	//a lost table is rebuilt from the entries when the writer reopens
+	std::remove((file + ".keys").c_str());
+	{
+		BS::RecordLogWriter w(file);
+	}
+	BS::RecordKeyIndex keys2(file);
+	ASSERT_EQ(keys2.size(), (size_t)51);
+	ASSERT_TRUE(keys2.find(std::string("key12"), off) && r1.read_at(off, box));
+	ASSERT_EQ(box.a, 112);
+}
+
+void TEST_SortedTable() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_SortedTable=================\n";
+	std::cout << "====================================\n";
+
+	std::map<std::string, int> m;
+	for (int i = 0; i < 1000; ++i)
+	{
+		std::ostringstream key;
+		key << "key" << (10000 + i * 2); //even numbers only
+		m[key.str()] = i;
+	}
+	const char *file = "test_file\\test_sortedtable.data";
+	ASSERT_TRUE(BS::write_sorted_table(m, file, 256));
+
+	BS::SortedTable<std::string, int> t(file);
+	ASSERT_TRUE(t.is_open());
+	ASSERT_EQ(t.size(), m.size());
+
+	//point lookups
+	int v = -1;
+	ASSERT_TRUE(t.get("key10000", v) && v == 0);
+	ASSERT_TRUE(t.get("key11000", v) && v == 500);
+	ASSERT_TRUE(t.get("key11998", v) && v == 999);
+	ASSERT_TRUE(!t.get("key10001", v));
+	ASSERT_TRUE(!t.get("aaa", v));
+	ASSERT_TRUE(!t.get("zzz", v));
+
+	//range [lo, hi)
+	std::vector<int> got;
+	size_t n = t.range("key10100", "key10120", [&](const std::string &, int &val) { got.push_back(val); });
+	ASSERT_EQ(n, (size_t)10);
+	ASSERT_TRUE(got.size() == 10 && got.front() == 50 && got.back() == 59);
+
+	//every key is found
+	bool all = true;
+	for (std::map<std::string, int>::const_iterator it = m.begin(); it != m.end(); ++it)
+	{
+		all = all && t.get(it->first, v) && v == it->second;
+	}
+	ASSERT_TRUE(all);
+}
+
+void TEST_PersistentMap() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_PersistentMap===============\n";
+	std::cout << "====================================\n";
+
+	const char *file = "test_file\\test_pmap";
+	//start from nothing
+	std::remove((std::string(file) + ".base").c_str());
+	std::remove((std::string(file) + ".manifest").c_str());
+	for (int g = 1; g <= 8; ++g)
+	{
+		std::ostringstream wal;
+		wal << file << ".wal." << g;
+		std::remove(wal.str().c_str());
+	}
+	std::map<int, std::string> expect;
+	{
+		BS::PersistentMap<int, std::string> pm(file);
+		for (int i = 0; i < 200; ++i)
+		{
+			std::ostringstream os;
+			os << "v" << i;
+			pm.put(i, os.str());
+			expect[i] = os.str();
+		}
+		ASSERT_TRUE(pm.compact());
+		//changes after the compaction only live in the log
+		for (int i = 0; i < 200; i += 3)
+		{
+			pm.erase(i);
+			expect.erase(i);
+		}
+		pm.put(7, "seven");
+		expect[7] = "seven";
+		pm.put(1000, "last");
+		expect[1000] = "last";
+		ASSERT_TRUE(pm.sync());
+		ASSERT_TRUE(pm.snapshot() == expect);
+	}
+
+	//recovery: base plus the log replayed on top
+	{
+		BS::PersistentMap<int, std::string> pm(file);
+		ASSERT_TRUE(pm.snapshot() == expect);
+		std::string v;
+		ASSERT_TRUE(pm.get(7, v) && v == "seven");
+		ASSERT_TRUE(!pm.get(3, v));
+
+		//background compaction folds the log into a new base
+		pm.start_compactor(1, 10);
+		for (int i = 0; i < 50 && pm.pending_ops() > 0; ++i)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		pm.put(2000, "after");
+		expect[2000] = "after";
+		pm.stop_compactor();
+		pm.sync();
+	}
+	{
+		BS::PersistentMap<int, std::string> pm(file);
+		ASSERT_TRUE(pm.snapshot() == expect);
+		ASSERT_TRUE(pm.compact());
+		std::map<int, std::string> base;
+		BS::MappedFile f(std::string(file) + ".base");
+		BS::InStream ie(f.data(), f.size());
+		ie >> base;
+		ASSERT_TRUE(base == expect);
+	}
+
+	//a truncated base fails recovery instead of loading part of the map,
+	//and nothing is logged on top of it
+	std::string base_name = std::string(file) + ".base";
+	std::string whole;
+	{
+		BS::MappedFile f(base_name);
+		whole.assign(f.data(), f.size());
+	}
+	{
+		std::ofstream out(base_name.c_str(), std::ios::binary | std::ios::trunc);
+		out.write(whole.data(), whole.size() - 5);
+	}
+	{
+		BS::PersistentMap<int, std::string> pm(file);
+		ASSERT_TRUE(!pm.is_open());
+		ASSERT_TRUE(!pm.put(1, "lost"));
+		ASSERT_TRUE(!pm.erase(1));
+		ASSERT_EQ(pm.size(), (size_t)0);
+		ASSERT_TRUE(!pm.sync());
+		ASSERT_TRUE(!pm.compact());
+	}
+	{
+		std::ofstream out(base_name.c_str(), std::ios::binary | std::ios::trunc);
+		out.write(whole.data(), whole.size());
+	}
+	{
+		BS::PersistentMap<int, std::string> pm(file);
+		ASSERT_TRUE(pm.is_open());
+		ASSERT_TRUE(pm.snapshot() == expect);
+		ASSERT_TRUE(pm.put(3000, "ok") && pm.erase(3000));
+	}
+}
+
+void TEST_Snapshot() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_Snapshot====================\n";
+	std::cout << "====================================\n";
+
+	std::map<int, std::string> live;
+	for (int i = 0; i < 20000; ++i)
+	{
+		live[i] = "value";
+	}
+	std::map<int, std::string> at_start = live;
+
+	const char *file = "test_file\\test_snapshot.data";
+	std::atomic<int> reported(-1);
+	BS::BackgroundSnapshot snap;
+	ASSERT_TRUE(BS::snapshot_to_binaryfile(snap, live, file, [&](bool ok) { reported = ok; }));
+
+	//the parent keeps changing its copy while the child writes
+	for (int i = 0; i < 20000; i += 2)
+	{
+		live[i] = "changed";
+	}
+	live.erase(1);
+
+	ASSERT_TRUE(snap.wait());
+	ASSERT_TRUE(snap.status() == BS::SNAPSHOT_DONE);
+	ASSERT_EQ(reported.load(), 1);
+
+	std::map<int, std::string> loaded;
+	BS::desrialize_from_binaryfile(loaded, file);
+	ASSERT_TRUE(loaded == at_start);
+
+	//custom writer, several objects in one file
+	std::vector<int> v(100, 7);
+	std::string name = "snap";
+	ASSERT_TRUE(snap.start(file, [&](BS::FileOutStream &out) { out << v << name; }));
+	ASSERT_TRUE(snap.wait());
+	BS::MappedFile f(file);
+	BS::InStream ie(f.data(), f.size());
+	std::vector<int> v1;
+	std::string name1;
+	ie >> v1 >> name1;
+	ASSERT_TRUE(ie.good() && v1 == v && name1 == name);
+}
+
+void TEST_Delta() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_Delta=======================\n";
+	std::cout << "====================================\n";
+
+	//map: erase, insert and modify a few of many entries
+	std::map<int, std::string> base;
+	for (int i = 0; i < 1000; ++i)
+	{
+		base[i] = "value";
+	}
+	std::map<int, std::string> cur = base;
+	cur.erase(10);
+	cur.erase(999);
+	cur[5000] = "new";
+	cur[20] = "changed";
+	std::string patch = BS::serialize_delta(base, cur);
+	ASSERT_TRUE(patch.size() < 100);
+	std::map<int, std::string> replica = base;
+	ASSERT_TRUE(BS::apply_delta(replica, patch));
+	ASSERT_TRUE(replica == cur);
+	//a patch only applies to the version it was taken against
+	ASSERT_TRUE(!BS::apply_delta(replica, patch));
+	ASSERT_TRUE(replica == cur);
+
+	//set
+	std::set<std::string> s0, s1;
+	s0.insert("a"); s0.insert("b"); s0.insert("c");
+	s1.insert("b"); s1.insert("c"); s1.insert("d");
+	std::set<std::string> s2 = s0;
+	ASSERT_TRUE(BS::apply_delta(s2, BS::serialize_delta(s0, s1)));
+	ASSERT_TRUE(s2 == s1);
+
+	//vector: changed runs, growth and shrinking
+	std::vector<int> v0(10000, 1);
+	std::vector<int> v1 = v0;
+	v1[3] = 2;
+	v1[5] = 2;
+	v1[9000] = 3;
+	v1.push_back(4);
+	patch = BS::serialize_delta(v0, v1);
+	ASSERT_TRUE(patch.size() < 100);
+	std::vector<int> v2 = v0;
+	ASSERT_TRUE(BS::apply_delta(v2, patch));
+	ASSERT_TRUE(v2 == v1);
+	std::vector<int> v3(v0.begin(), v0.begin() + 100);
+	v2 = v0;
+	ASSERT_TRUE(BS::apply_delta(v2, BS::serialize_delta(v0, v3)));
+	ASSERT_TRUE(v2 == v3);
+
+	//patches can follow each other in one stream
+	BS::OutStream oe;
+	BS::write_delta(oe, v0, v1);
+	BS::write_delta(oe, v1, v3);
+	std::string patches = oe.str();
+	BS::InStream ie(patches);
+	v2 = v0;
+	ie.apply_delta(v2);
+	ASSERT_TRUE(v2 == v1);
+	ie.apply_delta(v2);
+	ASSERT_TRUE(ie.good() && v2 == v3);
+}
+
+void TEST_ChunkStore() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_ChunkStore==================\n";
+	std::cout << "====================================\n";
+
+	BS::ChunkStore store("test_file\\test_chunks");
+	store.remove("hour1");
+	store.remove("hour2");
+	store.collect();
+
+	std::map<int, std::string> state;
+	for (int i = 0; i < 20000; ++i)
+	{
+		std::ostringstream os;
+		os << "value of " << i;
+		state[i] = os.str();
+	}
+	BS::ChunkStats s1, s2;
+	ASSERT_TRUE(store.save("hour1", state, &s1));
+	ASSERT_TRUE(s1.chunks > 1 && s1.new_chunks == s1.chunks);
+
+	//a small change: most chunks are shared with the first snapshot
+	state[100] = "changed";
+	state.erase(15000);
+	std::map<int, std::string> hour2 = state;
+	ASSERT_TRUE(store.save("hour2", state, &s2));
+	ASSERT_EQ(s2.bytes, (uint64_t)BS::serialized_size(state));
+	ASSERT_TRUE(s2.new_bytes * 5 < s2.bytes);
+
+	std::map<int, std::string> back;
+	ASSERT_TRUE(store.restore("hour2", back));
+	ASSERT_TRUE(back == hour2);
+
+	//dropping the first snapshot frees only its own chunks
+	ASSERT_TRUE(store.remove("hour1"));
+	ASSERT_TRUE(store.collect() > 0);
+	ASSERT_EQ(store.collect(), (size_t)0);
+	back.clear();
+	BS::ChunkReader r(store, "hour2");
+	ASSERT_TRUE(r.is_open());
+	r.stream() >> back;
+	ASSERT_TRUE(r.stream().good() && back == hour2);
+	ASSERT_TRUE(!store.restore("hour1", back));
+
+	//two chunks mapped at a time: visiting keys and values in step moves
+	//back and forth between chunks that have to be mapped again
+	ASSERT_TRUE(r.count() > 4);
+	BS::ChunkReader r2(store, "hour2", 2);
+	std::map<int, std::string> visited;
+	r2.stream().for_each_entry<int, std::string>([&](int &k, std::string &v) { visited[k] = v; });
+	ASSERT_TRUE(r2.stream().good() && visited == hour2);
+
+	//a damaged chunk fails the stream when the reads reach it
+	BS::IoSlice last;
+	ASSERT_TRUE(r2.segment(r2.count() - 1, last));
+	std::string saved(last.base, last.len);
+	std::string path;
+	{
+		std::vector<BS::ChunkRef> refs;
+		uint64_t total = 0;
+		ASSERT_TRUE(store.load_manifest("hour2", refs, total));
+		path = store.chunk_path(refs.back());
+	}
+	{
+		std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+		out.write(saved.data(), saved.size() - 1);
+		out.put((char)(saved[saved.size() - 1] ^ 1));
+	}
+	back.clear();
+	BS::ChunkReader r3(store, "hour2");
+	ASSERT_TRUE(r3.is_open());
+	r3.stream() >> back;
+	ASSERT_TRUE(!r3.stream().good());
+	{
+		std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+		out.write(saved.data(), saved.size());
+	}
+	back.clear();
+	ASSERT_TRUE(store.restore("hour2", back) && back == hour2);
+}
+
+void TEST_Checksum() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_Checksum====================\n";
+	std::cout << "====================================\n";
+
+	//known answers, and the hardware CRC agrees with the table
+	ASSERT_EQ(BS::crc32c("123456789", 9), 0xE3069283u);
+	ASSERT_EQ(BS::crc32c_table("123456789", 9), 0xE3069283u);
+	std::string bytes;
+	for (int i = 0; i < 100; ++i)
+	{
+		bytes += (char)i;
+	}
+	ASSERT_EQ(BS::crc32c(bytes.data(), 37, BS::crc32c(bytes.data() + 37, 0)), BS::crc32c_table(bytes.data(), 37));
+	BS::Hash64 h0, h1, h2;
+	h1.update("abc", 3);
+	for (size_t i = 0; i < bytes.size(); i += 7)
+	{
+		h2.update(bytes.data() + i, bytes.size() - i < 7 ? bytes.size() - i : 7);
+	}
+	ASSERT_TRUE(h0.digest() == 0xEF46DB3751D8E999ull);
+	ASSERT_TRUE(h1.digest() == 0x44BC2CF5AD770999ull);
+	ASSERT_TRUE(h2.digest() == 0x6AC1E58032166597ull);
+
+	//in memory: the trailer covers exactly the encoded bytes
+	std::map<std::string, std::vector<int> > m;
+	m["a"] = std::vector<int>(1000, 1);
+	m["b"] = std::vector<int>(10, 2);
+	std::string name = "checked";
+	BS::CheckedOutStream oe;
+	oe << m << name;
+	BS::ChecksumTrailer t = oe.finish();
+	std::string data = oe.str();
+	ASSERT_EQ(t.length, (uint64_t)data.size() - sizeof(t));
+	ASSERT_EQ(t.crc, BS::crc32c(data.data(), (size_t)t.length));
+
+	std::map<std::string, std::vector<int> > m1;
+	std::string name1;
+	BS::CheckedInStream ie(data);
+	ie >> m1 >> name1;
+	ASSERT_TRUE(ie.verify() && m1 == m && name1 == name);
+	ASSERT_TRUE(ie.trailer().hash == t.hash);
+
+	//a flipped bit is caught
+	data[100] ^= 1;
+	BS::CheckedInStream bad(data);
+	bad >> m1 >> name1;
+	ASSERT_TRUE(!bad.verify());
+
+	//file sink
+	const char *file = "test_file\\test_checked.data";
+	BS::ChecksumTrailer ft;
+	ASSERT_TRUE(BS::serialize_to_checked_file(m, file, &ft));
+	BS::CheckedOutStream om;
+	om << m;
+	ASSERT_TRUE(ft.hash == om.checksum().hash && ft.crc == om.checksum().crc);
+	m1.clear();
+	ASSERT_TRUE(BS::deserialize_from_checked_file(m1, file));
+	ASSERT_TRUE(m1 == m);
+}
+
+void TEST_XMLStreamWriter() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_XMLStreamWriter=============\n";
+	std::cout << "====================================\n";
+
+	//large and nested values go out through the printer, no DOM is built
+	std::vector<int> big(200000);
+	for (size_t i = 0; i < big.size(); ++i)
+	{
+		big[i] = (int)i;
+	}
+	std::vector<int> big1;
+	XML_Seri::serialize_xml(big, "big", "test_file\\test_bigvector.xml");
+	XML_Seri::deserialize_xml(big1, "big", "test_file\\test_bigvector.xml");
+	ASSERT_TRUE(big1 == big);
+
+	std::map<std::string, std::vector<double> > m, m1;
+	m["a & b"].push_back(1.5);
+	m["<c>"].push_back(-2.25);
+	m["<c>"].push_back(1e10);
+	XML_Seri::serialize_xml(m, "nested", "test_file\\test_nested.xml");
+	XML_Seri::deserialize_xml(m1, "nested", "test_file\\test_nested.xml");
+	ASSERT_TRUE(m1 == m);
+
+	//custom layouts write through XMLFileWriter
+	{
+		XML_Seri::XMLFileWriter xmlFile("test_file\\test_printer.xml");
+		ASSERT_TRUE(xmlFile.is_open());
+		xmlFile.printer().OpenElement("serialization");
+		XML_Seri::XMLBase::VarType<int>::print(xmlFile.printer(), "count", 3);
+		xmlFile.printer().CloseElement();
+	}
+	int count = 0;
+	XML_Seri::deserialize_xml(count, "count", "test_file\\test_printer.xml");
+	ASSERT_EQ(count, 3);
+}
+
+void TEST_XMLPullReader() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_XMLPullReader===============\n";
+	std::cout << "====================================\n";
+
+	//event stream of a small document
+	const char *xml = "<?xml version=\"1.0\"?><!-- c --><root id='7' name=\"a&amp;b\">"
+		"<v>1 &lt; 2</v><e/><d><![CDATA[<raw>]]></d>\n</root>";
+	XML_Seri::XMLPullReader r(xml, xml + strlen(xml));
+	ASSERT_TRUE(r.next() == XML_Seri::XMLPullReader::START_ELEMENT && r.name() == "root");
+	ASSERT_TRUE(std::string(r.attribute("id")) == "7" && std::string(r.attribute("name")) == "a&b");
+	ASSERT_TRUE(r.attribute("none") == NULL);
+	ASSERT_TRUE(r.next() == XML_Seri::XMLPullReader::START_ELEMENT && r.name() == "v");
+	ASSERT_TRUE(r.next() == XML_Seri::XMLPullReader::TEXT && r.text() == "1 < 2");
+	ASSERT_TRUE(r.next() == XML_Seri::XMLPullReader::END_ELEMENT && r.name() == "v");
+	ASSERT_TRUE(r.next() == XML_Seri::XMLPullReader::START_ELEMENT && r.name() == "e");
+	ASSERT_TRUE(r.next() == XML_Seri::XMLPullReader::END_ELEMENT && r.name() == "e");
+	ASSERT_TRUE(r.next_element() && r.read_text() == "<raw>");
+	ASSERT_TRUE(r.next() == XML_Seri::XMLPullReader::END_ELEMENT && r.depth() == 0);
+	ASSERT_TRUE(r.next() == XML_Seri::XMLPullReader::END_DOCUMENT && r.good());
+
+	//mismatched tags are an error
+	const char *bad = "<a><b></a>";
+	XML_Seri::XMLPullReader rb(bad, bad + strlen(bad));
+	rb.next();
+	rb.next();
+	ASSERT_TRUE(rb.next() == XML_Seri::XMLPullReader::PARSE_ERROR && !rb.good());
+
+	//a tiny block size forces tokens across refills
+	std::vector<std::string> v, v1;
+	for (int i = 0; i < 500; ++i)
+	{
+		std::ostringstream os;
+		os << "item <" << i << "> & more";
+		v.push_back(os.str());
+	}
+	XML_Seri::serialize_xml(v, "strings", "test_file\\test_pull.xml");
+	XML_Seri::XMLPullReader in("test_file\\test_pull.xml", 16);
+	ASSERT_TRUE(in.is_open() && in.next_element() && in.next_element());
+	XML_Seri::XMLBase::VarType<std::vector<std::string> >::reader(in, v1);
+	ASSERT_TRUE(in.good() && v1 == v);
+}
+
+void TEST_XMLInSitu() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_XMLInSitu===================\n";
+	std::cout << "====================================\n";
+
+	std::map<std::string, std::vector<int> > m, m1;
+	for (int i = 0; i < 300; ++i)
+	{
+		std::ostringstream key;
+		key << "key & " << i;
+		m[key.str()] = std::vector<int>(i % 7, i);
+	}
+	XML_Seri::serialize_xml(m, "map", "test_file\\test_insitu.xml");
+	tinyxml2::XMLDocument *xmlDoc = XML_Seri::ReadFromFileInSitu("test_file\\test_insitu.xml");
+	ASSERT_TRUE(!xmlDoc->Error());
+	XML_Seri::XMLBase::VarType<std::map<std::string, std::vector<int> > >::reader(xmlDoc->RootElement()->FirstChildElement(), m1);
+	delete xmlDoc;
+	ASSERT_TRUE(m1 == m);
+
+	//a file filling whole pages still gets its terminator
+	std::string xml = "<?xml version=\"1.0\"?><serialization><int>42</int></serialization>";
+	xml.insert(xml.size() - 16, 4096 * 2 - xml.size(), ' ');
+	std::ofstream("test_file\\test_insitu_page.xml", std::ios::binary) << xml;
+	XML_Seri::XMLMappedDocument doc;
+	ASSERT_TRUE(doc.LoadFileInSitu("test_file\\test_insitu_page.xml") == tinyxml2::XML_SUCCESS);
+	int v = 0;
+	XML_Seri::XMLBase::VarType<int>::reader(doc.RootElement()->FirstChildElement(), v);
+	ASSERT_EQ(v, 42);
+
+	ASSERT_TRUE(doc.LoadFileInSitu("test_file\\no_such_file.xml") != tinyxml2::XML_SUCCESS);
+}
+
+//parse with every scanner the CPU has and compare with the byte-at-a-time one
+void TEST_XMLScan() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_XMLScan=====================\n";
+	std::cout << "====================================\n";
+
+	std::string xml = "<?xml version=\"1.0\"?>\r\n<root>";
+	for (int i = 0; i < 200; ++i)
+	{
+		std::string name = "n" + std::string(i % 41, i % 2 ? 'a' : '_') + "-9.:x";
+		xml += std::string(i % 37, ' ') + "\n" + std::string(i % 5, '\t');
+		xml += "<" + name + " attr" + std::to_string(i) + "=\"v &amp; " + std::string(i % 33, 'z') + "\">";
+		xml += std::string(i % 70, 'x') + "&lt;" + (i % 3 ? "\r\n" : "\n\r") + "&#x4e2d;" + std::string(i % 19, '\n') + "&gt;";
+		xml += "</" + name + ">";
+	}
+	xml += "<!-- " + std::string(100, '-') + "x\n\n -->\n</root>";
+
+	const int best = tinyxml2::XMLUtil::ScanLevel();
+	std::vector<std::string> printed;
+	std::vector<std::vector<int> > lines;
+	for (int level = tinyxml2::XMLUtil::SCAN_SCALAR; level <= best; ++level)
+	{
+		ASSERT_EQ(tinyxml2::XMLUtil::SetScanLevel(level), level);
+		//every start offset within a vector block
+		for (size_t shift = 0; shift < 32; shift += 7)
+		{
+			std::string padded = std::string(shift, ' ') + xml;
+			tinyxml2::XMLDocument doc;
+			ASSERT_TRUE(doc.Parse(padded.c_str(), padded.size()) == tinyxml2::XML_SUCCESS);
+			std::vector<int> l;
+			for (tinyxml2::XMLElement *e = doc.RootElement()->FirstChildElement(); e; e = e->NextSiblingElement())
+			{
+				l.push_back(e->GetLineNum());
+			}
+			tinyxml2::XMLPrinter printer;
+			doc.Print(&printer);
+			printed.push_back(printer.CStr());
+			lines.push_back(l);
+		}
+	}
+	tinyxml2::XMLUtil::SetScanLevel(best);
+	std::cout << "scan level " << best << ", " << lines[0].size() << " elements, last on line " << lines[0].back() << std::endl;
+	ASSERT_EQ(lines[0].size(), (size_t)200);
+	for (size_t i = 1; i < printed.size(); ++i)
+	{
+		ASSERT_TRUE(printed[i] == printed[0]);
+		ASSERT_TRUE(lines[i] == lines[0]);
+	}
+
+	//unterminated text still fails
+	tinyxml2::XMLDocument bad;
+	ASSERT_TRUE(bad.Parse("<a>text without end") != tinyxml2::XML_SUCCESS);
+}
+
+void TEST_XMLNoLineNumbers() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_XMLNoLineNumbers============\n";
+	std::cout << "====================================\n";
+
+	std::string xml = "<?xml version=\"1.0\"?>\n<root>\n";
+	for (int i = 0; i < 50; ++i)
+	{
+		xml += "\t<item id=\"" + std::to_string(i) + "\">\n\t\tvalue &amp; " + std::to_string(i) + "\n\t</item>\n";
+	}
+	xml += "</root>\n";
+
+	tinyxml2::XMLDocument counted, fast;
+	fast.SetTrackLineNumbers(false);
+	ASSERT_TRUE(counted.Parse(xml.c_str()) == tinyxml2::XML_SUCCESS);
+	ASSERT_TRUE(fast.Parse(xml.c_str()) == tinyxml2::XML_SUCCESS);
+	tinyxml2::XMLPrinter p1, p2;
+	counted.Print(&p1);
+	fast.Print(&p2);
+	ASSERT_TRUE(std::string(p1.CStr()) == p2.CStr());
+	ASSERT_EQ(counted.RootElement()->LastChildElement()->GetLineNum(), 150);
+	ASSERT_EQ(fast.RootElement()->LastChildElement()->GetLineNum(), 0);
+
+	//an error is still reported on its line, by a second, counting parse
+	std::string bad = xml;
+	bad.replace(bad.find("<item id=\"30\">"), 15, "<item id=30>");
+	ASSERT_TRUE(counted.Parse(bad.c_str()) != tinyxml2::XML_SUCCESS);
+	ASSERT_TRUE(fast.Parse(bad.c_str()) != tinyxml2::XML_SUCCESS);
+	ASSERT_EQ(fast.ErrorLineNum(), counted.ErrorLineNum());
+	ASSERT_EQ(fast.ErrorLineNum(), 93);
+	ASSERT_TRUE(!fast.TrackLineNumbers());
+
+	std::ofstream("test_file\\test_bad_lines.xml", std::ios::binary) << bad;
+	ASSERT_TRUE(fast.LoadFile("test_file\\test_bad_lines.xml") != tinyxml2::XML_SUCCESS);
+	ASSERT_EQ(fast.ErrorLineNum(), 93);
+	tinyxml2::XMLDocument *mapped = XML_Seri::ReadFromFileInSitu("test_file\\test_bad_lines.xml");
+	ASSERT_EQ(mapped->ErrorLineNum(), 93);
+	delete mapped;
+}
+
+void TEST_XMLNumbers() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_XMLNumbers==================\n";
+	std::cout << "====================================\n";
+
+	//shortest text that reads back to the same bits
+	char buf[tinyxml2::XMLUtil::MAX_NUMBER_CHARS + 1];
+	double d[] = { 0.1, 3.1, -6.6, 1e100, 5e-324, 1.7976931348623157e308, 1e-5, 123456789.0, 1.0 / 3 };
+	const char *text[] = { "0.1", "3.1", "-6.6", "1e+100", "5e-324", "1.7976931348623157e+308", "1e-05", "123456789", "0.3333333333333333" };
+	for (int i = 0; i < 9; ++i)
+	{
+		*tinyxml2::XMLUtil::AppendNumber(d[i], buf) = 0;
+		ASSERT_TRUE(std::string(buf) == text[i]);
+	}
+	*tinyxml2::XMLUtil::AppendNumber(0.1f, buf) = 0;
+	ASSERT_TRUE(std::string(buf) == "0.1");
+
+	uint64_t bits = 7;
+	bool same = true;
+	for (int i = 0; i < 100000; ++i)
+	{
+		bits = bits * 6364136223846793005ULL + 1442695040888963407ULL; //random bit patterns
+		double v, r;
+		memcpy(&v, &bits, sizeof(v));
+		if (v != v || v - v != 0)
+			continue;
+		tinyxml2::XMLUtil::ToStr(v, buf, sizeof(buf));
+		same = same && tinyxml2::XMLUtil::ToDouble(buf, &r) && memcmp(&r, &v, sizeof(v)) == 0;
+
+		float f, fr;
+		uint32_t fbits = (uint32_t)bits;
+		memcpy(&f, &fbits, sizeof(f));
+		if (f != f || f - f != 0)
+			continue;
+		tinyxml2::XMLUtil::ToStr(f, buf, sizeof(buf));
+		same = same && tinyxml2::XMLUtil::ToFloat(buf, &fr) && memcmp(&fr, &f, sizeof(f)) == 0;
+	}
+	ASSERT_TRUE(same);
+
+	int iv = 0;
+	int64_t lv = 0;
+	unsigned uv = 0;
+	ASSERT_TRUE(tinyxml2::XMLUtil::ToInt(" -2147483648", &iv) && iv == INT_MIN);
+	ASSERT_TRUE(tinyxml2::XMLUtil::ToInt("0x1A", &iv) && iv == 26);
+	ASSERT_TRUE(tinyxml2::XMLUtil::ToUnsigned("4294967295", &uv) && uv == 4294967295u);
+	ASSERT_TRUE(tinyxml2::XMLUtil::ToInt64("-9223372036854775808", &lv) && lv == INT64_MIN);
+	ASSERT_TRUE(!tinyxml2::XMLUtil::ToInt("abc", &iv));
+
+	std::vector<double> v, v1;
+	for (int i = 0; i < 1000; ++i)
+	{
+		v.push_back(i * 0.37 + 1.0 / (i + 1));
+	}
+	XML_Seri::serialize_xml(v, "std_vector_double", "test_file\\test_vector_double.xml");
+	XML_Seri::deserialize_xml(v1, "std_vector_double", "test_file\\test_vector_double.xml");
+	ASSERT_TRUE(v1 == v);
+}
+
+void TEST_XMLCompactArray() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_XMLCompactArray=============\n";
+	std::cout << "====================================\n";
+
+	//base64 codec against RFC 4648 vectors, and the SIMD path on odd lengths
+	ASSERT_TRUE(XML_Seri::base64_encode("foobar", 6) == "Zm9vYmFy");
+	ASSERT_TRUE(XML_Seri::base64_encode("fooba", 5) == "Zm9vYmE=");
+	ASSERT_TRUE(XML_Seri::base64_encode("foob", 4) == "Zm9vYg==");
+	std::string bytes;
+	for (int i = 0; i < 300; ++i)
+	{
+		bytes += (char)(i * 37 + 11);
+	}
+	bool same = true;
+	for (size_t n = 0; n <= bytes.size(); n += 7)
+	{
+		std::string enc = XML_Seri::base64_encode(bytes.data(), n);
+		enc.insert(enc.size() / 2, "\n  "); //white space is skipped
+		std::vector<char> out(n + 3);
+		size_t len = 0;
+		same = same && XML_Seri::base64_decode(enc.data(), enc.size(), &out[0], out.size(), len)
+			&& len == n && memcmp(&out[0], bytes.data(), n) == 0;
+	}
+	ASSERT_TRUE(same);
+	size_t len = 0;
+	char out[8];
+	ASSERT_TRUE(!XML_Seri::base64_decode("Zm9v*mFy", 8, out, sizeof(out), len));
+
+	std::vector<double> d, d1, d2;
+	std::vector<int> iv, iv1;
+	std::list<float> fl, fl1;
+	std::set<int> s, s1;
+	for (int i = 0; i < 1001; ++i)
+	{
+		d.push_back(i * 0.37 - 1.0 / (i + 1));
+		iv.push_back(i * 7919 - 500000);
+		fl.push_back(i / 3.0f);
+		s.insert(i * i);
+	}
+
+	XML_Seri::XMLArrayFormat formats[] = { XML_Seri::XML_ARRAY_TEXT, XML_Seri::XML_ARRAY_BASE64 };
+	for (int f = 0; f < 2; ++f)
+	{
+		d1.clear(); d2.clear(); iv1.clear(); fl1.clear(); s1.clear();
+		XML_Seri::serialize_xml(d, "std_vector_double", "test_file\\test_compact_double.xml", formats[f]);
+		XML_Seri::deserialize_xml(d1, "std_vector_double", "test_file\\test_compact_double.xml");
+		ASSERT_TRUE(d1 == d);
+		tinyxml2::XMLDocument *xmlDoc = XML_Seri::ReadFromFile("test_file\\test_compact_double.xml");
+		XML_Seri::XMLBase::VarType<std::vector<double> >::reader(xmlDoc->RootElement()->FirstChildElement(), d2);
+		delete xmlDoc;
+		ASSERT_TRUE(d2 == d);
+
+		XML_Seri::serialize_xml(iv, "std_vector_int", "test_file\\test_compact_int.xml", formats[f]);
+		XML_Seri::deserialize_xml(iv1, "std_vector_int", "test_file\\test_compact_int.xml");
+		ASSERT_TRUE(iv1 == iv);
+		XML_Seri::serialize_xml(fl, "std_list_float", "test_file\\test_compact_float.xml", formats[f]);
+		XML_Seri::deserialize_xml(fl1, "std_list_float", "test_file\\test_compact_float.xml");
+		ASSERT_TRUE(fl1 == fl);
+		XML_Seri::serialize_xml(s, "std_set_int", "test_file\\test_compact_set.xml", formats[f]);
+		XML_Seri::deserialize_xml(s1, "std_set_int", "test_file\\test_compact_set.xml");
+		ASSERT_TRUE(s1 == s);
+	}
+	ASSERT_TRUE(XML_Seri::xml_array_format() == XML_Seri::XML_ARRAY_ITEMS);
+
+	//empty arrays and the DOM writer
+	std::vector<double> empty, e1;
+	tinyxml2::XMLDocument doc;
+	doc.InsertEndChild(doc.NewElement("serialization"));
+	XML_Seri::xml_array_format() = XML_Seri::XML_ARRAY_BASE64;
+	XML_Seri::XMLBase::VarType<std::vector<double> >::writer(doc.RootElement(), "empty", empty);
+	XML_Seri::XMLBase::VarType<std::vector<double> >::writer(doc.RootElement(), "d", d);
+	XML_Seri::xml_array_format() = XML_Seri::XML_ARRAY_ITEMS;
+	XML_Seri::XMLBase::VarType<std::vector<double> >::reader(doc.RootElement()->FirstChildElement(), e1);
+	ASSERT_TRUE(e1.empty());
+	d1.clear();
+	XML_Seri::XMLBase::VarType<std::vector<double> >::reader(doc.RootElement()->LastChildElement(), d1);
+	ASSERT_TRUE(d1 == d);
+
+	//a wrong count is not taken for a complete array
+	std::vector<int> bad;
+	ASSERT_TRUE(!XML_Seri::XMLArray<int>::decode("text", "3", "1 2", bad));
+
+	//one text node instead of an element per value
+	auto file_size = [](const char *name) { return (long long)std::ifstream(name, std::ios::binary | std::ios::ate).tellg(); };
+	long long size[3];
+	XML_Seri::XMLArrayFormat all[] = { XML_Seri::XML_ARRAY_ITEMS, XML_Seri::XML_ARRAY_TEXT, XML_Seri::XML_ARRAY_BASE64 };
+	for (int f = 0; f < 3; ++f)
+	{
+		XML_Seri::serialize_xml(d, "std_vector_double", "test_file\\test_compact_double.xml", all[f]);
+		size[f] = file_size("test_file\\test_compact_double.xml");
+	}
+	ASSERT_TRUE(size[1] < size[0] && size[2] < size[0]);
+	std::cout << d.size() << " doubles: items " << size[0] << " bytes, text " << size[1] << " bytes, base64 " << size[2] << " bytes\n";
+}
+
+void TEST_XMLAttributeLayout() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_XMLAttributeLayout==========\n";
+	std::cout << "====================================\n";
+
+	std::map<std::string, int> m, m1, m2;
+	std::map<int, std::vector<double> > mv, mv1, mv2;
+	std::map<int, std::pair<int, double> > mp, mp1;
+	for (int i = 0; i < 500; ++i)
+	{
+		std::ostringstream key;
+		key << "key \"" << i << "\" & <" << i % 7 << ">";
+		m[key.str()] = i * 3 - 700;
+		mv[i * 11] = std::vector<double>(i % 4, i * 0.25);
+		mp[-i] = std::make_pair(i, i / 8.0);
+	}
+	std::pair<int, double> p(2, 3.1), p1;
+	std::pair<int, std::vector<int> > pv(5, std::vector<int>(3, 9)), pv1;
+	std::vector<std::string> vs, vs1;
+	vs.push_back("a < b");
+	vs.push_back("");
+	vs.push_back("'quoted'");
+	std::map<int, int> empty, empty1;
+	char ch = 'x', ch1 = 0;
+
+	XML_Seri::XMLLayout attr = XML_Seri::XML_LAYOUT_ATTRIBUTES;
+	XML_Seri::serialize_xml(m, "std_map", "test_file\\test_attr_map.xml", attr);
+	XML_Seri::deserialize_xml(m1, "std_map", "test_file\\test_attr_map.xml");
+	ASSERT_TRUE(m1 == m);
+	tinyxml2::XMLDocument *xmlDoc = XML_Seri::ReadFromFile("test_file\\test_attr_map.xml");
+	tinyxml2::XMLElement *e = xmlDoc->RootElement()->FirstChildElement()->FirstChildElement();
+	ASSERT_TRUE(std::string(e->Name()) == "e" && e->FirstChild() == NULL && e->Attribute("k") && e->Attribute("v"));
+	XML_Seri::XMLBase::VarType<std::map<std::string, int> >::reader(xmlDoc->RootElement()->FirstChildElement(), m2);
+	delete xmlDoc;
+	ASSERT_TRUE(m2 == m);
+
+	XML_Seri::serialize_xml(mv, "std_map", "test_file\\test_attr_map_vector.xml", attr);
+	XML_Seri::deserialize_xml(mv1, "std_map", "test_file\\test_attr_map_vector.xml");
+	ASSERT_TRUE(mv1 == mv);
+	xmlDoc = XML_Seri::ReadFromFile("test_file\\test_attr_map_vector.xml");
+	XML_Seri::XMLBase::VarType<std::map<int, std::vector<double> > >::reader(xmlDoc->RootElement()->FirstChildElement(), mv2);
+	delete xmlDoc;
+	ASSERT_TRUE(mv2 == mv);
+
+	XML_Seri::serialize_xml(mp, "std_map", "test_file\\test_attr_map_pair.xml", attr);
+	XML_Seri::deserialize_xml(mp1, "std_map", "test_file\\test_attr_map_pair.xml");
+	ASSERT_TRUE(mp1 == mp);
+
+	XML_Seri::serialize_xml(p, "std_pair", "test_file\\test_attr_pair.xml", attr);
+	XML_Seri::deserialize_xml(p1, "std_pair", "test_file\\test_attr_pair.xml");
+	ASSERT_TRUE(p1 == p);
+	XML_Seri::serialize_xml(pv, "std_pair", "test_file\\test_attr_pair.xml", attr); //members as child elements
+	XML_Seri::deserialize_xml(pv1, "std_pair", "test_file\\test_attr_pair.xml");
+	ASSERT_TRUE(pv1 == pv);
+
+	XML_Seri::serialize_xml(vs, "std_vector", "test_file\\test_attr_vector.xml", attr);
+	XML_Seri::deserialize_xml(vs1, "std_vector", "test_file\\test_attr_vector.xml");
+	ASSERT_TRUE(vs1 == vs);
+	XML_Seri::serialize_xml(ch, "char", "test_file\\test_attr_char.xml", attr);
+	XML_Seri::deserialize_xml(ch1, "char", "test_file\\test_attr_char.xml");
+	ASSERT_EQ(ch1, ch);
+	XML_Seri::serialize_xml(empty, "std_map", "test_file\\test_attr_empty.xml", attr); //<std_map/>
+	XML_Seri::deserialize_xml(empty1, "std_map", "test_file\\test_attr_empty.xml");
+	xmlDoc = XML_Seri::ReadFromFile("test_file\\test_attr_empty.xml");
+	XML_Seri::XMLBase::VarType<std::map<int, int> >::reader(xmlDoc->RootElement()->FirstChildElement(), empty1);
+	delete xmlDoc;
+	ASSERT_TRUE(empty1.empty());
+	ASSERT_TRUE(XML_Seri::xml_layout() == XML_Seri::XML_LAYOUT_ELEMENTS);
+
+	//the DOM writer
+	tinyxml2::XMLDocument doc;
+	doc.InsertEndChild(doc.NewElement("serialization"));
+	XML_Seri::xml_layout() = attr;
+	XML_Seri::XMLBase::VarType<std::map<std::string, int> >::writer(doc.RootElement(), "m", m);
+	XML_Seri::XMLBase::VarType<std::pair<int, double> >::writer(doc.RootElement(), "p", p);
+	XML_Seri::xml_layout() = XML_Seri::XML_LAYOUT_ELEMENTS;
+	m1.clear();
+	p1 = std::make_pair(0, 0.0);
+	XML_Seri::XMLBase::VarType<std::map<std::string, int> >::reader(doc.RootElement()->FirstChildElement("m"), m1);
+	XML_Seri::XMLBase::VarType<std::pair<int, double> >::reader(doc.RootElement()->FirstChildElement("p"), p1);
+	ASSERT_TRUE(m1 == m);
+	ASSERT_TRUE(p1 == p);
+
+	//DOM writer and printer give the same bytes for a char, in both layouts
+	for (int layout = 0; layout < 2; ++layout)
+	{
+		XML_Seri::xml_layout() = layout ? attr : XML_Seri::XML_LAYOUT_ELEMENTS;
+		tinyxml2::XMLDocument chDoc;
+		chDoc.InsertEndChild(chDoc.NewElement("serialization"));
+		XML_Seri::XMLBase::VarType<char>::writer(chDoc.RootElement(), "char", ch);
+		tinyxml2::XMLPrinter fromDoc, direct;
+		chDoc.Print(&fromDoc);
+		direct.OpenElement("serialization");
+		XML_Seri::XMLBase::VarType<char>::print(direct, "char", ch);
+		direct.CloseElement();
+		ASSERT_TRUE(std::string(fromDoc.CStr()) == direct.CStr());
+		ch1 = 0;
+		XML_Seri::XMLBase::VarType<char>::reader(chDoc.RootElement()->FirstChildElement(), ch1);
+		ASSERT_EQ(ch1, ch);
+	}
+	XML_Seri::xml_layout() = XML_Seri::XML_LAYOUT_ELEMENTS;
+
+	//one element per entry instead of six
+	auto file_size = [](const char *name) { return (long long)std::ifstream(name, std::ios::binary | std::ios::ate).tellg(); };
+	XML_Seri::serialize_xml(m, "std_map", "test_file\\test_attr_map_elements.xml");
+	long long elements = file_size("test_file\\test_attr_map_elements.xml");
+	long long attributes = file_size("test_file\\test_attr_map.xml");
+	ASSERT_TRUE(attributes < elements);
+	std::cout << m.size() << " map entries: elements " << elements << " bytes, attributes " << attributes << " bytes\n";
+}
+
+void TEST_XMLReusableDocument() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_XMLReusableDocument=========\n";
+	std::cout << "====================================\n";
+
+	std::map<std::string, std::vector<int> > m, m1;
+	for (int i = 0; i < 300; ++i)
+	{
+		std::ostringstream key;
+		key << "key & " << i;
+		m[key.str()] = std::vector<int>(i % 7, i);
+	}
+	XML_Seri::serialize_xml(m, "map", "test_file\\test_reuse.xml");
+
+	//the second and later loads run on the blocks of the first
+	XML_Seri::XMLReusableDocument doc;
+	int blocks = 0;
+	bool same = true;
+	for (int i = 0; i < 5; ++i)
+	{
+		ASSERT_TRUE(doc.LoadFileInSitu("test_file\\test_reuse.xml") == tinyxml2::XML_SUCCESS);
+		m1.clear();
+		XML_Seri::XMLBase::VarType<std::map<std::string, std::vector<int> > >::reader(doc.RootElement()->FirstChildElement(), m1);
+		same = same && m1 == m;
+		if (i == 0)
+			blocks = doc.MemPoolBlockCount();
+		else
+			same = same && doc.MemPoolBlockCount() == blocks;
+	}
+	ASSERT_TRUE(same);
+	ASSERT_TRUE(blocks > 0);
+
+	//building in place of a loaded document reuses the same blocks
+	doc.Recycle();
+	tinyxml2::XMLElement *root = doc.NewElement("serialization");
+	doc.InsertEndChild(root);
+	XML_Seri::XMLBase::VarType<std::map<std::string, std::vector<int> > >::writer(root, "map", m);
+	ASSERT_EQ(doc.MemPoolBlockCount(), blocks);
+
+	//bigger blocks, fewer of them
+	XML_Seri::XMLReusableDocument big;
+	big.SetMemPoolBlockSize(64 * 1024, 16 * 1024, 64 * 1024, 1024);
+	ASSERT_TRUE(big.LoadFileInSitu("test_file\\test_reuse.xml") == tinyxml2::XML_SUCCESS);
+	ASSERT_TRUE(big.MemPoolBlockCount() < blocks);
+
+	ASSERT_TRUE(doc.LoadFileInSitu("test_file\\test_bad_lines.xml") != tinyxml2::XML_SUCCESS);
+	ASSERT_EQ(doc.ErrorLineNum(), 93);
+	ASSERT_TRUE(!doc.TrackLineNumbers());
+	ASSERT_TRUE(doc.LoadFileInSitu("test_file\\no_such_file.xml") != tinyxml2::XML_SUCCESS);
+
+	//the thread cache hands the same document back; nested handles and
+	//other threads get their own
+	XML_Seri::XMLReusableDocument *first;
+	{
+		XML_Seri::XMLPooledDocument pooled;
+		ASSERT_TRUE(pooled->LoadFileInSitu("test_file\\test_reuse.xml") == tinyxml2::XML_SUCCESS);
+		first = pooled.get();
+		XML_Seri::XMLPooledDocument nested;
+		ASSERT_TRUE(nested.get() != first);
+	}
+	{
+		XML_Seri::XMLPooledDocument pooled;
+		ASSERT_TRUE(pooled.get() == first);
+		ASSERT_TRUE(pooled->NoChildren());
+		m1.clear();
+		ASSERT_TRUE(pooled->LoadFileInSitu("test_file\\test_reuse.xml") == tinyxml2::XML_SUCCESS);
+		XML_Seri::XMLBase::VarType<std::map<std::string, std::vector<int> > >::reader(pooled->RootElement()->FirstChildElement(), m1);
+		ASSERT_TRUE(m1 == m);
+	}
+	XML_Seri::XMLReusableDocument *other = NULL;
+	std::thread t([&other]() {
+		XML_Seri::XMLPooledDocument pooled;
+		other = pooled.get();
+	});
+	t.join();
+	ASSERT_TRUE(other != first);
+}
+
+void TEST_XMLInternNames() {
+	std::cout << "\n====================================\n";
+	std::cout << "===TEST_XMLInternNames==============\n";
+	std::cout << "====================================\n";
+
+	tinyxml2::XMLDocument doc;
+	const char *item = doc.Intern("item");
+	ASSERT_TRUE(doc.Intern("items", 4) == item);
+	ASSERT_TRUE(doc.Intern("items") != item);
+	ASSERT_TRUE(std::string(doc.Intern("items")) == "items");
+	std::vector<const char*> names;
+	for (int i = 0; i < 1000; ++i) //grows the table a few times
+	{
+		names.push_back(doc.Intern(("name" + std::to_string(i)).c_str()));
+	}
+	std::string longName(3000, 'n');
+	const char *longInterned = doc.Intern(longName.c_str());
+	bool same = longInterned == doc.Intern(longName.c_str());
+	for (int i = 0; i < 1000; ++i)
+	{
+		same = same && doc.Intern(("name" + std::to_string(i)).c_str()) == names[i];
+	}
+	ASSERT_TRUE(same);
+	ASSERT_TRUE(doc.Intern("item") == item);
+
+	//writers name elements from the table
+	std::map<std::string, std::vector<int> > m, m1;
+	for (int i = 0; i < 50; ++i)
+	{
+		m[std::to_string(i)] = std::vector<int>(i % 5 + 1, i);
+	}
+	doc.InsertEndChild(doc.NewElement("serialization", true));
+	XML_Seri::XMLBase::VarType<std::map<std::string, std::vector<int> > >::writer(doc.RootElement(), "map", m);
+	tinyxml2::XMLElement *val = doc.RootElement()->FirstChildElement()->LastChildElement();
+	tinyxml2::XMLElement *a = val->FirstChildElement(), *b = val->LastChildElement();
+	ASSERT_TRUE(a != b && a->Name() == b->Name() && a->Name() == doc.Intern("item"));
+	XML_Seri::XMLBase::VarType<std::map<std::string, std::vector<int> > >::reader(doc.RootElement()->FirstChildElement(), m1);
+	ASSERT_TRUE(m1 == m);
+
+	//parsing with the table gives the same document, with shared names
+	tinyxml2::XMLPrinter printer;
+	doc.Print(&printer);
+	tinyxml2::XMLDocument plain, interned;
+	interned.SetInternNames(true);
+	ASSERT_TRUE(plain.Parse(printer.CStr()) == tinyxml2::XML_SUCCESS);
+	ASSERT_TRUE(interned.Parse(printer.CStr()) == tinyxml2::XML_SUCCESS);
+	tinyxml2::XMLPrinter p1, p2;
+	plain.Print(&p1);
+	interned.Print(&p2);
+	ASSERT_TRUE(std::string(p1.CStr()) == p2.CStr());
+	ASSERT_TRUE(std::string(p1.CStr()) == printer.CStr());
+	val = interned.RootElement()->FirstChildElement()->LastChildElement();
+	ASSERT_TRUE(val->FirstChildElement()->Name() == val->LastChildElement()->Name());
+
+	std::string xml = "<r><e k=\"1\" v=\"2\"/><e k=\"3\" v=\"4\"/></r>";
+	ASSERT_TRUE(interned.Parse(xml.c_str()) == tinyxml2::XML_SUCCESS);
+	a = interned.RootElement()->FirstChildElement();
+	b = a->NextSiblingElement();
+	ASSERT_TRUE(a->FirstAttribute()->Name() == b->FirstAttribute()->Name());
+	ASSERT_TRUE(a->FirstAttribute()->Next()->Name() == interned.Intern("v"));
+	ASSERT_TRUE(std::string(b->Attribute("v")) == "4");
+	b->SetAttribute("k", 5);
+	b->SetAttribute("extra", "x");
+	ASSERT_TRUE(b->FindAttribute("extra")->Name() == interned.Intern("extra"));
+	ASSERT_EQ(b->IntAttribute("k"), 5);
+
+	ASSERT_TRUE(interned.Parse("<r><a></b></r>") == tinyxml2::XML_ERROR_MISMATCHED_ELEMENT);
+	ASSERT_TRUE(interned.Parse("<r a=\"1\" a=\"2\"/>") != tinyxml2::XML_SUCCESS);
+}
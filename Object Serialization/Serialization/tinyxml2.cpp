@@ -100,6 +100,15 @@ distribution.
 	#define TIXML_SSCANF   sscanf
 #endif
 
+#if ( defined(_M_X64) || defined(__x86_64__) ) && !defined(TINYXML2_NO_SIMD)
+	// SSE2 is part of x86-64; AVX2 is used when the CPU has it
+	#define TIXML_SIMD_X86
+	#include <immintrin.h>
+	#if defined(_MSC_VER)
+		#include <intrin.h>	// __cpuid, _BitScanForward
+	#endif
+#endif
+
 #if defined(_WIN64)
 	#define TIXML_FSEEK _fseeki64
 	#define TIXML_FTELL _ftelli64
@@ -149,6 +158,400 @@ static const Entity entities[NUM_ENTITIES] = {
 };
 
 
+/*
+	Vectorized scanners for the parser's inner loops.
+
+	The NUL-terminated scans use aligned loads: the bytes of the first block
+	that lie before the start are masked off, and a load that holds the
+	terminator never crosses into the next page. That reads up to a block
+	past the end of the buffer, which is intended, so the address sanitizer
+	is told to skip these functions.
+*/
+#if defined(__GNUC__)
+#   define TIXML_NO_SANITIZE_ADDRESS	__attribute__((no_sanitize_address))
+#   define TIXML_TARGET_AVX2			__attribute__((target("avx2")))
+#else
+#   define TIXML_NO_SANITIZE_ADDRESS
+#   define TIXML_TARGET_AVX2
+#endif
+
+// countLines = false drops the newline bookkeeping from the loops
+template<bool countLines>
+static const char* SkipWhiteSpaceScalar( const char* p, int* lines )
+{
+    while ( XMLUtil::IsWhiteSpace( *p ) ) {
+        if ( countLines && *p == '\n' ) {
+            ++(*lines);
+        }
+        ++p;
+    }
+    return p;
+}
+
+template<bool countLines>
+static const char* FindCharScalar( const char* p, char c, int* lines )
+{
+    while ( *p && *p != c ) {
+        if ( countLines && *p == '\n' ) {
+            ++(*lines);
+        }
+        ++p;
+    }
+    return p;
+}
+
+static const char* SkipNameCharsScalar( const char* p )
+{
+    while ( *p && XMLUtil::IsNameChar( (unsigned char) *p ) ) {
+        ++p;
+    }
+    return p;
+}
+
+static const char* FindAnyOfScalar( const char* p, const char* end, const char* set, int n )
+{
+    for ( ; p < end; ++p ) {
+        for ( int i = 0; i < n; ++i ) {
+            if ( *p == set[i] ) {
+                return p;
+            }
+        }
+    }
+    return end;
+}
+
+#ifdef TIXML_SIMD_X86
+
+static inline int TrailingZeros( unsigned m )
+{
+    TIXMLASSERT( m );
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward( &i, m );
+    return (int) i;
+#else
+    return __builtin_ctz( m );
+#endif
+}
+
+static inline int PopCount( unsigned m )
+{
+#if defined(_MSC_VER)
+    // __popcnt needs a newer CPU than SSE2
+    m = m - ( ( m >> 1 ) & 0x55555555u );
+    m = ( m & 0x33333333u ) + ( ( m >> 2 ) & 0x33333333u );
+    return (int) ( ( ( ( m + ( m >> 4 ) ) & 0x0f0f0f0fu ) * 0x01010101u ) >> 24 );
+#else
+    return __builtin_popcount( m );
+#endif
+}
+
+// Newlines before the first stop byte are counted; the result points at it.
+template<bool countLines>
+static inline const char* StopAt( const char* block, unsigned stop, unsigned newlines, int* lines )
+{
+    const int i = TrailingZeros( stop );
+    if ( countLines ) {
+        *lines += PopCount( newlines & ( ( 1u << i ) - 1 ) );
+    }
+    return block + i;
+}
+
+static inline const char* AlignDown( const char* p, uintptr_t size )
+{
+    return reinterpret_cast<const char*>( reinterpret_cast<uintptr_t>( p ) & ~( size - 1 ) );
+}
+
+//---- SSE2: 16 bytes at a time ----
+
+// space, or \t \n \v \f \r. Bytes with the high bit set are negative and fail the range test.
+static inline __m128i IsWhiteSpaceSSE2( __m128i v )
+{
+    return _mm_or_si128( _mm_cmpeq_epi8( v, _mm_set1_epi8( ' ' ) ),
+                         _mm_and_si128( _mm_cmpgt_epi8( v, _mm_set1_epi8( '\t' - 1 ) ),
+                                        _mm_cmpgt_epi8( _mm_set1_epi8( '\r' + 1 ), v ) ) );
+}
+
+// [lo, hi], for lo and hi below 128
+static inline __m128i InRangeSSE2( __m128i v, char lo, char hi )
+{
+    return _mm_and_si128( _mm_cmpgt_epi8( v, _mm_set1_epi8( lo - 1 ) ),
+                          _mm_cmpgt_epi8( _mm_set1_epi8( hi + 1 ), v ) );
+}
+
+// XMLUtil::IsNameChar: high bit, letter, digit, ':', '_', '.', '-'
+static inline __m128i IsNameCharSSE2( __m128i v )
+{
+    const __m128i high   = _mm_cmpgt_epi8( _mm_setzero_si128(), v );
+    const __m128i alpha  = InRangeSSE2( _mm_or_si128( v, _mm_set1_epi8( 0x20 ) ), 'a', 'z' );
+    const __m128i digit  = InRangeSSE2( v, '0', ':' );
+    const __m128i punct  = _mm_or_si128( InRangeSSE2( v, '-', '.' ), _mm_cmpeq_epi8( v, _mm_set1_epi8( '_' ) ) );
+    return _mm_or_si128( _mm_or_si128( high, alpha ), _mm_or_si128( digit, punct ) );
+}
+
+template<bool countLines>
+TIXML_NO_SANITIZE_ADDRESS
+static const char* SkipWhiteSpaceSSE2( const char* p, int* lines )
+{
+    const char* a = AlignDown( p, 16 );
+    unsigned mask = ( 0xffffu << ( p - a ) ) & 0xffffu;
+    for ( ;; a += 16, mask = 0xffffu ) {
+        const __m128i v = _mm_load_si128( reinterpret_cast<const __m128i*>( a ) );
+        const unsigned stop = ~(unsigned) _mm_movemask_epi8( IsWhiteSpaceSSE2( v ) ) & mask;
+        const unsigned newlines = countLines ? (unsigned) _mm_movemask_epi8( _mm_cmpeq_epi8( v, _mm_set1_epi8( '\n' ) ) ) & mask : 0;
+        if ( stop ) {
+            return StopAt<countLines>( a, stop, newlines, lines );
+        }
+        if ( countLines ) {
+            *lines += PopCount( newlines );
+        }
+    }
+}
+
+template<bool countLines>
+TIXML_NO_SANITIZE_ADDRESS
+static const char* FindCharSSE2( const char* p, char c, int* lines )
+{
+    const char* a = AlignDown( p, 16 );
+    unsigned mask = ( 0xffffu << ( p - a ) ) & 0xffffu;
+    for ( ;; a += 16, mask = 0xffffu ) {
+        const __m128i v = _mm_load_si128( reinterpret_cast<const __m128i*>( a ) );
+        const __m128i hit = _mm_or_si128( _mm_cmpeq_epi8( v, _mm_set1_epi8( c ) ), _mm_cmpeq_epi8( v, _mm_setzero_si128() ) );
+        const unsigned stop = (unsigned) _mm_movemask_epi8( hit ) & mask;
+        const unsigned newlines = countLines ? (unsigned) _mm_movemask_epi8( _mm_cmpeq_epi8( v, _mm_set1_epi8( '\n' ) ) ) & mask : 0;
+        if ( stop ) {
+            return StopAt<countLines>( a, stop, newlines, lines );
+        }
+        if ( countLines ) {
+            *lines += PopCount( newlines );
+        }
+    }
+}
+
+TIXML_NO_SANITIZE_ADDRESS
+static const char* SkipNameCharsSSE2( const char* p )
+{
+    const char* a = AlignDown( p, 16 );
+    unsigned mask = ( 0xffffu << ( p - a ) ) & 0xffffu;
+    for ( ;; a += 16, mask = 0xffffu ) {
+        const __m128i v = _mm_load_si128( reinterpret_cast<const __m128i*>( a ) );
+        const unsigned stop = ~(unsigned) _mm_movemask_epi8( IsNameCharSSE2( v ) ) & mask;
+        if ( stop ) {
+            return a + TrailingZeros( stop );
+        }
+    }
+}
+
+static const char* FindAnyOfSSE2( const char* p, const char* end, const char* set, int n )
+{
+    const __m128i s0 = _mm_set1_epi8( set[0] );
+    const __m128i s1 = _mm_set1_epi8( set[n > 1 ? 1 : 0] );
+    const __m128i s2 = _mm_set1_epi8( set[n > 2 ? 2 : 0] );
+    for ( ; end - p >= 16; p += 16 ) {
+        const __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) );
+        const __m128i hit = _mm_or_si128( _mm_cmpeq_epi8( v, s0 ), _mm_or_si128( _mm_cmpeq_epi8( v, s1 ), _mm_cmpeq_epi8( v, s2 ) ) );
+        const unsigned stop = (unsigned) _mm_movemask_epi8( hit );
+        if ( stop ) {
+            return p + TrailingZeros( stop );
+        }
+    }
+    return FindAnyOfScalar( p, end, set, n );
+}
+
+//---- AVX2: 32 bytes at a time ----
+
+TIXML_TARGET_AVX2
+static inline __m256i IsWhiteSpaceAVX2( __m256i v )
+{
+    return _mm256_or_si256( _mm256_cmpeq_epi8( v, _mm256_set1_epi8( ' ' ) ),
+                            _mm256_and_si256( _mm256_cmpgt_epi8( v, _mm256_set1_epi8( '\t' - 1 ) ),
+                                              _mm256_cmpgt_epi8( _mm256_set1_epi8( '\r' + 1 ), v ) ) );
+}
+
+TIXML_TARGET_AVX2
+static inline __m256i InRangeAVX2( __m256i v, char lo, char hi )
+{
+    return _mm256_and_si256( _mm256_cmpgt_epi8( v, _mm256_set1_epi8( lo - 1 ) ),
+                             _mm256_cmpgt_epi8( _mm256_set1_epi8( hi + 1 ), v ) );
+}
+
+TIXML_TARGET_AVX2
+static inline __m256i IsNameCharAVX2( __m256i v )
+{
+    const __m256i high   = _mm256_cmpgt_epi8( _mm256_setzero_si256(), v );
+    const __m256i alpha  = InRangeAVX2( _mm256_or_si256( v, _mm256_set1_epi8( 0x20 ) ), 'a', 'z' );
+    const __m256i digit  = InRangeAVX2( v, '0', ':' );
+    const __m256i punct  = _mm256_or_si256( InRangeAVX2( v, '-', '.' ), _mm256_cmpeq_epi8( v, _mm256_set1_epi8( '_' ) ) );
+    return _mm256_or_si256( _mm256_or_si256( high, alpha ), _mm256_or_si256( digit, punct ) );
+}
+
+template<bool countLines>
+TIXML_TARGET_AVX2 TIXML_NO_SANITIZE_ADDRESS
+static const char* SkipWhiteSpaceAVX2( const char* p, int* lines )
+{
+    const char* a = AlignDown( p, 32 );
+    unsigned mask = ~0u << ( p - a );
+    for ( ;; a += 32, mask = ~0u ) {
+        const __m256i v = _mm256_load_si256( reinterpret_cast<const __m256i*>( a ) );
+        const unsigned stop = ~(unsigned) _mm256_movemask_epi8( IsWhiteSpaceAVX2( v ) ) & mask;
+        const unsigned newlines = countLines ? (unsigned) _mm256_movemask_epi8( _mm256_cmpeq_epi8( v, _mm256_set1_epi8( '\n' ) ) ) & mask : 0;
+        if ( stop ) {
+            return StopAt<countLines>( a, stop, newlines, lines );
+        }
+        if ( countLines ) {
+            *lines += PopCount( newlines );
+        }
+    }
+}
+
+template<bool countLines>
+TIXML_TARGET_AVX2 TIXML_NO_SANITIZE_ADDRESS
+static const char* FindCharAVX2( const char* p, char c, int* lines )
+{
+    const char* a = AlignDown( p, 32 );
+    unsigned mask = ~0u << ( p - a );
+    for ( ;; a += 32, mask = ~0u ) {
+        const __m256i v = _mm256_load_si256( reinterpret_cast<const __m256i*>( a ) );
+        const __m256i hit = _mm256_or_si256( _mm256_cmpeq_epi8( v, _mm256_set1_epi8( c ) ), _mm256_cmpeq_epi8( v, _mm256_setzero_si256() ) );
+        const unsigned stop = (unsigned) _mm256_movemask_epi8( hit ) & mask;
+        const unsigned newlines = countLines ? (unsigned) _mm256_movemask_epi8( _mm256_cmpeq_epi8( v, _mm256_set1_epi8( '\n' ) ) ) & mask : 0;
+        if ( stop ) {
+            return StopAt<countLines>( a, stop, newlines, lines );
+        }
+        if ( countLines ) {
+            *lines += PopCount( newlines );
+        }
+    }
+}
+
+TIXML_TARGET_AVX2 TIXML_NO_SANITIZE_ADDRESS
+static const char* SkipNameCharsAVX2( const char* p )
+{
+    const char* a = AlignDown( p, 32 );
+    unsigned mask = ~0u << ( p - a );
+    for ( ;; a += 32, mask = ~0u ) {
+        const __m256i v = _mm256_load_si256( reinterpret_cast<const __m256i*>( a ) );
+        const unsigned stop = ~(unsigned) _mm256_movemask_epi8( IsNameCharAVX2( v ) ) & mask;
+        if ( stop ) {
+            return a + TrailingZeros( stop );
+        }
+    }
+}
+
+TIXML_TARGET_AVX2
+static const char* FindAnyOfAVX2( const char* p, const char* end, const char* set, int n )
+{
+    const __m256i s0 = _mm256_set1_epi8( set[0] );
+    const __m256i s1 = _mm256_set1_epi8( set[n > 1 ? 1 : 0] );
+    const __m256i s2 = _mm256_set1_epi8( set[n > 2 ? 2 : 0] );
+    for ( ; end - p >= 32; p += 32 ) {
+        const __m256i v = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( p ) );
+        const __m256i hit = _mm256_or_si256( _mm256_cmpeq_epi8( v, s0 ), _mm256_or_si256( _mm256_cmpeq_epi8( v, s1 ), _mm256_cmpeq_epi8( v, s2 ) ) );
+        const unsigned stop = (unsigned) _mm256_movemask_epi8( hit );
+        if ( stop ) {
+            return p + TrailingZeros( stop );
+        }
+    }
+    return FindAnyOfSSE2( p, end, set, n );
+}
+
+static int CpuScanLevel()
+{
+#if defined(_MSC_VER)
+    int r[4];
+    __cpuid( r, 1 );
+    const bool osxsave = ( ( r[2] >> 27 ) & 1 ) != 0;
+    const bool avx = ( ( r[2] >> 28 ) & 1 ) != 0;
+    if ( !osxsave || !avx || ( _xgetbv( 0 ) & 6 ) != 6 ) {
+        return XMLUtil::SCAN_SSE2;
+    }
+    __cpuidex( r, 7, 0 );
+    return ( ( r[1] >> 5 ) & 1 ) ? XMLUtil::SCAN_AVX2 : XMLUtil::SCAN_SSE2;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports( "avx2" ) ? XMLUtil::SCAN_AVX2 : XMLUtil::SCAN_SSE2;
+#endif
+}
+
+#else
+
+static int CpuScanLevel()
+{
+    return XMLUtil::SCAN_SCALAR;
+}
+
+#endif // TIXML_SIMD_X86
+
+struct Scanners {
+    // [0] without, [1] with line counting
+    const char* (*skipWhiteSpace[2])( const char* p, int* lines );
+    const char* (*findChar[2])( const char* p, char c, int* lines );
+    const char* (*skipNameChars)( const char* p );
+    const char* (*findAnyOf)( const char* p, const char* end, const char* set, int n );
+};
+
+static const Scanners scanners[] = {
+    { { SkipWhiteSpaceScalar<false>, SkipWhiteSpaceScalar<true> }, { FindCharScalar<false>, FindCharScalar<true> },
+      SkipNameCharsScalar, FindAnyOfScalar },
+#ifdef TIXML_SIMD_X86
+    { { SkipWhiteSpaceSSE2<false>, SkipWhiteSpaceSSE2<true> }, { FindCharSSE2<false>, FindCharSSE2<true> },
+      SkipNameCharsSSE2, FindAnyOfSSE2 },
+    { { SkipWhiteSpaceAVX2<false>, SkipWhiteSpaceAVX2<true> }, { FindCharAVX2<false>, FindCharAVX2<true> },
+      SkipNameCharsAVX2, FindAnyOfAVX2 },
+#endif
+};
+
+static int& ActiveScanLevel()
+{
+    static int level = CpuScanLevel();
+    return level;
+}
+
+
+int XMLUtil::ScanLevel()
+{
+    return ActiveScanLevel();
+}
+
+
+int XMLUtil::SetScanLevel( int level )
+{
+    // Not synchronized: call it while no other thread is parsing.
+    const int best = CpuScanLevel();
+    ActiveScanLevel() = level < SCAN_SCALAR ? SCAN_SCALAR : level > best ? best : level;
+    return ActiveScanLevel();
+}
+
+
+const char* XMLUtil::SkipWhiteSpaceRun( const char* p, int* curLineNumPtr )
+{
+    TIXMLASSERT( p );
+    return scanners[ActiveScanLevel()].skipWhiteSpace[curLineNumPtr != 0]( p, curLineNumPtr );
+}
+
+
+const char* XMLUtil::FindChar( const char* p, char c, int* curLineNumPtr )
+{
+    TIXMLASSERT( p );
+    return scanners[ActiveScanLevel()].findChar[curLineNumPtr != 0]( p, c, curLineNumPtr );
+}
+
+
+const char* XMLUtil::SkipNameChars( const char* p )
+{
+    TIXMLASSERT( p );
+    return scanners[ActiveScanLevel()].skipNameChars( p );
+}
+
+
+const char* XMLUtil::FindAnyOf( const char* p, const char* end, const char* set, int n )
+{
+    TIXMLASSERT( p && end && p <= end );
+    TIXMLASSERT( 0 < n && n <= 3 );
+    return scanners[ActiveScanLevel()].findAnyOf( p, end, set, n );
+}
+
+
 StrPair::~StrPair()
 {
     Reset();
@@ -208,24 +611,24 @@ char* StrPair::ParseText( char* p, const char* endTag, int strFlags, int* curLin
 {
     TIXMLASSERT( p );
     TIXMLASSERT( endTag && *endTag );
-	TIXMLASSERT(curLineNumPtr);
 
     char* start = p;
     const char  endChar = *endTag;
     size_t length = strlen( endTag );
 
     // Inner loop of text parsing.
-    while ( *p ) {
-        if ( *p == endChar && strncmp( p, endTag, length ) == 0 ) {
+    for ( ;; ) {
+        p = const_cast<char*>( XMLUtil::FindChar( p, endChar, curLineNumPtr ) );
+        TIXMLASSERT( p );
+        if ( !*p ) {
+            return 0;
+        }
+        if ( strncmp( p, endTag, length ) == 0 ) {
             Set( start, p, strFlags );
             return p + length;
-        } else if (*p == '\n') {
-            ++(*curLineNumPtr);
         }
         ++p;
-        TIXMLASSERT( p );
     }
-    return 0;
 }
 
 
@@ -239,10 +642,7 @@ char* StrPair::ParseName( char* p )
     }
 
     char* const start = p;
-    ++p;
-    while ( *p && XMLUtil::IsNameChar( (unsigned char) *p ) ) {
-        ++p;
-    }
+    p = const_cast<char*>( XMLUtil::SkipNameChars( p + 1 ) );
 
     Set( start, p, 0 );
     return p;
@@ -290,7 +690,28 @@ const char* StrPair::GetStr()
             const char* p = _start;	// the read pointer
             char* q = _start;	// the write pointer
 
+            // The bytes the loop below has to look at
+            char special[3];
+            int numSpecial = 0;
+            if ( _flags & NEEDS_NEWLINE_NORMALIZATION ) {
+                special[numSpecial++] = CR;
+                special[numSpecial++] = LF;
+            }
+            if ( _flags & NEEDS_ENTITY_PROCESSING ) {
+                special[numSpecial++] = '&';
+            }
+
             while( p < _end ) {
+                // Move the plain run before the next special byte in one go.
+                const char* run = numSpecial ? XMLUtil::FindAnyOf( p, _end, special, numSpecial ) : _end;
+                if ( run != p ) {
+                    if ( q != p ) {
+                        memmove( q, p, run - p );
+                    }
+                    q += run - p;
+                    p = run;
+                    continue;
+                }
                 if ( (_flags & NEEDS_NEWLINE_NORMALIZATION) && *p == CR ) {
                     // CR-LF pair becomes LF
                     // CR alone becomes LF
@@ -563,15 +984,508 @@ const char* XMLUtil::GetCharacterRef( const char* p, char* value, int* length )
 }
 
 
+/*
+	Number <-> text conversion without printf and scanf.
+
+	Floating point values are written with Grisu2 (Florian Loitsch, "Printing
+	Floating-Point Numbers Quickly and Accurately with Integers", 2010): the
+	digits always read back to the same bits, and are the shortest that do
+	in all but rare cases. Reading takes Clinger's fast path when the decimal
+	mantissa and power of ten are both exact in the target type, where one
+	multiplication or division is correctly rounded; other text goes to the
+	scanf path as before.
+*/
+
+static const char DIGIT_PAIRS[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static inline bool IsDigit( char c )
+{
+    return c >= '0' && c <= '9';
+}
+
+static char* AppendDecimal( uint64_t v, char* out )
+{
+    char tmp[20];
+    char* p = tmp + sizeof( tmp );
+    while ( v >= 100 ) {
+        const unsigned i = static_cast<unsigned>( v % 100 ) * 2;
+        v /= 100;
+        p -= 2;
+        p[0] = DIGIT_PAIRS[i];
+        p[1] = DIGIT_PAIRS[i + 1];
+    }
+    if ( v >= 10 ) {
+        const unsigned i = static_cast<unsigned>( v ) * 2;
+        p -= 2;
+        p[0] = DIGIT_PAIRS[i];
+        p[1] = DIGIT_PAIRS[i + 1];
+    }
+    else {
+        *--p = static_cast<char>( '0' + v );
+    }
+    const size_t len = tmp + sizeof( tmp ) - p;
+    memcpy( out, p, len );
+    return out + len;
+}
+
+static char* AppendSigned( int64_t v, char* out )
+{
+    uint64_t u = static_cast<uint64_t>( v );
+    if ( v < 0 ) {
+        *out++ = '-';
+        u = 0 - u;
+    }
+    return AppendDecimal( u, out );
+}
+
+// A 64-bit significand and a binary exponent
+struct DiyFp {
+    DiyFp( uint64_t fp, int exp ) : f( fp ), e( exp ) {}
+
+    DiyFp operator-( const DiyFp& rhs ) const {
+        TIXMLASSERT( e == rhs.e && f >= rhs.f );
+        return DiyFp( f - rhs.f, e );
+    }
+
+    // upper 64 bits of the product, rounded
+    DiyFp operator*( const DiyFp& rhs ) const {
+        const uint64_t M32 = 0xFFFFFFFFu;
+        const uint64_t a = f >> 32, b = f & M32, c = rhs.f >> 32, d = rhs.f & M32;
+        const uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+        uint64_t tmp = ( bd >> 32 ) + ( ad & M32 ) + ( bc & M32 );
+        tmp += 1u << 31;
+        return DiyFp( ac + ( ad >> 32 ) + ( bc >> 32 ) + ( tmp >> 32 ), e + rhs.e + 64 );
+    }
+
+    DiyFp Normalize() const {
+        TIXMLASSERT( f != 0 );
+        DiyFp r = *this;
+        while ( !( r.f & ( uint64_t( 1 ) << 63 ) ) ) {
+            r.f <<= 1;
+            --r.e;
+        }
+        return r;
+    }
+
+    uint64_t f;
+    int e;
+};
+
+template<typename T> struct FloatTraits;
+
+template<> struct FloatTraits<double> {
+    typedef uint64_t Bits;
+    enum {
+        SIGNIFICAND_BITS = 52,
+        EXPONENT_MASK = 0x7FF,
+        EXPONENT_BIAS = 0x3FF + 52,
+        MAX_EXACT_POW10 = 22
+    };
+    static uint64_t MaxExactMantissa()  { return uint64_t( 1 ) << 53; }
+    static double Pow10( int i ) {
+        static const double pow10[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+        return pow10[i];
+    }
+};
+
+template<> struct FloatTraits<float> {
+    typedef uint32_t Bits;
+    enum {
+        SIGNIFICAND_BITS = 23,
+        EXPONENT_MASK = 0xFF,
+        EXPONENT_BIAS = 0x7F + 23,
+        MAX_EXACT_POW10 = 10
+    };
+    static uint64_t MaxExactMantissa()  { return uint64_t( 1 ) << 24; }
+    static float Pow10( int i ) {
+        static const float pow10[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+        return pow10[i];
+    }
+};
+
+static const uint64_t POW10_U64[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+    1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL, 10000000000000000000ULL
+};
+
+// 10^k for k = -348, -340, ..., 340, normalized
+static const uint64_t CACHED_POWERS_F[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+    0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL, 0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+    0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+    0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL, 0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+    0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+    0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL, 0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+    0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+    0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL, 0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+    0x9c40000000000000ULL, 0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+    0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL, 0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+    0x924d692ca61be758ULL, 0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+    0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL, 0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+    0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+    0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL, 0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+    0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+
+static const int16_t CACHED_POWERS_E[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+    -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+    -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+    -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+    56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+    694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+    1013, 1039, 1066,
+};
+
+// The cached power that brings the exponent of a product with it into [-60, -32]
+static DiyFp CachedPower( int e, int* K )
+{
+    const double dk = ( -61 - e ) * 0.30102999566398114 + 347;	// log10(2), offset by 348 - 1
+    int k = static_cast<int>( dk );
+    if ( dk - k > 0.0 ) {
+        ++k;
+    }
+    const unsigned index = static_cast<unsigned>( ( k >> 3 ) + 1 );
+    TIXMLASSERT( index < sizeof( CACHED_POWERS_F ) / sizeof( CACHED_POWERS_F[0] ) );
+    *K = -( -348 + static_cast<int>( index << 3 ) );
+    return DiyFp( CACHED_POWERS_F[index], CACHED_POWERS_E[index] );
+}
+
+static void GrisuRound( char* digits, int len, uint64_t delta, uint64_t rest, uint64_t tenKappa, uint64_t distance )
+{
+    while ( rest < distance && delta - rest >= tenKappa &&
+            ( rest + tenKappa < distance || distance - rest > rest + tenKappa - distance ) ) {
+        --digits[len - 1];
+        rest += tenKappa;
+    }
+}
+
+static void DigitGen( const DiyFp& w, const DiyFp& high, uint64_t delta, char* digits, int* len, int* K )
+{
+    const DiyFp one( uint64_t( 1 ) << -high.e, high.e );
+    const DiyFp distance = high - w;
+    uint32_t p1 = static_cast<uint32_t>( high.f >> -one.e );
+    uint64_t p2 = high.f & ( one.f - 1 );
+    int kappa = 1;
+    while ( kappa < 10 && p1 >= POW10_U64[kappa] ) {
+        ++kappa;
+    }
+    *len = 0;
+    while ( kappa > 0 ) {
+        const uint32_t pow = static_cast<uint32_t>( POW10_U64[kappa - 1] );
+        const uint32_t d = p1 / pow;
+        p1 %= pow;
+        if ( d || *len ) {
+            digits[(*len)++] = static_cast<char>( '0' + d );
+        }
+        --kappa;
+        const uint64_t rest = ( static_cast<uint64_t>( p1 ) << -one.e ) + p2;
+        if ( rest <= delta ) {
+            *K += kappa;
+            GrisuRound( digits, *len, delta, rest, POW10_U64[kappa] << -one.e, distance.f );
+            return;
+        }
+    }
+    for ( ;; ) {
+        p2 *= 10;
+        delta *= 10;
+        const char d = static_cast<char>( p2 >> -one.e );
+        if ( d || *len ) {
+            digits[(*len)++] = static_cast<char>( '0' + d );
+        }
+        p2 &= one.f - 1;
+        --kappa;
+        if ( p2 < delta ) {
+            *K += kappa;
+            const int index = -kappa;
+            GrisuRound( digits, *len, delta, p2, one.f, distance.f * ( index < 20 ? POW10_U64[index] : 0 ) );
+            return;
+        }
+    }
+}
+
+// digits * 10^K is the shortest decimal in v's rounding interval; v > 0 and finite
+template<typename T>
+static void Grisu2( T v, char* digits, int* len, int* K )
+{
+    typedef FloatTraits<T> Traits;
+    typename Traits::Bits bits;
+    memcpy( &bits, &v, sizeof( bits ) );
+    const uint64_t hidden = uint64_t( 1 ) << Traits::SIGNIFICAND_BITS;
+    const uint64_t significand = static_cast<uint64_t>( bits ) & ( hidden - 1 );
+    const int biasedExp = static_cast<int>( static_cast<uint64_t>( bits ) >> Traits::SIGNIFICAND_BITS ) & Traits::EXPONENT_MASK;
+    const DiyFp value = biasedExp ? DiyFp( significand + hidden, biasedExp - Traits::EXPONENT_BIAS )
+                                  : DiyFp( significand, 1 - Traits::EXPONENT_BIAS );
+
+    // The boundaries halfway to the neighbours; the lower one is closer at a power of two.
+    const DiyFp plus = DiyFp( ( value.f << 1 ) + 1, value.e - 1 ).Normalize();
+    DiyFp minus = ( value.f == hidden ) ? DiyFp( ( value.f << 2 ) - 1, value.e - 2 ) : DiyFp( ( value.f << 1 ) - 1, value.e - 1 );
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    const DiyFp c = CachedPower( plus.e, K );
+    const DiyFp w = value.Normalize() * c;
+    DiyFp high = plus * c;
+    DiyFp low = minus * c;
+    ++low.f;
+    --high.f;
+    DigitGen( w, high, high.f - low.f, digits, len, K );
+}
+
+// Lay out digits * 10^K like %g: positional for exponents -4 to 16, else d.ddde+XX
+static char* FormatDecimal( const char* digits, int len, int K, char* out )
+{
+    const int exp10 = len + K - 1;	// of the first digit
+    if ( -4 <= exp10 && exp10 < 17 ) {
+        if ( exp10 < 0 ) {
+            *out++ = '0';
+            *out++ = '.';
+            for ( int i = -1; i > exp10; --i ) {
+                *out++ = '0';
+            }
+            memcpy( out, digits, len );
+            return out + len;
+        }
+        if ( exp10 + 1 >= len ) {
+            memcpy( out, digits, len );
+            out += len;
+            for ( int i = len; i <= exp10; ++i ) {
+                *out++ = '0';
+            }
+            return out;
+        }
+        memcpy( out, digits, exp10 + 1 );
+        out += exp10 + 1;
+        *out++ = '.';
+        memcpy( out, digits + exp10 + 1, len - exp10 - 1 );
+        return out + len - exp10 - 1;
+    }
+    *out++ = digits[0];
+    if ( len > 1 ) {
+        *out++ = '.';
+        memcpy( out, digits + 1, len - 1 );
+        out += len - 1;
+    }
+    *out++ = 'e';
+    *out++ = exp10 < 0 ? '-' : '+';
+    const int e = exp10 < 0 ? -exp10 : exp10;
+    if ( e < 10 ) {
+        *out++ = '0';	// two exponent digits at least, as printf
+    }
+    return AppendDecimal( static_cast<uint64_t>( e ), out );
+}
+
+template<typename T>
+static char* AppendFloat( T v, char* out )
+{
+    typename FloatTraits<T>::Bits bits;
+    memcpy( &bits, &v, sizeof( bits ) );
+    if ( v != v ) {
+        memcpy( out, "nan", 3 );
+        return out + 3;
+    }
+    if ( bits >> ( sizeof( bits ) * 8 - 1 ) ) {
+        *out++ = '-';
+        v = -v;
+    }
+    if ( v == 0 ) {
+        *out++ = '0';
+        return out;
+    }
+    if ( v - v != 0 ) {
+        memcpy( out, "inf", 3 );
+        return out + 3;
+    }
+    char digits[20];
+    int len = 0;
+    int K = 0;
+    Grisu2( v, digits, &len, &K );
+    return FormatDecimal( digits, len, K, out );
+}
+
+// Fast path for [white space][sign]digits[.digits][e[sign]digits]. Returns
+// false for anything it can not convert exactly; the caller then scans.
+template<typename T>
+static bool ParseFloat( const char* p, T* value )
+{
+    typedef FloatTraits<T> Traits;
+    while ( XMLUtil::IsWhiteSpace( *p ) ) {
+        ++p;
+    }
+    bool negative = false;
+    if ( *p == '-' || *p == '+' ) {
+        negative = ( *p == '-' );
+        ++p;
+    }
+    uint64_t mantissa = 0;
+    int significant = 0;
+    int exp10 = 0;
+    bool any = false;
+    for ( ; IsDigit( *p ); ++p ) {
+        any = true;
+        if ( mantissa || *p != '0' ) {
+            mantissa = mantissa * 10 + ( *p - '0' );
+            ++significant;
+        }
+        if ( significant > 19 ) {
+            return false;
+        }
+    }
+    if ( *p == '.' ) {
+        for ( ++p; IsDigit( *p ); ++p ) {
+            any = true;
+            if ( mantissa || *p != '0' ) {
+                mantissa = mantissa * 10 + ( *p - '0' );
+                ++significant;
+            }
+            --exp10;
+            if ( significant > 19 ) {
+                return false;
+            }
+        }
+    }
+    if ( !any || *p == 'x' || *p == 'X' ) {
+        return false;	// inf, nan, hex
+    }
+    if ( *p == 'e' || *p == 'E' ) {
+        ++p;
+        bool negativeExp = false;
+        if ( *p == '-' || *p == '+' ) {
+            negativeExp = ( *p == '-' );
+            ++p;
+        }
+        if ( !IsDigit( *p ) ) {
+            return false;
+        }
+        int e = 0;
+        for ( ; IsDigit( *p ); ++p ) {
+            if ( e > 9999 ) {
+                return false;
+            }
+            e = e * 10 + ( *p - '0' );
+        }
+        exp10 += negativeExp ? -e : e;
+    }
+    if ( mantissa == 0 ) {
+        *value = negative ? -T( 0 ) : T( 0 );
+        return true;
+    }
+    if ( mantissa > Traits::MaxExactMantissa() || exp10 < -Traits::MAX_EXACT_POW10 || exp10 > Traits::MAX_EXACT_POW10 ) {
+        return false;
+    }
+    T r = static_cast<T>( mantissa );
+    r = exp10 < 0 ? r / Traits::Pow10( -exp10 ) : r * Traits::Pow10( exp10 );
+    *value = negative ? -r : r;
+    return true;
+}
+
+// Fast path for [white space][sign]digits up to limit (for a '-', up to
+// limit + 1 would still fit; the callers check). Hex and out of range text
+// goes to scanf.
+static bool ParseDecimal( const char* p, uint64_t limit, bool* negative, uint64_t* value )
+{
+    while ( XMLUtil::IsWhiteSpace( *p ) ) {
+        ++p;
+    }
+    *negative = ( *p == '-' );
+    if ( *p == '-' || *p == '+' ) {
+        ++p;
+    }
+    if ( !IsDigit( *p ) ) {
+        return false;
+    }
+    uint64_t v = 0;
+    for ( ; IsDigit( *p ); ++p ) {
+        const unsigned d = static_cast<unsigned>( *p - '0' );
+        if ( v > ( limit - d ) / 10 ) {
+            return false;
+        }
+        v = v * 10 + d;
+    }
+    *value = v;
+    return true;
+}
+
+// ToStr() writes like snprintf: at most bufferSize - 1 characters, then a terminator
+template<typename T>
+static void NumberToStr( T v, char* buffer, int bufferSize )
+{
+    TIXMLASSERT( bufferSize > 0 );
+    if ( bufferSize > XMLUtil::MAX_NUMBER_CHARS ) {
+        *XMLUtil::AppendNumber( v, buffer ) = 0;
+        return;
+    }
+    char num[XMLUtil::MAX_NUMBER_CHARS];
+    const size_t len = XMLUtil::AppendNumber( v, num ) - num;
+    const size_t n = len < static_cast<size_t>( bufferSize - 1 ) ? len : static_cast<size_t>( bufferSize - 1 );
+    memcpy( buffer, num, n );
+    buffer[n] = 0;
+}
+
+
+char* XMLUtil::AppendNumber( int v, char* out )
+{
+    return AppendSigned( v, out );
+}
+
+
+char* XMLUtil::AppendNumber( unsigned v, char* out )
+{
+    return AppendDecimal( v, out );
+}
+
+
+char* XMLUtil::AppendNumber( int64_t v, char* out )
+{
+    return AppendSigned( v, out );
+}
+
+
+char* XMLUtil::AppendNumber( uint64_t v, char* out )
+{
+    return AppendDecimal( v, out );
+}
+
+
+char* XMLUtil::AppendNumber( float v, char* out )
+{
+    return AppendFloat( v, out );
+}
+
+
+char* XMLUtil::AppendNumber( double v, char* out )
+{
+    return AppendFloat( v, out );
+}
+
+
 void XMLUtil::ToStr( int v, char* buffer, int bufferSize )
 {
-    TIXML_SNPRINTF( buffer, bufferSize, "%d", v );
+    NumberToStr( v, buffer, bufferSize );
 }
 
 
 void XMLUtil::ToStr( unsigned v, char* buffer, int bufferSize )
 {
-    TIXML_SNPRINTF( buffer, bufferSize, "%u", v );
+    NumberToStr( v, buffer, bufferSize );
 }
 
 
@@ -583,33 +1497,39 @@ void XMLUtil::ToStr( bool v, char* buffer, int bufferSize )
 /*
 	ToStr() of a number is a very tricky topic.
 	https://github.com/leethomason/tinyxml2/issues/106
+	Floating point values get the shortest text that reads back to the same
+	value (see above), rather than a fixed %.8g / %.17g.
 */
 void XMLUtil::ToStr( float v, char* buffer, int bufferSize )
 {
-    TIXML_SNPRINTF( buffer, bufferSize, "%.8g", v );
+    NumberToStr( v, buffer, bufferSize );
 }
 
 
 void XMLUtil::ToStr( double v, char* buffer, int bufferSize )
 {
-    TIXML_SNPRINTF( buffer, bufferSize, "%.17g", v );
+    NumberToStr( v, buffer, bufferSize );
 }
 
 
 void XMLUtil::ToStr( int64_t v, char* buffer, int bufferSize )
 {
-	// horrible syntax trick to make the compiler happy about %lld
-	TIXML_SNPRINTF(buffer, bufferSize, "%lld", static_cast<long long>(v));
+    NumberToStr( v, buffer, bufferSize );
 }
 
 void XMLUtil::ToStr( uint64_t v, char* buffer, int bufferSize )
 {
-    // horrible syntax trick to make the compiler happy about %llu
-    TIXML_SNPRINTF(buffer, bufferSize, "%llu", (long long)v);
+    NumberToStr( v, buffer, bufferSize );
 }
 
 bool XMLUtil::ToInt(const char* str, int* value)
 {
+    bool negative;
+    uint64_t v;
+    if ( !IsPrefixHex( str ) && ParseDecimal( str, uint64_t( INT_MAX ) + 1, &negative, &v ) && ( negative || v <= INT_MAX ) ) {
+        *value = negative ? static_cast<int>( 0 - static_cast<int64_t>( v ) ) : static_cast<int>( v );
+        return true;
+    }
     if (TIXML_SSCANF(str, IsPrefixHex(str) ? "%x" : "%d", value) == 1) {
         return true;
     }
@@ -618,6 +1538,12 @@ bool XMLUtil::ToInt(const char* str, int* value)
 
 bool XMLUtil::ToUnsigned(const char* str, unsigned* value)
 {
+    bool negative;
+    uint64_t v;
+    if ( !IsPrefixHex( str ) && ParseDecimal( str, UINT_MAX, &negative, &v ) && !negative ) {
+        *value = static_cast<unsigned>( v );
+        return true;
+    }
     if (TIXML_SSCANF(str, IsPrefixHex(str) ? "%x" : "%u", value) == 1) {
         return true;
     }
@@ -652,6 +1578,9 @@ bool XMLUtil::ToBool( const char* str, bool* value )
 
 bool XMLUtil::ToFloat( const char* str, float* value )
 {
+    if ( ParseFloat( str, value ) ) {
+        return true;
+    }
     if ( TIXML_SSCANF( str, "%f", value ) == 1 ) {
         return true;
     }
@@ -661,6 +1590,9 @@ bool XMLUtil::ToFloat( const char* str, float* value )
 
 bool XMLUtil::ToDouble( const char* str, double* value )
 {
+    if ( ParseFloat( str, value ) ) {
+        return true;
+    }
     if ( TIXML_SSCANF( str, "%lf", value ) == 1 ) {
         return true;
     }
@@ -670,6 +1602,12 @@ bool XMLUtil::ToDouble( const char* str, double* value )
 
 bool XMLUtil::ToInt64(const char* str, int64_t* value)
 {
+	bool negative;
+	uint64_t u;
+	if (!IsPrefixHex(str) && ParseDecimal(str, uint64_t(INT64_MAX) + 1, &negative, &u) && (negative || u <= uint64_t(INT64_MAX))) {
+		*value = negative ? static_cast<int64_t>(0 - u) : static_cast<int64_t>(u);
+		return true;
+	}
 	long long v = 0;	// horrible syntax trick to make the compiler happy about %lld
 	if (TIXML_SSCANF(str, IsPrefixHex(str) ? "%llx" : "%lld", &v) == 1) {
 		*value = static_cast<int64_t>(v);
@@ -680,6 +1618,12 @@ bool XMLUtil::ToInt64(const char* str, int64_t* value)
 
 
 bool XMLUtil::ToUnsigned64(const char* str, uint64_t* value) {
+    bool negative;
+    uint64_t u;
+    if ( !IsPrefixHex( str ) && ParseDecimal( str, UINT64_MAX, &negative, &u ) && !negative ) {
+        *value = u;
+        return true;
+    }
     unsigned long long v = 0;	// horrible syntax trick to make the compiler happy about %llu
     if(TIXML_SSCANF(str, IsPrefixHex(str) ? "%llx" : "%llu", &v) == 1) {
         *value = (uint64_t)v;
@@ -695,7 +1639,7 @@ char* XMLDocument::Identify( char* p, XMLNode** node )
     TIXMLASSERT( p );
     char* const start = p;
     int const startLine = _parseCurLineNum;
-    p = XMLUtil::SkipWhiteSpace( p, &_parseCurLineNum );
+    p = XMLUtil::SkipWhiteSpace( p, _trackLineNumbers ? &_parseCurLineNum : 0 );
     if( !*p ) {
         *node = 0;
         TIXMLASSERT( p );
@@ -1657,31 +2601,32 @@ void	XMLElement::SetText( const char* inText )
 
 void XMLElement::SetText( int v )
 {
-    char buf[BUF_SIZE];
-    XMLUtil::ToStr( v, buf, BUF_SIZE );
+    char buf[XMLUtil::MAX_NUMBER_CHARS + 1];
+    *XMLUtil::AppendNumber( v, buf ) = 0;
     SetText( buf );
 }
 
 
 void XMLElement::SetText( unsigned v )
 {
-    char buf[BUF_SIZE];
-    XMLUtil::ToStr( v, buf, BUF_SIZE );
+    char buf[XMLUtil::MAX_NUMBER_CHARS + 1];
+    *XMLUtil::AppendNumber( v, buf ) = 0;
     SetText( buf );
 }
 
 
-void XMLElement::SetText(int64_t v)
+void XMLElement::SetText( int64_t v )
 {
-	char buf[BUF_SIZE];
-	XMLUtil::ToStr(v, buf, BUF_SIZE);
-	SetText(buf);
+    char buf[XMLUtil::MAX_NUMBER_CHARS + 1];
+    *XMLUtil::AppendNumber( v, buf ) = 0;
+    SetText( buf );
 }
 
-void XMLElement::SetText(uint64_t v) {
-    char buf[BUF_SIZE];
-    XMLUtil::ToStr(v, buf, BUF_SIZE);
-    SetText(buf);
+void XMLElement::SetText( uint64_t v )
+{
+    char buf[XMLUtil::MAX_NUMBER_CHARS + 1];
+    *XMLUtil::AppendNumber( v, buf ) = 0;
+    SetText( buf );
 }
 
 
@@ -1695,16 +2640,16 @@ void XMLElement::SetText( bool v )
 
 void XMLElement::SetText( float v )
 {
-    char buf[BUF_SIZE];
-    XMLUtil::ToStr( v, buf, BUF_SIZE );
+    char buf[XMLUtil::MAX_NUMBER_CHARS + 1];
+    *XMLUtil::AppendNumber( v, buf ) = 0;
     SetText( buf );
 }
 
 
 void XMLElement::SetText( double v )
 {
-    char buf[BUF_SIZE];
-    XMLUtil::ToStr( v, buf, BUF_SIZE );
+    char buf[XMLUtil::MAX_NUMBER_CHARS + 1];
+    *XMLUtil::AppendNumber( v, buf ) = 0;
     SetText( buf );
 }
 
@@ -1871,7 +2816,12 @@ XMLAttribute* XMLElement::FindOrCreateAttribute( const char* name )
             TIXMLASSERT( _rootAttribute == 0 );
             _rootAttribute = attrib;
         }
-        attrib->SetName( name );
+        if ( _document->_internNames ) {
+            attrib->_name.SetInternedStr( _document->Intern( name ) );
+        }
+        else {
+            attrib->SetName( name );
+        }
     }
     return attrib;
 }
@@ -1916,7 +2866,13 @@ char* XMLElement::ParseAttributes( char* p, int* curLineNumPtr )
 
             const int attrLineNum = attrib->_parseLineNum;
 
+            char* const name = p;
             p = attrib->ParseDeep( p, _document->ProcessEntities(), curLineNumPtr );
+            if ( p && _document->_internNames ) {
+                // ParseDeep() ended the name at the first non-name character.
+                const char* nameEnd = XMLUtil::SkipNameChars( name + 1 );
+                attrib->_name.SetInternedStr( _document->Intern( name, nameEnd - name ) );
+            }
             if ( !p || Attribute( attrib->Name() ) ) {
                 DeleteAttribute( attrib );
                 _document->SetError( XML_ERROR_PARSING_ATTRIBUTE, attrLineNum, "XMLElement name=%s", Name() );
@@ -2025,10 +2981,14 @@ char* XMLElement::ParseDeep( char* p, StrPair* parentEndTag, int* curLineNumPtr
         ++p;
     }
 
+    char* const name = p;
     p = _value.ParseName( p );
     if ( _value.Empty() ) {
         return 0;
     }
+    if ( _document->_internNames ) {
+        _value.SetInternedStr( _document->Intern( name, p - name ) );
+    }
 
     p = ParseAttributes( p, curLineNumPtr );
     if ( !p || !*p || _closingType != OPEN ) {
@@ -2129,8 +3089,19 @@ XMLDocument::XMLDocument( bool processEntities, Whitespace whitespaceMode ) :
     _errorStr(),
     _errorLineNum( 0 ),
     _charBuffer( 0 ),
+    _charBufferOwned( true ),
+    _trackLineNumbers( true ),
     _parseCurLineNum( 0 ),
 	_parsingDepth(0),
+    _internNames( false ),
+    _nameSlots( 0 ),
+    _nameSlotCount( 0 ),
+    _nameCount( 0 ),
+    _nameBlocks(),
+    _nameBlockPos( 0 ),
+    _nameBlockFree( 0 ),
+    _lastName( 0 ),
+    _lastNameLen( 0 ),
     _unlinked(),
     _elementPool(),
     _attributePool(),
@@ -2145,6 +3116,7 @@ XMLDocument::XMLDocument( bool processEntities, Whitespace whitespaceMode ) :
 XMLDocument::~XMLDocument()
 {
     Clear();
+    FreeNameTable();
 }
 
 
@@ -2173,8 +3145,11 @@ void XMLDocument::Clear()
 #endif
     ClearError();
 
-    delete [] _charBuffer;
+    if ( _charBufferOwned ) {
+        delete [] _charBuffer;
+    }
     _charBuffer = 0;
+    _charBufferOwned = true;
 	_parsingDepth = 0;
 
 #if 0
@@ -2195,6 +3170,129 @@ void XMLDocument::Clear()
 }
 
 
+void XMLDocument::Recycle()
+{
+    Clear();
+    _elementPool.Recycle();
+    _attributePool.Recycle();
+    _textPool.Recycle();
+    _commentPool.Recycle();
+}
+
+
+void XMLDocument::SetMemPoolBlockSize( size_t elementBytes, size_t attributeBytes, size_t textBytes, size_t commentBytes )
+{
+    _elementPool.SetBlockSize( elementBytes );
+    _attributePool.SetBlockSize( attributeBytes );
+    _textPool.SetBlockSize( textBytes );
+    _commentPool.SetBlockSize( commentBytes );
+}
+
+
+int XMLDocument::MemPoolBlockCount() const
+{
+    return _elementPool.BlockCount() + _attributePool.BlockCount() + _textPool.BlockCount() + _commentPool.BlockCount();
+}
+
+
+const char* XMLDocument::Intern( const char* str, size_t len )
+{
+    TIXMLASSERT( str );
+    // Writers and parsers tend to ask for the same name many times in a row.
+    if ( _lastName && _lastNameLen == len && memcmp( _lastName, str, len ) == 0 ) {
+        return _lastName;
+    }
+    if ( ( _nameCount + 1 ) * 2 > _nameSlotCount ) {
+        GrowNameTable();
+    }
+    // FNV-1a
+    unsigned hash = 2166136261u;
+    for ( size_t i = 0; i < len; ++i ) {
+        hash = ( hash ^ (unsigned char)str[i] ) * 16777619u;
+    }
+    const int mask = _nameSlotCount - 1;
+    int slot = (int)( hash & (unsigned)mask );
+    while ( _nameSlots[slot] ) {
+        const char* name = _nameSlots[slot];
+        if ( strncmp( name, str, len ) == 0 && name[len] == 0 ) {
+            _lastName = name;
+            _lastNameLen = len;
+            return name;
+        }
+        slot = ( slot + 1 ) & mask;
+    }
+
+    static const size_t NAME_BLOCK_SIZE = 4 * 1024;
+    char* copy;
+    if ( len + 1 > NAME_BLOCK_SIZE / 4 ) {
+        // Long names get a block of their own.
+        copy = new char[len + 1];
+        _nameBlocks.Push( copy );
+    }
+    else {
+        if ( _nameBlockFree < len + 1 ) {
+            _nameBlockPos = new char[NAME_BLOCK_SIZE];
+            _nameBlockFree = NAME_BLOCK_SIZE;
+            _nameBlocks.Push( _nameBlockPos );
+        }
+        copy = _nameBlockPos;
+        _nameBlockPos += len + 1;
+        _nameBlockFree -= len + 1;
+    }
+    memcpy( copy, str, len );
+    copy[len] = 0;
+    _nameSlots[slot] = copy;
+    ++_nameCount;
+    _lastName = copy;
+    _lastNameLen = len;
+    return copy;
+}
+
+
+void XMLDocument::GrowNameTable()
+{
+    const char** old = _nameSlots;
+    const int oldCount = _nameSlotCount;
+    _nameSlotCount = oldCount ? oldCount * 2 : 64;
+    _nameSlots = new const char*[_nameSlotCount];
+    memset( _nameSlots, 0, _nameSlotCount * sizeof( *_nameSlots ) );
+    _nameCount = 0;
+    for ( int i = 0; i < oldCount; ++i ) {
+        if ( old[i] ) {
+            // Strings already in the blocks: just find their new slots.
+            const size_t len = strlen( old[i] );
+            unsigned hash = 2166136261u;
+            for ( size_t k = 0; k < len; ++k ) {
+                hash = ( hash ^ (unsigned char)old[i][k] ) * 16777619u;
+            }
+            int slot = (int)( hash & (unsigned)( _nameSlotCount - 1 ) );
+            while ( _nameSlots[slot] ) {
+                slot = ( slot + 1 ) & ( _nameSlotCount - 1 );
+            }
+            _nameSlots[slot] = old[i];
+            ++_nameCount;
+        }
+    }
+    delete [] old;
+}
+
+
+void XMLDocument::FreeNameTable()
+{
+    while ( !_nameBlocks.Empty() ) {
+        delete [] _nameBlocks.Pop();
+    }
+    delete [] _nameSlots;
+    _nameSlots = 0;
+    _nameSlotCount = 0;
+    _nameCount = 0;
+    _nameBlockPos = 0;
+    _nameBlockFree = 0;
+    _lastName = 0;
+    _lastNameLen = 0;
+}
+
+
 void XMLDocument::DeepCopy(XMLDocument* target) const
 {
 	TIXMLASSERT(target);
@@ -2208,10 +3306,10 @@ void XMLDocument::DeepCopy(XMLDocument* target) const
 	}
 }
 
-XMLElement* XMLDocument::NewElement( const char* name )
+XMLElement* XMLDocument::NewElement( const char* name, bool staticMem )
 {
     XMLElement* ele = CreateUnlinkedNode<XMLElement>( _elementPool );
-    ele->SetName( name );
+    ele->SetName( name, staticMem );
     return ele;
 }
 
@@ -2350,6 +3448,12 @@ XMLError XMLDocument::LoadFile( FILE* fp )
     _charBuffer[size] = 0;
 
     Parse();
+    if ( Error() && !_trackLineNumbers ) {
+        // Read and parse again, counting lines, to find where it failed.
+        _trackLineNumbers = true;
+        LoadFile( fp );
+        _trackLineNumbers = false;
+    }
     return _errorID;
 }
 
@@ -2401,6 +3505,13 @@ XMLError XMLDocument::Parse( const char* p, size_t len )
     _charBuffer[len] = 0;
 
     Parse();
+    if ( Error() && !_trackLineNumbers ) {
+        // Parse again, counting lines, to find where it failed.
+        _trackLineNumbers = true;
+        Parse( p, len );
+        _trackLineNumbers = false;
+        return _errorID;
+    }
     if ( Error() ) {
         // clean up now essentially dangling memory.
         // and the parse fail can put objects in the
@@ -2415,6 +3526,30 @@ XMLError XMLDocument::Parse( const char* p, size_t len )
 }
 
 
+XMLError XMLDocument::ParseInSitu( char* p, size_t len )
+{
+    Clear();
+
+    if ( len == 0 || !p || !*p ) {
+        SetError( XML_ERROR_EMPTY_DOCUMENT, 0, 0 );
+        return _errorID;
+    }
+    TIXMLASSERT( p[len] == 0 );
+    _charBuffer = p;
+    _charBufferOwned = false;
+
+    Parse();
+    if ( Error() ) {
+        DeleteChildren();
+        _elementPool.Clear();
+        _attributePool.Clear();
+        _textPool.Clear();
+        _commentPool.Clear();
+    }
+    return _errorID;
+}
+
+
 void XMLDocument::Print( XMLPrinter* streamer ) const
 {
     if ( streamer ) {
@@ -2483,16 +3618,19 @@ void XMLDocument::Parse()
 {
     TIXMLASSERT( NoChildren() ); // Clear() must have been called previously
     TIXMLASSERT( _charBuffer );
-    _parseCurLineNum = 1;
-    _parseLineNum = 1;
+    // Without tracking the counter stays at 0 ("unknown") and a null
+    // pointer is passed down, which selects the scanners that don't count.
+    int* const curLineNumPtr = _trackLineNumbers ? &_parseCurLineNum : 0;
+    _parseCurLineNum = _trackLineNumbers ? 1 : 0;
+    _parseLineNum = _parseCurLineNum;
     char* p = _charBuffer;
-    p = XMLUtil::SkipWhiteSpace( p, &_parseCurLineNum );
+    p = XMLUtil::SkipWhiteSpace( p, curLineNumPtr );
     p = const_cast<char*>( XMLUtil::ReadBOM( p, &_writeBOM ) );
     if ( !*p ) {
         SetError( XML_ERROR_EMPTY_DOCUMENT, 0, 0 );
         return;
     }
-    ParseDeep(p, 0, &_parseCurLineNum );
+    ParseDeep(p, 0, curLineNumPtr );
 }
 
 void XMLDocument::PushDepth()
@@ -2749,6 +3887,14 @@ void XMLPrinter::PushAttribute( const char* name, double v )
 }
 
 
+void XMLPrinter::PushAttribute( const char* name, float v )
+{
+    char buf[BUF_SIZE];
+    XMLUtil::ToStr( v, buf, BUF_SIZE );
+    PushAttribute( name, buf );
+}
+
+
 void XMLPrinter::CloseElement( bool compactMode )
 {
     --_depth;
@@ -2787,6 +3933,15 @@ void XMLPrinter::SealElementIfJustOpened()
 }
 
 
+void XMLPrinter::PushNumber( const char* text, const char* end )
+{
+    _textDepth = _depth-1;
+
+    SealElementIfJustOpened();
+    Write( text, end - text );
+}
+
+
 void XMLPrinter::PushText( const char* text, bool cdata )
 {
     _textDepth = _depth-1;
@@ -2805,33 +3960,29 @@ void XMLPrinter::PushText( const char* text, bool cdata )
 
 void XMLPrinter::PushText( int64_t value )
 {
-    char buf[BUF_SIZE];
-    XMLUtil::ToStr( value, buf, BUF_SIZE );
-    PushText( buf, false );
+    char buf[XMLUtil::MAX_NUMBER_CHARS];
+    PushNumber( buf, XMLUtil::AppendNumber( value, buf ) );
 }
 
 
 void XMLPrinter::PushText( uint64_t value )
 {
-	char buf[BUF_SIZE];
-	XMLUtil::ToStr(value, buf, BUF_SIZE);
-	PushText(buf, false);
+    char buf[XMLUtil::MAX_NUMBER_CHARS];
+    PushNumber( buf, XMLUtil::AppendNumber( value, buf ) );
 }
 
 
 void XMLPrinter::PushText( int value )
 {
-    char buf[BUF_SIZE];
-    XMLUtil::ToStr( value, buf, BUF_SIZE );
-    PushText( buf, false );
+    char buf[XMLUtil::MAX_NUMBER_CHARS];
+    PushNumber( buf, XMLUtil::AppendNumber( value, buf ) );
 }
 
 
 void XMLPrinter::PushText( unsigned value )
 {
-    char buf[BUF_SIZE];
-    XMLUtil::ToStr( value, buf, BUF_SIZE );
-    PushText( buf, false );
+    char buf[XMLUtil::MAX_NUMBER_CHARS];
+    PushNumber( buf, XMLUtil::AppendNumber( value, buf ) );
 }
 
 
@@ -2845,17 +3996,15 @@ void XMLPrinter::PushText( bool value )
 
 void XMLPrinter::PushText( float value )
 {
-    char buf[BUF_SIZE];
-    XMLUtil::ToStr( value, buf, BUF_SIZE );
-    PushText( buf, false );
+    char buf[XMLUtil::MAX_NUMBER_CHARS];
+    PushNumber( buf, XMLUtil::AppendNumber( value, buf ) );
 }
 
 
 void XMLPrinter::PushText( double value )
 {
-    char buf[BUF_SIZE];
-    XMLUtil::ToStr( value, buf, BUF_SIZE );
-    PushText( buf, false );
+    char buf[XMLUtil::MAX_NUMBER_CHARS];
+    PushNumber( buf, XMLUtil::AppendNumber( value, buf ) );
 }
 
 
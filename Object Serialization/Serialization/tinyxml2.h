@@ -169,6 +169,7 @@ public:
     void SetInternedStr( const char* str ) {
         Reset();
         _start = const_cast<char*>(str);
+        _end = _start + strlen( str );
     }
 
     void SetStr( const char* str, int flags=0 );
@@ -346,7 +347,7 @@ template< int ITEM_SIZE >
 class MemPoolT : public MemPool
 {
 public:
-    MemPoolT() : _blockPtrs(), _root(0), _currentAllocs(0), _nAllocs(0), _maxAllocs(0), _nUntracked(0)	{}
+    MemPoolT() : _blockPtrs(), _root(0), _itemsPerBlock(ITEMS_PER_BLOCK), _currentAllocs(0), _nAllocs(0), _maxAllocs(0), _nUntracked(0)	{}
     ~MemPoolT() {
         MemPoolT< ITEM_SIZE >::Clear();
     }
@@ -354,8 +355,8 @@ public:
     void Clear() {
         // Delete the blocks.
         while( !_blockPtrs.Empty()) {
-            Block* lastBlock = _blockPtrs.Pop();
-            delete lastBlock;
+            Block lastBlock = _blockPtrs.Pop();
+            delete [] lastBlock.items;
         }
         _root = 0;
         _currentAllocs = 0;
@@ -364,6 +365,35 @@ public:
         _nUntracked = 0;
     }
 
+    // Like Clear(), but keeps the blocks: every item is free again, handed
+    // out in block order. Whatever was allocated must be dead by now.
+    void Recycle() {
+        _root = 0;
+        for( int b = _blockPtrs.Size() - 1; b >= 0; --b ) {
+            const Block& block = _blockPtrs[b];
+            for( int i = block.count - 1; i >= 0; --i ) {
+                block.items[i].next = _root;
+                _root = &block.items[i];
+            }
+        }
+        _currentAllocs = 0;
+        _nAllocs = 0;
+        _maxAllocs = 0;
+        _nUntracked = 0;
+    }
+
+    // Bytes per block allocated from now on (at least one item).
+    void SetBlockSize( size_t bytes ) {
+        const size_t items = bytes / ITEM_SIZE;
+        _itemsPerBlock = items < 1 ? 1 : ( items > INT_MAX ? INT_MAX : (int)items );
+    }
+    size_t BlockSize() const {
+        return (size_t)_itemsPerBlock * ITEM_SIZE;
+    }
+    int BlockCount() const {
+        return _blockPtrs.Size();
+    }
+
     virtual int ItemSize() const	{
         return ITEM_SIZE;
     }
@@ -374,14 +404,14 @@ public:
     virtual void* Alloc() {
         if ( !_root ) {
             // Need a new block.
-            Block* block = new Block();
+            Block block = { new Item[_itemsPerBlock], _itemsPerBlock };
             _blockPtrs.Push( block );
 
-            Item* blockItems = block->items;
-            for( int i = 0; i < ITEMS_PER_BLOCK - 1; ++i ) {
+            Item* blockItems = block.items;
+            for( int i = 0; i < block.count - 1; ++i ) {
                 blockItems[i].next = &(blockItems[i + 1]);
             }
-            blockItems[ITEMS_PER_BLOCK - 1].next = 0;
+            blockItems[block.count - 1].next = 0;
             _root = blockItems;
         }
         Item* const result = _root;
@@ -432,6 +462,7 @@ public:
 	//		16k:	5200
 	//		32k:	4300
 	//		64k:	4000	21000
+	// It is the default; SetBlockSize() changes it per pool.
     // Declared public because some compilers do not accept to use ITEMS_PER_BLOCK
     // in private part if ITEMS_PER_BLOCK is private
     enum { ITEMS_PER_BLOCK = (4 * 1024) / ITEM_SIZE };
@@ -445,10 +476,12 @@ private:
         char    itemData[ITEM_SIZE];
     };
     struct Block {
-        Item items[ITEMS_PER_BLOCK];
+        Item*   items;
+        int     count;
     };
-    DynArray< Block*, 10 > _blockPtrs;
+    DynArray< Block, 10 > _blockPtrs;
     Item* _root;
+    int _itemsPerBlock;
 
     int _currentAllocs;
     int _nAllocs;
@@ -553,12 +586,11 @@ public:
     static const char* SkipWhiteSpace( const char* p, int* curLineNumPtr )	{
         TIXMLASSERT( p );
 
-        while( IsWhiteSpace(*p) ) {
-            if (curLineNumPtr && *p == '\n') {
-                ++(*curLineNumPtr);
-            }
-            ++p;
+        // Most calls land directly on markup; only runs go to the vector scan.
+        if ( !IsWhiteSpace(*p) ) {
+            return p;
         }
+        p = SkipWhiteSpaceRun( p, curLineNumPtr );
         TIXMLASSERT( p );
         return p;
     }
@@ -609,12 +641,46 @@ public:
         return ( p & 0x80 ) != 0;
     }
 
+    // Scanners for the parser's inner loops. On x86-64 they test 16 (SSE2)
+    // or 32 (AVX2) bytes at a time; the widest the CPU supports is picked
+    // on first use. Newlines passed over are added to *curLineNumPtr
+    // when it is not null.
+    enum {
+        SCAN_SCALAR,
+        SCAN_SSE2,
+        SCAN_AVX2
+    };
+    static int ScanLevel();
+    // Limit the scanners to 'level' (for testing and benchmarks). Returns
+    // the level in effect, which is never above what the CPU supports.
+    static int SetScanLevel( int level );
+
+    // First byte that is not white space.
+    static const char* SkipWhiteSpaceRun( const char* p, int* curLineNumPtr );
+    // First occurrence of c, or the null terminator.
+    static const char* FindChar( const char* p, char c, int* curLineNumPtr );
+    // First byte that can not continue a name.
+    static const char* SkipNameChars( const char* p );
+    // First byte in [p, end) equal to one of set[0..n), or end. n is 1 to 3.
+    static const char* FindAnyOf( const char* p, const char* end, const char* set, int n );
+
     static const char* ReadBOM( const char* p, bool* hasBOM );
     // p is the starting location,
     // the UTF-8 value of the entity will be placed in value, and length filled in.
     static const char* GetCharacterRef( const char* p, char* value, int* length );
     static void ConvertUTF32ToUTF8( unsigned long input, char* output, int* length );
 
+    // Longest text AppendNumber() writes.
+    enum { MAX_NUMBER_CHARS = 32 };
+    // Writes v at out, without a terminator, and returns the end. Floating
+    // point values get the shortest text that reads back to the same bits.
+    static char* AppendNumber( int v, char* out );
+    static char* AppendNumber( unsigned v, char* out );
+    static char* AppendNumber( int64_t v, char* out );
+    static char* AppendNumber( uint64_t v, char* out );
+    static char* AppendNumber( float v, char* out );
+    static char* AppendNumber( double v, char* out );
+
     // converts primitive types to strings
     static void ToStr( int v, char* buffer, int bufferSize );
     static void ToStr( unsigned v, char* buffer, int bufferSize );
@@ -747,7 +813,8 @@ public:
     */
     void SetValue( const char* val, bool staticMem=false );
 
-    /// Gets the line number the node is in, if the document was parsed from a file.
+    /// Gets the line number the node is in, if the document was parsed from a file
+    /// with line numbers tracked (see XMLDocument::SetTrackLineNumbers()).
     int GetLineNum() const { return _parseLineNum; }
 
     /// Get the parent of this node on the DOM.
@@ -1744,6 +1811,14 @@ public:
     */
     XMLError Parse( const char* xml, size_t nBytes=static_cast<size_t>(-1) );
 
+    /**
+    	Parse XML in place, in a buffer owned by the caller, without
+    	copying it. xml[nBytes] must be readable and 0. The parser
+    	null-terminates and decodes strings inside the buffer, so it must
+    	stay writable and valid until the document is cleared or destroyed.
+    */
+    XMLError ParseInSitu( char* xml, size_t nBytes );
+
     /**
     	Load an XML file from disk.
     	Returns XML_SUCCESS (0) on success, or
@@ -1787,6 +1862,20 @@ public:
         return _whitespaceMode;
     }
 
+    /**
+    	Turn line counting off for files nobody reads by hand: the parser's
+    	inner loops then skip the newline bookkeeping, and GetLineNum()
+    	returns 0. When a parse fails, Parse() and LoadFile() parse again
+    	with counting to report the line of the error. ParseInSitu() can
+    	not, since the first pass has already written into the buffer.
+    */
+    void SetTrackLineNumbers( bool track )	{
+        _trackLineNumbers = track;
+    }
+    bool TrackLineNumbers() const	{
+        return _trackLineNumbers;
+    }
+
     /**
     	Returns true if this document has a leading Byte Order Mark of UTF8.
     */
@@ -1829,9 +1918,11 @@ public:
     /**
     	Create a new Element associated with
     	this Document. The memory for the Element
-    	is managed by the Document.
+    	is managed by the Document. With staticMem
+    	the name is not copied, and must outlive the
+    	Element: a literal, or a string from Intern().
     */
-    XMLElement* NewElement( const char* name );
+    XMLElement* NewElement( const char* name, bool staticMem=false );
     /**
     	Create a new Comment associated with
     	this Document. The memory for the Comment
@@ -1901,6 +1992,51 @@ public:
     /// Clear the document, resetting it to the initial state.
     void Clear();
 
+    /**
+    	Clear the document but keep the memory of its node pools, so that
+    	the next parse or build of a similar document allocates nothing
+    	for its nodes. Nodes are handed out again in block order.
+    */
+    void Recycle();
+
+    /**
+    	Set the bytes per block the element, attribute, text and comment
+    	pools allocate from now on (default 4k each). Larger blocks mean
+    	fewer allocations for big documents; smaller ones less waste for
+    	small ones.
+    */
+    void SetMemPoolBlockSize( size_t elementBytes, size_t attributeBytes, size_t textBytes, size_t commentBytes );
+    /// Blocks the node pools hold, live or free.
+    int MemPoolBlockCount() const;
+
+    /**
+    	Return the copy of str[0..len) in this document's name table:
+    	equal strings give the same pointer, stored once. The table lives
+    	as long as the document (Clear() and Recycle() keep it), so its
+    	strings can name elements without a copy per node:
+    	@verbatim
+    	doc.NewElement( doc.Intern( name, len ), true );
+    	@endverbatim
+    */
+    const char* Intern( const char* str, size_t len );
+    const char* Intern( const char* str ) {
+        return Intern( str, strlen( str ) );
+    }
+
+    /**
+    	Have the parser put element and attribute names in the name table
+    	(see Intern()) instead of pointing into the parsed text, and
+    	SetAttribute() use it instead of copying each new name. Each
+    	distinct name is then stored once, and end tags match their start
+    	tags by pointer.
+    */
+    void SetInternNames( bool intern )	{
+        _internNames = intern;
+    }
+    bool InternNames() const	{
+        return _internNames;
+    }
+
 	/**
 		Copies this document to a target document.
 		The target will be completely cleared before the copy.
@@ -1934,8 +2070,20 @@ private:
     mutable StrPair	_errorStr;
     int             _errorLineNum;
     char*			_charBuffer;
+    bool			_charBufferOwned;	// false after ParseInSitu
+    bool			_trackLineNumbers;
     int				_parseCurLineNum;
 	int				_parsingDepth;
+    bool			_internNames;
+    // Name table: open addressing over strings kept in 4k blocks.
+    const char**	_nameSlots;
+    int				_nameSlotCount;
+    int				_nameCount;
+    DynArray<char*, 4> _nameBlocks;
+    char*			_nameBlockPos;
+    size_t			_nameBlockFree;
+    const char*		_lastName;	// the last hit, tried first
+    size_t			_lastNameLen;
 	// Memory tracking does add some overhead.
 	// However, the code assumes that you don't
 	// have a bunch of unlinked nodes around.
@@ -1970,6 +2118,8 @@ private:
 	private:
 		XMLDocument * _document;
 	};
+	void GrowNameTable();
+	void FreeNameTable();
 	void PushDepth();
 	void PopDepth();
 
@@ -2256,6 +2406,7 @@ public:
 	void PushAttribute( const char* name, uint64_t value );
 	void PushAttribute( const char* name, bool value );
     void PushAttribute( const char* name, double value );
+    void PushAttribute( const char* name, float value );
     /// If streaming, close the Element.
     virtual void CloseElement( bool compactMode=false );
 
@@ -2334,6 +2485,7 @@ protected:
     inline void Write(const char* data) { Write(data, strlen(data)); }
 
     void SealElementIfJustOpened();
+    void PushNumber( const char* text, const char* end );	// text that needs no escaping
     bool _elementJustOpened;
     DynArray< const char*, 10 > _stack;
 